@@ -0,0 +1,592 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "../lib/jsmntree.h"
+
+/*
+ * Benchmark of the phases of a tree's life on generated corpora. Each
+ * result is printed as one JSON object per line, e.g. for jq or a diff
+ * of two runs:
+ *
+ *  {"corpus":"records","size":1048589,"tokens":139234,"phase":"make_tree",
+ *   "iterations":15,"seconds":0.004672817,"mb_per_s":214.006,"ns_per_token":33.561,
+ *   "allocations":221654,"allocated_bytes":5108898,"peak_rss_kb":47188}
+ *
+ * `seconds' is the best of `iterations' runs, and the allocations are
+ * those of one run. `peak_rss_kb' is the high-water mark of the whole
+ * process so far; run a single corpus and size (-c, -s) to isolate it.
+ */
+
+/* Allocations are counted by wrapping the allocator of glibc */
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__) && !defined(__SANITIZE_THREAD__)
+#define BENCH_COUNT_ALLOCATIONS 1
+
+extern void * __libc_malloc(size_t size);
+extern void * __libc_calloc(size_t count, size_t size);
+extern void * __libc_realloc(void * ptr, size_t size);
+extern void __libc_free(void * ptr);
+
+static size_t bench_allocations;
+static size_t bench_allocated_bytes;
+
+void *
+malloc(size_t size)
+{
+    ++bench_allocations;
+    bench_allocated_bytes += size;
+    return __libc_malloc(size);
+}
+
+void *
+calloc(size_t count, size_t size)
+{
+    ++bench_allocations;
+    bench_allocated_bytes += count * size;
+    return __libc_calloc(count, size);
+}
+
+void *
+realloc(void * ptr, size_t size)
+{
+    ++bench_allocations;
+    bench_allocated_bytes += size;
+    return __libc_realloc(ptr, size);
+}
+
+void
+free(void * ptr)
+{
+    __libc_free(ptr);
+}
+#endif /* __GLIBC__ && ! __SANITIZE_ADDRESS__ && ! __SANITIZE_THREAD__ */
+
+/* Items of a corpus are nested in arrays of at most this many */
+#define BENCH_FANOUT        64
+
+/* Phases are repeated until about this many bytes are processed */
+#define BENCH_VOLUME        (16 * 1024 * 1024)
+
+/* A deterministic generator (xorshift64), so that corpora are the same on every run */
+static uint64_t
+bench_random(uint64_t * state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static void
+bench_puts(jsmntree_buffer * buffer, const char * string)
+{
+    if(jsmntree_buffer_append(buffer, string, strlen(string)) != 0)
+    {
+        fprintf(stderr, "Memory error\n");
+        exit(3);
+    }
+}
+
+static void
+bench_printf(jsmntree_buffer * buffer, const char * format, long long a, long long b)
+{
+    char text[64];
+
+    snprintf(text, sizeof(text), format, a, b);
+    bench_puts(buffer, text);
+}
+
+/* Objects and arrays nested 128 deep */
+static void
+bench_item_deep(jsmntree_buffer * buffer, uint64_t * state, const size_t n)
+{
+    int i;
+
+    (void)n;
+
+    for(i = 0; i < 64; ++i)
+        bench_puts(buffer, "{\"a\":[");
+    bench_printf(buffer, "%lld", (long long)(bench_random(state) % 1000), 0);
+    for(i = 0; i < 64; ++i)
+        bench_puts(buffer, "]}");
+}
+
+/* An object of 256 members of mixed types */
+static void
+bench_item_wide(jsmntree_buffer * buffer, uint64_t * state, const size_t n)
+{
+    int i;
+
+    (void)n;
+
+    bench_puts(buffer, "{");
+    for(i = 0; i < 256; ++i)
+    {
+        bench_printf(buffer, (i > 0) ? ",\"field%03lld\":" : "\"field%03lld\":", i, 0);
+
+        switch(i % 4)
+        {
+        case 0:
+            bench_printf(buffer, "%lld", (long long)(bench_random(state) % 100000), 0);
+            break;
+        case 1:
+            bench_printf(buffer, "\"value %lld\"", (long long)(bench_random(state) % 1000), 0);
+            break;
+        case 2:
+            bench_puts(buffer, (bench_random(state) & 1) ? "true" : "false");
+            break;
+        default:
+            bench_puts(buffer, "null");
+            break;
+        }
+    }
+    bench_puts(buffer, "}");
+}
+
+/* A typical record of an API response */
+static void
+bench_item_records(jsmntree_buffer * buffer, uint64_t * state, const size_t n)
+{
+    const long long id = (long long)n;
+
+    bench_printf(buffer, "{\"id\":%lld,\"name\":\"user %lld\",", id, id);
+    bench_printf(buffer, "\"email\":\"user%lld@example.com\",", id, 0);
+    bench_puts(buffer, (bench_random(state) & 1) ? "\"active\":true," : "\"active\":false,");
+    bench_printf(buffer, "\"score\":%lld.%02lld,", (long long)(bench_random(state) % 1000),
+                    (long long)(bench_random(state) % 100));
+    bench_puts(buffer, "\"tags\":[\"alpha\",\"beta\",\"gamma\"],");
+    bench_printf(buffer, "\"address\":{\"city\":\"City %lld\",\"zip\":\"%05lld\"}}",
+                    (long long)(bench_random(state) % 100), (long long)(bench_random(state) % 100000));
+}
+
+/* Integers, negative numbers, reals with exponents and large unsigned */
+static void
+bench_item_numbers(jsmntree_buffer * buffer, uint64_t * state, const size_t n)
+{
+    int i;
+
+    (void)n;
+
+    bench_puts(buffer, "[");
+    for(i = 0; i < 64; ++i)
+    {
+        const long long r = (long long)(bench_random(state) >> 1);
+
+        if(i > 0)
+            bench_puts(buffer, ",");
+
+        switch(i % 4)
+        {
+        case 0:
+            bench_printf(buffer, "%lld", r % 1000000, 0);
+            break;
+        case 1:
+            bench_printf(buffer, "-%lld", r % 1000000000, 0);
+            break;
+        case 2:
+            bench_printf(buffer, "%lld.%06lld", r % 1000, r % 1000000);
+            bench_printf(buffer, "e%lld", r % 40 - 20, 0);
+            break;
+        default:
+            /* From 18446744073000000000 up to UINT64_MAX, above INT64_MAX */
+            bench_printf(buffer, "18446744073%09lld", r % 709551616, 0);
+            break;
+        }
+    }
+    bench_puts(buffer, "]");
+}
+
+/* Strings of 8 to 200 bytes, some with escapes */
+static void
+bench_item_strings(jsmntree_buffer * buffer, uint64_t * state, const size_t n)
+{
+    static const char * const   pieces[] =
+    {
+        "lorem ", "ipsum ", "dolor ", "sit ", "amet ", "\\\"quoted\\\" ",
+        "back\\\\slash ", "new\\nline ", "caf\\u00e9 ", "tab\\t ",
+    };
+    int                         i;
+
+    (void)n;
+
+    bench_puts(buffer, "[");
+    for(i = 0; i < 16; ++i)
+    {
+        const size_t    length  = 8 + bench_random(state) % 192;
+        const size_t    start   = buffer->size;
+
+        bench_puts(buffer, (i > 0) ? ",\"" : "\"");
+        while(buffer->size - start < length)
+            bench_puts(buffer, pieces[bench_random(state) % (sizeof(pieces) / sizeof(pieces[0]))]);
+        bench_puts(buffer, "\"");
+    }
+    bench_puts(buffer, "]");
+}
+
+typedef void (*bench_item_fn)(jsmntree_buffer * buffer, uint64_t * state, const size_t n);
+
+static const struct
+{
+    const char *    name;
+    bench_item_fn   item;
+}
+bench_corpora[] =
+{
+    { "deep",       bench_item_deep     },
+    { "wide",       bench_item_wide     },
+    { "records",    bench_item_records  },
+    { "numbers",    bench_item_numbers  },
+    { "strings",    bench_item_strings  },
+};
+
+/**
+ * Generate a corpus of about `size' bytes. Items are nested in arrays of
+ * BENCH_FANOUT, as deep as needed: jsmn looks for the parent of a token
+ * by scanning back over its siblings, so a flat array of millions of
+ * items would measure that scan alone.
+ */
+static void
+bench_generate(jsmntree_buffer * buffer, const char * name, bench_item_fn item, const size_t size)
+{
+    uint64_t    state   = 88172645463325252ull;
+    size_t      levels  = 1;
+    size_t      items   = 1;
+    size_t      n;
+    size_t      i;
+
+    /* Items needed, from the size of one */
+    item(buffer, &state, 0);
+    items = size / (buffer->size + 1) + 1;
+    buffer->size = 0;
+
+    for(n = BENCH_FANOUT; n < items; n *= BENCH_FANOUT)
+        ++levels;
+
+    bench_puts(buffer, "{\"corpus\":\"");
+    bench_puts(buffer, name);
+    bench_puts(buffer, "\",\"data\":");
+    for(i = 0; i < levels; ++i)
+        bench_puts(buffer, "[");
+
+    for(n = 0; n == 0 || buffer->size + levels + 1 < size; ++n)
+    {
+        /* Close as many arrays as are full, and open new ones */
+        if(n > 0)
+        {
+            size_t full = 0;
+            size_t k;
+
+            for(k = n; k % BENCH_FANOUT == 0 && full + 1 < levels; k /= BENCH_FANOUT)
+                ++full;
+
+            for(i = 0; i < full; ++i)
+                bench_puts(buffer, "]");
+            bench_puts(buffer, ",");
+            for(i = 0; i < full; ++i)
+                bench_puts(buffer, "[");
+        }
+
+        item(buffer, &state, n);
+    }
+
+    for(i = 0; i < levels; ++i)
+        bench_puts(buffer, "]");
+    bench_puts(buffer, "}");
+}
+
+static double
+bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Results of a phase.
+ * @param       seconds     Best time of a run
+ * @param       allocations Allocations of a run
+ * @param       allocated_bytes Bytes allocated by a run
+ */
+typedef struct
+{
+    double      seconds;
+    size_t      allocations;
+    size_t      allocated_bytes;
+}
+bench_phase;
+
+enum
+{
+    BENCH_PARSE,
+    BENCH_MAKE_TREE,
+    BENCH_FPRINT_TREE,
+    BENCH_FREE_TREE,
+    BENCH_PARSE_FUSED,
+    BENCH_PARSE_CONTEXT,
+    BENCH_NUM_PHASES,
+};
+
+static const char * const bench_phase_names[BENCH_NUM_PHASES] =
+{
+    "jsmn_parse", "make_tree", "fprint_tree", "free_tree", "parse_fused", "parse_context",
+};
+
+/* Start timing a phase */
+static double
+bench_begin(void)
+{
+#ifdef BENCH_COUNT_ALLOCATIONS
+    bench_allocations       = 0;
+    bench_allocated_bytes   = 0;
+#endif /* BENCH_COUNT_ALLOCATIONS */
+
+    return bench_now();
+}
+
+/* Stop timing a phase begun at `start' */
+static void
+bench_end(bench_phase * phase, const double start)
+{
+    const double seconds = bench_now() - start;
+
+    if(phase->seconds == 0 || seconds < phase->seconds)
+        phase->seconds = seconds;
+
+#ifdef BENCH_COUNT_ALLOCATIONS
+    phase->allocations      = bench_allocations;
+    phase->allocated_bytes  = bench_allocated_bytes;
+#endif /* BENCH_COUNT_ALLOCATIONS */
+}
+
+/* Run all phases on a corpus and print their results */
+static int
+bench_run(const char * name, const jsmntree_buffer * corpus, const jsmntree_options * options,
+            const unsigned int repeat, FILE * sink)
+{
+    bench_phase         phases[BENCH_NUM_PHASES];
+    jsmntree_options    fused       = *options;
+    jsmntree_context *  context;
+    jsmntok_t *         tokens      = NULL;
+    unsigned int        capacity    = 0;
+    unsigned int        iterations  = repeat;
+    unsigned int        k;
+    int                 num_tokens;
+
+    memset(phases, 0, sizeof(phases));
+    fused.flags |= JSMNTREE_FLAG_FUSED;
+
+    /* Size the tokens once; jsmn_parse() is then timed alone */
+    num_tokens = jsmntree_parse_tokens(corpus->data, corpus->size, &tokens, &capacity);
+    if(num_tokens <= 0)
+    {
+        fprintf(stderr, "Parse error (%d) in %s\n", num_tokens, name);
+        free(tokens);
+        return -1;
+    }
+
+    if(iterations * corpus->size < BENCH_VOLUME)
+        iterations = BENCH_VOLUME / corpus->size;
+
+    /* Reused from one iteration to the next, as by a server */
+    context = jsmntree_context_create(&fused);
+    if(context == NULL)
+    {
+        fprintf(stderr, "Memory error in %s\n", name);
+        free(tokens);
+        return -1;
+    }
+
+    for(k = 0; k < iterations; ++k)
+    {
+        jsmn_parser         parser;
+        jsmntree_object *   tree;
+        double              start;
+
+        jsmn_init(&parser);
+        start = bench_begin();
+        jsmn_parse(&parser, corpus->data, corpus->size, tokens, capacity);
+        bench_end(&phases[BENCH_PARSE], start);
+
+        start = bench_begin();
+        tree = jsmntree_make_tree_ex(corpus->data, corpus->size, tokens, num_tokens, options);
+        bench_end(&phases[BENCH_MAKE_TREE], start);
+
+        if(tree == NULL)
+        {
+            fprintf(stderr, "Memory error in %s\n", name);
+            jsmntree_context_destroy(context);
+            free(tokens);
+            return -1;
+        }
+
+        start = bench_begin();
+        jsmntree_fprint_tree(sink, tree);
+        fflush(sink);
+        bench_end(&phases[BENCH_FPRINT_TREE], start);
+
+        start = bench_begin();
+        jsmntree_free_tree(tree);
+        bench_end(&phases[BENCH_FREE_TREE], start);
+
+        /* jsmn_parse and make_tree in one */
+        start = bench_begin();
+        jsmntree_parse_buffer(corpus->data, corpus->size, &fused, &tree);
+        bench_end(&phases[BENCH_PARSE_FUSED], start);
+
+        if(tree == NULL)
+        {
+            fprintf(stderr, "Fused parse error in %s\n", name);
+            jsmntree_context_destroy(context);
+            free(tokens);
+            return -1;
+        }
+
+        jsmntree_free_tree(tree);
+
+        /* The same, in memory kept from the last iteration */
+        start = bench_begin();
+        jsmntree_context_parse(context, corpus->data, corpus->size, &tree);
+        bench_end(&phases[BENCH_PARSE_CONTEXT], start);
+
+        if(tree == NULL)
+        {
+            fprintf(stderr, "Context parse error in %s\n", name);
+            jsmntree_context_destroy(context);
+            free(tokens);
+            return -1;
+        }
+    }
+
+    jsmntree_context_destroy(context);
+    free(tokens);
+
+    {
+        struct rusage   usage;
+        int             i;
+
+        getrusage(RUSAGE_SELF, &usage);
+
+        for(i = 0; i < BENCH_NUM_PHASES; ++i)
+        {
+            const double seconds = (phases[i].seconds > 0) ? phases[i].seconds : 1e-9;
+
+            printf("{\"corpus\":\"%s\",\"size\":%zu,\"tokens\":%d,\"phase\":\"%s\","
+                    "\"iterations\":%u,\"seconds\":%.9f,\"mb_per_s\":%.3f,\"ns_per_token\":%.3f,",
+                    name, corpus->size, num_tokens, bench_phase_names[i], iterations, seconds,
+                    corpus->size / seconds / (1024 * 1024), seconds * 1e9 / num_tokens);
+#ifdef BENCH_COUNT_ALLOCATIONS
+            printf("\"allocations\":%zu,\"allocated_bytes\":%zu,",
+                    phases[i].allocations, phases[i].allocated_bytes);
+#else /* BENCH_COUNT_ALLOCATIONS */
+            printf("\"allocations\":null,\"allocated_bytes\":null,");
+#endif /* BENCH_COUNT_ALLOCATIONS */
+            printf("\"peak_rss_kb\":%ld}\n", usage.ru_maxrss);
+        }
+        fflush(stdout);
+    }
+
+    return 0;
+}
+
+/* A size such as 4096, 64K, 16M or 1G */
+static size_t
+bench_parse_size(const char * text)
+{
+    char *  end;
+    size_t  size = strtoul(text, &end, 10);
+
+    switch(*end)
+    {
+    case 'G': case 'g':
+        size *= 1024;
+        /* Fall through */
+    case 'M': case 'm':
+        size *= 1024;
+        /* Fall through */
+    case 'K': case 'k':
+        size *= 1024;
+        ++end;
+        break;
+    }
+
+    return (*end == '\0') ? size : 0;
+}
+
+int
+main(const int argc, const char * const argv[])
+{
+    jsmntree_options    options;
+    const char *        corpus_name = NULL;
+    size_t              min_size    = 1024;
+    size_t              max_size    = 32 * 1024 * 1024;
+    unsigned int        repeat      = 3;
+    FILE *              sink;
+    size_t              size;
+    size_t              c;
+    int                 i;
+
+    jsmntree_options_init(&options);
+
+    for(i = 1; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+            corpus_name = argv[++i];
+        else if(strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+            min_size = max_size = bench_parse_size(argv[++i]);
+        else if(strcmp(argv[i], "-m") == 0 && i + 1 < argc)
+            max_size = bench_parse_size(argv[++i]);
+        else if(strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+            repeat = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-a") == 0)
+            options.flags |= JSMNTREE_FLAG_ARENA;
+        else
+        {
+            min_size = 0;
+            break;
+        }
+    }
+
+    if(min_size == 0 || max_size < min_size || repeat == 0)
+    {
+        fprintf(stderr, "Usage: %s [-c deep|wide|records|numbers|strings] [-s size | -m max_size]"
+                        " [-r repeat] [-a]\n"
+                        "Sizes are from 1K up to 32M by a factor of 32 unless given, e.g."
+                        " -m 1G; -a builds trees in an arena.\n", argv[0]);
+        exit(1);
+    }
+
+    sink = fopen("/dev/null", "w");
+    if(sink == NULL)
+    {
+        fprintf(stderr, "File error\n");
+        exit(2);
+    }
+
+    for(c = 0; c < sizeof(bench_corpora) / sizeof(bench_corpora[0]); ++c)
+    {
+        if(corpus_name != NULL && strcmp(corpus_name, bench_corpora[c].name) != 0)
+            continue;
+
+        for(size = min_size; size <= max_size; size *= 32)
+        {
+            jsmntree_buffer corpus = { NULL, 0, 0 };
+
+            bench_generate(&corpus, bench_corpora[c].name, bench_corpora[c].item, size);
+            if(bench_run(bench_corpora[c].name, &corpus, &options, repeat, sink) != 0)
+                exit(5);
+
+            jsmntree_buffer_free(&corpus);
+        }
+    }
+
+    fclose(sink);
+    return 0;
+}
+
+#undef BENCH_VOLUME
+#undef BENCH_FANOUT
+#undef BENCH_COUNT_ALLOCATIONS
@@ -2,113 +2,379 @@
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
-#include <mcheck.h>
 
 #include "../lib/jsmntree.h"
+#include "../lib/jsmntree_batch.h"
+#include "../lib/jsmntree_sax.h"
 
-#define TOKENS_CAPACITY     20000
+/* Minify a document of a batch into its own line */
+static int
+minimize_document(void * context, jsmntree_object * document, jsmntree_buffer * output)
+{
+    const jsmntree_format format = { JSMNTREE_FORMAT_MINIFIED, 0 };
+
+    (void)context;
+
+    if(jsmntree_serialize_buffer(document, &format, output) != 0 ||
+            jsmntree_buffer_append(output, "\n", 1) != 0)
+    {
+        fprintf(stderr, "Memory error\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+static int
+write_stdout(void * context, const char * data, const size_t length)
+{
+    (void)context;
+
+    return (fwrite(data, 1, length, stdout) == length) ? 0 : -1;
+}
+
+/**
+ * State of minifying with SAX callbacks.
+ * @param       output      Output not yet written
+ * @param       decoded     A string with its escapes decoded
+ * @param       comma       Whether a ',' comes before the next value
+ * @param       error       Nonzero once anything failed
+ */
+typedef struct
+{
+    jsmntree_buffer     output;
+    jsmntree_buffer     decoded;
+    int                 comma;
+    int                 error;
+}
+sax_minimizer;
+
+/* Write the output once it is large */
+static int
+sax_flush(sax_minimizer * m, const size_t threshold)
+{
+    if(m->output.size >= threshold && m->output.size > 0)
+    {
+        if(fwrite(m->output.data, 1, m->output.size, stdout) != m->output.size)
+            m->error = 1;
+        m->output.size = 0;
+    }
+
+    return m->error;
+}
+
+static int
+sax_put(sax_minimizer * m, const char * data, const size_t length)
+{
+    if(m->comma && jsmntree_buffer_append(&m->output, ",", 1) != 0)
+        m->error = 1;
+    if(jsmntree_buffer_append(&m->output, data, length) != 0)
+        m->error = 1;
+
+    return sax_flush(m, 64 * 1024);
+}
+
+/* Put a string as a tree would write it: decoded, then escaped again */
+static int
+sax_put_string(sax_minimizer * m, const char * string, const size_t length)
+{
+    const jsmntree_format   format  = { JSMNTREE_FORMAT_MINIFIED, 0 };
+    jsmntree_element        element;
+    size_t                  decoded;
+
+    if(m->decoded.capacity < JSMNTREE_UNESCAPED_MAX(length) + 1)
+    {
+        char * data = realloc(m->decoded.data, JSMNTREE_UNESCAPED_MAX(length) + 1);
+
+        if(data == NULL)
+        {
+            m->error = 1;
+            return m->error;
+        }
+
+        m->decoded.data     = data;
+        m->decoded.capacity = JSMNTREE_UNESCAPED_MAX(length) + 1;
+    }
+
+    decoded = jsmntree_string_unescape_lossy(string, length, m->decoded.data);
+    jsmntree_element_set_string(&element, m->decoded.data, decoded);
+
+    sax_put(m, "", 0);     /* The comma, if any */
+    if(jsmntree_serialize_value(&element, &format, &m->output) != 0)
+        m->error = 1;
+
+    return m->error;
+}
+
+static int
+sax_begin_object(void * context, const size_t size)
+{
+    sax_minimizer * m = context;
+
+    (void)size;
+
+    sax_put(m, "{", 1);
+    m->comma = 0;
+    return m->error;
+}
+
+static int
+sax_begin_array(void * context, const size_t size)
+{
+    sax_minimizer * m = context;
+
+    (void)size;
+
+    sax_put(m, "[", 1);
+    m->comma = 0;
+    return m->error;
+}
+
+static int
+sax_end_object(void * context)
+{
+    sax_minimizer * m = context;
+
+    m->comma = 0;
+    sax_put(m, "}", 1);
+    m->comma = 1;
+    return m->error;
+}
+
+static int
+sax_end_array(void * context)
+{
+    sax_minimizer * m = context;
+
+    m->comma = 0;
+    sax_put(m, "]", 1);
+    m->comma = 1;
+    return m->error;
+}
+
+static int
+sax_key(void * context, const char * name, const size_t length)
+{
+    sax_minimizer * m = context;
+
+    sax_put_string(m, name, length);
+    m->comma = 0;
+    sax_put(m, ":", 1);
+    return m->error;
+}
+
+static int
+sax_value(void * context, const jsmntree_element * value)
+{
+    const jsmntree_format   format  = { JSMNTREE_FORMAT_MINIFIED, 0 };
+    sax_minimizer *         m       = context;
+
+    /* Still escaped as in the file */
+    if(value->value_type == JSMNTREE_STRING)
+        sax_put_string(m, JSMNTREE_VALUE_STRING(&value->value, value->value_length), value->value_length);
+    else
+    {
+        sax_put(m, "", 0);     /* The comma, if any */
+        if(jsmntree_serialize_value(value, &format, &m->output) != 0)
+            m->error = 1;
+    }
+    m->comma = 1;
+    return m->error;
+}
+
+/* Minify a JSON file without making a tree */
+static int
+minimize_sax(const char * fpath)
+{
+    const jsmntree_sax_handler handler =
+    {
+        sax_begin_object, sax_end_object,
+        sax_begin_array, sax_end_array,
+        sax_key, sax_value,
+    };
+    sax_minimizer   m       = { { NULL, 0, 0 }, { NULL, 0, 0 }, 0, 0 };
+    jsmntok_t *     tokens  = NULL;
+    unsigned int    capacity = 0;
+    const char *    data;
+    size_t          size;
+    int             r;
+
+    data = jsmntree_map_file(fpath, NULL, &size);
+    if(data == NULL)
+        return JSMNTREE_ERROR_IO;
+
+    r = jsmntree_parse_tokens(data, size, &tokens, &capacity);
+    if(r >= 0)
+        r = jsmntree_sax_parse(data, tokens, r, &handler, &m);
+
+    if(r == 0 && (jsmntree_buffer_append(&m.output, "\n", 1) != 0 || sax_flush(&m, 0) != 0))
+        r = JSMNTREE_ERROR_IO;
+
+    jsmntree_buffer_free(&m.output);
+    jsmntree_buffer_free(&m.decoded);
+    free(tokens);
+    jsmntree_unmap_file(data, size);
+
+    return r;
+}
+
+/* Print statistics to stderr, as JSON */
+static void
+print_stats(const jsmntree_stats * stats)
+{
+    fprintf(stderr, "{\"objects\":%zu,\"arrays\":%zu,\"members\":%zu,\"elements\":%zu,"
+                    "\"strings\":%zu,\"numbers\":%zu,\"booleans\":%zu,\"nulls\":%zu,",
+            stats->counts[JSMNTREE_OBJECT], stats->counts[JSMNTREE_ARRAY],
+            stats->counts[JSMNTREE_MEMBER], stats->counts[JSMNTREE_ELEMENT],
+            stats->counts[JSMNTREE_STRING],
+            stats->counts[JSMNTREE_NUMBER] + stats->counts[JSMNTREE_UNSIGNED] + stats->counts[JSMNTREE_REAL],
+            stats->counts[JSMNTREE_BOOLEAN], stats->counts[JSMNTREE_NULL]);
+    fprintf(stderr, "\"string_bytes\":%zu,\"pointer_bytes\":%zu,\"node_bytes\":%zu,"
+                    "\"scalar_bytes\":%zu,\"max_depth\":%zu,\"allocations\":%zu,\"allocated_bytes\":%zu,"
+                    "\"invalid_strings\":%zu,",
+            stats->string_bytes, stats->pointer_bytes, stats->node_bytes,
+            stats->scalar_bytes, stats->max_depth, stats->allocations, stats->allocated_bytes,
+            stats->invalid_strings);
+    fprintf(stderr, "\"build_seconds\":%.6f,\"print_seconds\":%.6f,\"free_seconds\":%.6f}\n",
+            stats->build_seconds, stats->print_seconds, stats->free_seconds);
+}
 
 int
 main(const int argc, const char * const argv[])
 {
-    /* malloc tracing */
-    mtrace();
-
     char    fpath[PATH_MAX + 1];
-    char *  buffer;
+    int     ndjson      = 0;
+    int     sax         = 0;
+    int     show_stats  = 0;
+    int     num_threads = 1;
+    const char * path   = NULL;
     jsmntree_object * jsontree = NULL;
 
-    if(argc < 2)
     {
-        fprintf(stderr, "Argument error\n");
-        exit(1);
+        int i;
+        for(i = 1; i < argc; ++i)
+        {
+            if(strcmp(argv[i], "--ndjson") == 0)
+                ndjson = 1;
+            else if(strcmp(argv[i], "--sax") == 0)
+                sax = 1;
+            else if(strcmp(argv[i], "--stats") == 0)
+                show_stats = 1;
+            else if(strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+                num_threads = atoi(argv[++i]);
+            else if(path == NULL)
+                path = argv[i];
+            else
+            {
+                /* More than one file */
+                path = NULL;
+                break;
+            }
+        }
     }
-    strcpy(fpath, argv[1]);
 
+    if(path == NULL || num_threads < 0 || strlen(path) > PATH_MAX)
     {
-        FILE *  fp;
-        long    fsize;
-        size_t  result;
+        fprintf(stderr, "Usage: %s [--ndjson | --sax | --stats] [-j threads] file\n", argv[0]);
+        exit(1);
+    }
+    strcpy(fpath, path);
 
-        /* Open the file */
-        fp = fopen(fpath, "rb");
-        if(fp == NULL)
+    /* Minify straight from the tokens, without a tree */
+    if(sax)
+    {
+        int r = minimize_sax(fpath);
+        if(r == JSMNTREE_ERROR_IO)
         {
             fprintf(stderr, "File error\n");
             exit(2);
         }
+        else if(r != 0)
+        {
+            fprintf(stderr, "Parse error (%d)\n", r);
+            exit(5);
+        }
+
+        return 0;
+    }
 
-        /* Obtain file size */
-        fseek(fp, 0, SEEK_END);
-        fsize = ftell(fp);
-        rewind(fp);
+    /* Minify each line on a pool of threads; 0 threads for all processors */
+    if(ndjson)
+    {
+        jsmntree_options    options;
+        const char *        data;
+        size_t              size;
+        int                 r;
+
+        jsmntree_options_init(&options);
+        options.flags |= JSMNTREE_FLAG_ARENA;
 
-        /* Allocate memory to contain the whole file */
-        buffer = (char *)malloc(sizeof(char) * fsize);
-        if(buffer == NULL)
+        data = jsmntree_map_file(fpath, &options, &size);
+        if(data == NULL)
         {
-            fprintf(stderr, "Memory error\n");
-            exit(3);
+            fprintf(stderr, "File error\n");
+            exit(2);
         }
 
-        /* Copy the file into the buffer */
-        result = fread(buffer, 1, fsize, fp);
-        if(result != fsize)
+        r = jsmntree_batch(data, size, &options, num_threads,
+                            minimize_document, NULL, write_stdout, NULL);
+        jsmntree_unmap_file(data, size);
+
+        if(r != 0)
         {
-            fprintf(stderr, "Read error\n");
-            exit(4);
+            fprintf(stderr, "Parse error (%d)\n", r);
+            exit(5);
         }
 
-        /* Close the file */
-        fclose(fp);
+        return 0;
     }
 
     {
-        jsmn_parser parser;
-        char buf[strlen(buffer)];
-
-        jsmn_init(&parser);
+        /* Map the JSON file and make a JSON tree on `num_threads' threads */
+        jsmntree_options    options;
+        jsmntree_stats      stats;
+        int                 r;
 
-        /* Initialise tokens */
-        jsmntok_t tokens[TOKENS_CAPACITY] = { JSMN_UNDEFINED, };
+        jsmntree_options_init(&options);
+        options.num_threads = num_threads;
 
-        /* Parse the JSON file */
-        jsmn_parse(&parser, buffer, strlen(buffer), tokens, TOKENS_CAPACITY);
+        /* In a single pass, unless on several threads */
+        options.flags      |= JSMNTREE_FLAG_FUSED;
 
-#if 0
-        /* Print all tokens */
+        /* What the tree costs, instead of tracing malloc */
+        if(show_stats)
         {
-            int i;
-            for(i = 0; tokens[i].type != JSMN_UNDEFINED; ++i)
-            {
-                strncpy(buf, &buffer[tokens[i].start], tokens[i].end - tokens[i].start);
-                buf[tokens[i].end - tokens[i].start] = '\0';
-                
-                printf("%d: [%d] %d -> %d (%d): %s\n"
-                        , i
-                        , tokens[i].type
-                        , tokens[i].start
-                        , tokens[i].end
-                        , tokens[i].size
-                        , buf);
-            }
+            jsmntree_stats_init(&stats);
+            options.stats = &stats;
         }
-#endif
 
-        /* Make a JSON tree */
-        jsontree = jsmntree_make_tree(buffer, strlen(buffer), tokens, TOKENS_CAPACITY);
+        r = jsmntree_make_tree_from_file(fpath, &options, &jsontree);
+        if(r == JSMNTREE_ERROR_IO)
+        {
+            fprintf(stderr, "File error\n");
+            exit(2);
+        }
+        else if(r != 0)
+        {
+            fprintf(stderr, "Parse error (%d)\n", r);
+            exit(5);
+        }
 
         /* Make a new JSON file using JSON tree */
-        jsmntree_fprint_tree(stdout, jsontree);
-    }
+        {
+            const jsmntree_format format = { JSMNTREE_FORMAT_MINIFIED, 0 };
+            jsmntree_fwrite_tree(stdout, jsontree, &format);
+        }
+
+        if(show_stats)
+            jsmntree_stats_collect(jsontree, &stats);
 
-    /* Free the JSON tree */
-    jsmntree_free_tree(jsontree);
-    free(buffer);
+        /* Free the JSON tree */
+        jsmntree_free_tree(jsontree);
+
+        if(show_stats)
+            print_stats(&stats);
+    }
 
-    /* malloc tracing */
-    muntrace();
     return 0;
 }
-
-#undef TOKENS_CAPACITY
@@ -1,81 +1,197 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <ctype.h>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "jsmntree.h"
+#include "jsmntree_private.h"
 #include "jsmn/jsmn.h"
 #include "algorithm/adt/stack.h"
 
+/**
+ * State shared while building a tree. It is kept with the tree, so that
+ * lazy containers can be built later on.
+ * @param       arena       Arena to allocate from, or NULL for malloc
+ * @param       intern      Table to intern member names in, or NULL
+ * @param       flags       Bitwise OR of enum jsmntree_flag
+ * @param       js          JSON string
+ * @param       len         Length of `js'
+ * @param       tokens      Tokens of `js'
+ * @param       num_tokens  Number of tokens
+ * @param       tree        Tree being built
+ * @param       projection  Members to build, or NULL for all
+ * @param       allocator   Allocator of the tree, or all NULL for malloc
+ * @param       stats       Statistics to record in, or NULL
+ */
+typedef struct
+{
+    jsmntree_arena *        arena;
+    jsmntree_intern *       intern;
+    unsigned int            flags;
+    const char *            js;
+    size_t                  len;
+    const jsmntok_t *       tokens;
+    unsigned int            num_tokens;
+    struct jsmntree_tree *  tree;
+    const jsmntree_projection * projection;
+    jsmntree_allocator      allocator;
+    jsmntree_stats *        stats;
+}
+jsmntree_builder;
+
+/**
+ * A node of a projection: which members of an object are built.
+ * @param       name        Member name; unused at the root
+ * @param       name_length Length of `name'
+ * @param       hash        Hash of `name'
+ * @param       wildcard    Whether the node stands for any name
+ * @param       all         Whether the whole value of the member is built
+ * @param       children    Members built under the member
+ * @param       num_children    Number of `children'
+ * @param       capacity    Allocated number of `children'
+ */
+struct jsmntree_projection
+{
+    char *                          name;
+    size_t                          name_length;
+    uint32_t                        hash;
+    int                             wildcard;
+    int                             all;
+    struct jsmntree_projection *    children;
+    size_t                          num_children;
+    size_t                          capacity;
+};
+
+/**
+ * The root of a tree and what the tree owns. `root' must be the first
+ * member, so that the root object handed out is also the whole tree.
+ * @param       root        Root object
+ * @param       builder     How the tree is built
+ * @param       owns_arena  Whether `builder.arena' is released with the tree
+ * @param       owns_intern Whether `builder.intern' is released with the tree
+ * @param       owned_tokens    Tokens released with the tree, or NULL
+ * @param       mapping     Mapped JSON file unmapped with the tree, or NULL
+ * @param       mapping_size    Size of `mapping'
+ * @param       arenas      Arenas of the threads which built the tree
+ * @param       num_arenas  Number of `arenas'
+ */
+typedef struct jsmntree_tree
+{
+    jsmntree_object     root;
+    jsmntree_builder    builder;
+    int                 owns_arena;
+    int                 owns_intern;
+    jsmntok_t *         owned_tokens;
+    void *              mapping;
+    size_t              mapping_size;
+    jsmntree_arena **   arenas;
+    unsigned int        num_arenas;
+}
+jsmntree_tree;
+
+static void *
+jsmntree_alloc_bytes(jsmntree_builder * builder, const size_t size)
+{
+    /* Threads building the same tree share the statistics */
+    if(builder->stats != NULL)
+    {
+        __atomic_fetch_add(&builder->stats->allocations, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&builder->stats->allocated_bytes, size, __ATOMIC_RELAXED);
+    }
+
+    if(builder->arena != NULL)
+        return jsmntree_arena_alloc(builder->arena, size);
+
+    if(builder->allocator.malloc != NULL)
+        return builder->allocator.malloc(builder->allocator.context, size);
+
+    return malloc(size);
+}
+
 static void *
-jsmntree_alloc(const jsmntreetype_t type, const size_t capacity)
+jsmntree_alloc(jsmntree_builder * builder, const jsmntreetype_t type, const size_t capacity)
 {
-    void * ret = NULL;
+    size_t size = 0;
 
     switch(type)
     {
     case JSMNTREE_OBJECT:
-        ret = malloc(sizeof(jsmntree_object) * capacity);
+        size = sizeof(jsmntree_object) * capacity;
         break;
 
     case JSMNTREE_ARRAY:
-        ret = malloc(sizeof(jsmntree_array) * capacity);
+        size = sizeof(jsmntree_array) * capacity;
         break;
 
     case JSMNTREE_MEMBER:
-        ret = malloc(sizeof(jsmntree_member) * capacity);
+        size = sizeof(jsmntree_member) * capacity;
         break;
 
     case JSMNTREE_ELEMENT:
-        ret = malloc(sizeof(jsmntree_element) * capacity);
+        size = sizeof(jsmntree_element) * capacity;
         break;
 
     case JSMNTREE_MEMBER_ARRAY:
-        ret = malloc(sizeof(jsmntree_member *) * capacity);
+        size = sizeof(jsmntree_member) * capacity;
         break;
 
     case JSMNTREE_ELEMENT_ARRAY:
-        ret = malloc(sizeof(jsmntree_element *) * capacity);
+        size = sizeof(jsmntree_element) * capacity;
         break;
 
     case JSMNTREE_STRING:
-        ret = malloc(sizeof(char) * capacity);
-        break;
-
-    case JSMNTREE_NUMBER:
-    case JSMNTREE_BOOLEAN:
-        ret = malloc(sizeof(int) * capacity);
+        size = sizeof(char) * capacity;
         break;
 
     default:
-        ret = NULL;
-        break;
+        return NULL;
     }
 
-    return ret;
+    return jsmntree_alloc_bytes(builder, size);
 }
 
 static void
-jsmntree_dealloc(void * container)
+jsmntree_dealloc(const jsmntree_builder * builder, void * container)
 {
-    if(container != NULL)
+    if(container == NULL)
+        return;
+
+    if(builder->allocator.free != NULL)
+        builder->allocator.free(builder->allocator.context, container);
+    else
         free(container);
 }
 
+/* Seconds of a monotonic clock, for statistics */
+static double
+jsmntree_clock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
 static void *
 jsmntree_init(void * ptr, const jsmntreetype_t type, const size_t capacity)
 {
     switch(type)
     {
     case JSMNTREE_OBJECT:
+        /* No members yet; `capacity' is set along with `members' */
         memset(ptr, 0, sizeof(jsmntree_object) * capacity);
-        ((jsmntree_object *)ptr)->size      = 0;
-        ((jsmntree_object *)ptr)->capacity  = capacity;
         break;
 
     case JSMNTREE_ARRAY:
         memset(ptr, 0, sizeof(jsmntree_array) * capacity);
-        ((jsmntree_array *)ptr)->size       = 0;
-        ((jsmntree_array *)ptr)->capacity   = capacity;
         break;
 
     case JSMNTREE_MEMBER:
@@ -87,499 +203,3032 @@ jsmntree_init(void * ptr, const jsmntreetype_t type, const size_t capacity)
         break;
 
     case JSMNTREE_MEMBER_ARRAY:
-        memset(ptr, 0, sizeof(jsmntree_member *) * capacity);
+        memset(ptr, 0, sizeof(jsmntree_member) * capacity);
         break;
 
     case JSMNTREE_ELEMENT_ARRAY:
-        memset(ptr, 0, sizeof(jsmntree_element *) * capacity);
+        memset(ptr, 0, sizeof(jsmntree_element) * capacity);
         break;
 
     case JSMNTREE_STRING:
         memset(ptr, 0, sizeof(char) * capacity);
         break;
 
-    case JSMNTREE_NUMBER:
-    case JSMNTREE_BOOLEAN:
-        memset(ptr, 0, sizeof(int) * capacity);
+    default:
+        /* Scalars are stored inline, never allocated */
         break;
     }
 
     return ptr;
 }
 
-jsmntree_object *
-jsmntree_make_tree(const char * js, const size_t len,
-                    const jsmntok_t * tokens, const unsigned int num_tokens)
+/**
+ * A slot of the hash index of an object.
+ * @param       hash        Hash of the name
+ * @param       member      Index of the member plus 1; 0 if empty
+ */
+typedef struct
 {
-    if(tokens[0].type == JSMN_UNDEFINED)
-        return NULL;
+    uint32_t            hash;
+    uint32_t            member;
+}
+jsmntree_index_slot;
+
+/**
+ * Open-addressing hash index of the members of an object, by name. Every
+ * member has a slot of its own, so that members can be added and removed
+ * in place; a lookup finds the first of duplicate names by position.
+ * @param       mask        Number of slots minus 1 (a power of 2 minus 1)
+ * @param       slots       Slots, linearly probed
+ */
+struct jsmntree_index
+{
+    size_t              mask;
+    jsmntree_index_slot slots[];
+};
 
-    typedef struct
+uint32_t
+jsmntree_hash_name(const char * name, const size_t length)
+{
+    uint32_t    hash    = 2166136261u;
+    size_t      i;
+
+    for(i = 0; i < length; ++i)
     {
-        int             end;
-        void *          c;
-        jsmntreetype_t  c_type;
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
     }
-    stack_node;
 
-    jsmntree_object *   root    = jsmntree_alloc(JSMNTREE_OBJECT, 1);
-    jsmntree_init(root, JSMNTREE_OBJECT, 1);
+    return hash;
+}
 
-    root->members               = jsmntree_alloc(JSMNTREE_MEMBER_ARRAY, tokens[0].size);
-    jsmntree_init(root->members, JSMNTREE_MEMBER_ARRAY, tokens[0].size);
+static int
+jsmntree_member_is(const jsmntree_member * member, const char * key, const size_t keylen)
+{
+    return member->name_length == keylen && memcmp(member->name, key, keylen) == 0;
+}
 
-    adt_stack *         s       = adt_stack_create(sizeof(stack_node));
+/* Release the children of a projection node */
+static void
+jsmntree_projection_clear(jsmntree_projection * node)
+{
+    size_t i;
+
+    for(i = 0; i < node->num_children; ++i)
     {
-        stack_node      snode   = { tokens[0].end, root, JSMNTREE_OBJECT };
-        adt_stack_push(s, &snode);
+        jsmntree_projection_clear(&node->children[i]);
+        free(node->children[i].name);
     }
 
-    int i;
-    for(i = 1; i < num_tokens && tokens[i].type != JSMNTREE_UNDEFINED; ++i)
-    {
-        while(adt_stack_size(s) > 0 &&
-                tokens[i].start > ((stack_node *)adt_stack_top(s))->end)
-            adt_stack_pop(s);
+    free(node->children);
+    node->children      = NULL;
+    node->num_children  = 0;
+    node->capacity      = 0;
+}
 
-        stack_node *    tsc     = (stack_node *)adt_stack_top(s);
+/* Find or add the child of a projection node for a path segment */
+static jsmntree_projection *
+jsmntree_projection_add(jsmntree_projection * node, const char * name, const size_t length)
+{
+    const uint32_t  hash        = jsmntree_hash_name(name, length);
+    const int       wildcard    = (length == 1 && name[0] == '*');
+    size_t          i;
 
-        if(tsc->c_type == JSMNTREE_OBJECT)
-        {
-#if 0
-            /* Destroy all nodes */
-            if(tokens[i].type != JSMNTREE_STRING)
-                return NULL;
-#endif
+    for(i = 0; i < node->num_children; ++i)
+    {
+        jsmntree_projection * child = &node->children[i];
 
-            jsmntree_object *   base_object         = (jsmntree_object *)tsc->c;
-            jsmntree_member **  new_member_array    = base_object->members;
-            new_member_array[base_object->size]     = jsmntree_alloc(JSMNTREE_MEMBER, 1);
-            jsmntree_init(new_member_array[base_object->size], JSMNTREE_MEMBER, 1);
-            
-            jsmntree_member *   new_member          = new_member_array[base_object->size];
-            new_member->name                        = jsmntree_alloc(JSMNTREE_STRING, tokens[i].end - tokens[i].start + 1);
-            jsmntree_init(new_member->name, JSMNTREE_STRING, tokens[i].end - tokens[i].start + 1);
-
-            char *              new_string          = new_member->name;
-            strncpy(new_string, &js[tokens[i].start], tokens[i].end - tokens[i].start);
-            new_string[tokens[i].end - tokens[i].start] = '\0';
+        if(child->wildcard == wildcard && child->hash == hash &&
+                child->name_length == length && memcmp(child->name, name, length) == 0)
+            return child;
+    }
 
-            ++i;
-        }
+    if(node->num_children == node->capacity)
+    {
+        size_t                  new_capacity    = (node->capacity > 0) ? node->capacity * 2 : 4;
+        jsmntree_projection *   new_children    = realloc(node->children, sizeof(jsmntree_projection) * new_capacity);
 
-        switch(tokens[i].type)
-        {
-        case JSMN_OBJECT:
-            {
-                switch(tsc->c_type)
-                {
-                case JSMNTREE_OBJECT:
-                    {
-                        jsmntree_object *   base_object         = (jsmntree_object *)tsc->c;
-                        jsmntree_member **  new_member_array    = base_object->members;
-                        jsmntree_member *   new_member  = new_member_array[base_object->size];
+        if(new_children == NULL)
+            return NULL;
 
-                        new_member->value_type          = JSMNTREE_OBJECT;
-                        new_member->value               = jsmntree_alloc(JSMNTREE_OBJECT, 1);
-                        jsmntree_init(new_member->value, JSMNTREE_OBJECT, 1);
+        node->children  = new_children;
+        node->capacity  = new_capacity;
+    }
 
-                        jsmntree_object *   new_object  = new_member->value;
-                        new_object->members             = jsmntree_alloc(JSMNTREE_MEMBER_ARRAY, tokens[i].size);
-                        jsmntree_init(new_object->members, JSMNTREE_MEMBER_ARRAY, tokens[i].size);
+    jsmntree_projection * child = &node->children[node->num_children];
+    memset(child, 0, sizeof(jsmntree_projection));
 
-                        ++base_object->size;
+    child->name = jsmntree_string_dup(name, length);
+    if(child->name == NULL)
+        return NULL;
 
-                        stack_node snode = { tokens[i].end, new_object, JSMNTREE_OBJECT };
-                        adt_stack_push(s, &snode);
-                    }
-                    break;
+    child->name_length  = length;
+    child->hash         = hash;
+    child->wildcard     = wildcard;
+    ++node->num_children;
 
-                case JSMNTREE_ARRAY:
-                    {
-                        jsmntree_array *    base_array          = (jsmntree_array *)tsc->c;
-                        jsmntree_element ** new_element_array   = base_array->elements;
-                        new_element_array[base_array->size]     = jsmntree_alloc(JSMNTREE_ELEMENT, 1);
-                        jsmntree_init(new_element_array[base_array->size], JSMNTREE_ELEMENT, 1);
+    return child;
+}
 
-                        jsmntree_element *  new_element = new_element_array[base_array->size];
-                        new_element->value_type         = JSMNTREE_OBJECT;
-                        new_element->value              = jsmntree_alloc(JSMNTREE_OBJECT, 1);
-                        jsmntree_init(new_element->value, JSMNTREE_OBJECT, 1);
+jsmntree_projection *
+jsmntree_projection_create(const char * const * paths, const size_t num_paths)
+{
+    jsmntree_projection *   root    = calloc(1, sizeof(jsmntree_projection));
+    size_t                  k;
 
-                        jsmntree_object *   new_object  = new_element->value;
-                        new_object->members             = jsmntree_alloc(JSMNTREE_MEMBER_ARRAY, tokens[i].size);
-                        jsmntree_init(new_object->members, JSMNTREE_MEMBER_ARRAY, tokens[i].size);
+    if(root == NULL)
+        return NULL;
 
-                        ++base_array->size;
+    for(k = 0; k < num_paths; ++k)
+    {
+        const char *            p       = paths[k];
+        jsmntree_projection *   node    = root;
+        char *                  name;
 
-                        stack_node snode = { tokens[i].end, new_object, JSMNTREE_OBJECT };
-                        adt_stack_push(s, &snode);
-                    }
-                    break;
-                }
-            }
-            break;
+        if(*p != '\0' && *p != '/')
+        {
+            jsmntree_projection_free(root);
+            return NULL;
+        }
 
-        case JSMN_ARRAY:
-            {
-                switch(tsc->c_type)
-                {
-                case JSMNTREE_OBJECT:
-                    {
-                        jsmntree_object *   base_object         = (jsmntree_object *)tsc->c;
-                        jsmntree_member **  new_member_array    = base_object->members;
-                        jsmntree_member *   new_member  = new_member_array[base_object->size];
+        name = malloc(strlen(p) + 1);
+        if(name == NULL)
+        {
+            jsmntree_projection_free(root);
+            return NULL;
+        }
 
-                        new_member->value_type          = JSMNTREE_ARRAY;
-                        new_member->value               = jsmntree_alloc(JSMNTREE_ARRAY, 1);
-                        jsmntree_init(new_member->value, JSMNTREE_ARRAY, 1);
+        /* A path which is a prefix of another keeps everything below it */
+        while(*p == '/' && !node->all)
+        {
+            size_t length = 0;
 
-                        jsmntree_array *    new_array   = new_member->value;
-                        new_array->elements             = jsmntree_alloc(JSMNTREE_ELEMENT_ARRAY, tokens[i].size);
-                        jsmntree_init(new_array->elements, JSMNTREE_ELEMENT_ARRAY, tokens[i].size);
+            for(++p; *p != '\0' && *p != '/'; ++p)
+            {
+                char c = *p;
 
-                        ++base_object->size;
+                if(c == '~' && (p[1] == '0' || p[1] == '1'))
+                    c = (*++p == '0') ? '~' : '/';
 
-                        stack_node snode = { tokens[i].end, new_array, JSMNTREE_ARRAY };
-                        adt_stack_push(s, &snode);
-                    }
-                    break;
+                name[length++] = c;
+            }
 
-                case JSMNTREE_ARRAY:
-                    {
-                        jsmntree_array *    base_array          = (jsmntree_array *)tsc->c;
-                        jsmntree_element ** new_element_array   = base_array->elements;
-                        new_element_array[base_array->size]     = jsmntree_alloc(JSMNTREE_ELEMENT, 1);
-                        jsmntree_init(new_element_array[base_array->size], JSMNTREE_ELEMENT, 1);
+            node = jsmntree_projection_add(node, name, length);
+            if(node == NULL)
+            {
+                free(name);
+                jsmntree_projection_free(root);
+                return NULL;
+            }
+        }
 
-                        jsmntree_element *  new_element = new_element_array[base_array->size];
-                        new_element->value_type         = JSMNTREE_ARRAY;
-                        new_element->value              = jsmntree_alloc(JSMNTREE_ARRAY, 1);
-                        jsmntree_init(new_element->value, JSMNTREE_ARRAY, 1);
+        free(name);
 
-                        jsmntree_array *    new_array   = new_element->value;
-                        new_array->elements             = jsmntree_alloc(JSMNTREE_ELEMENT_ARRAY, tokens[i].size);
-                        jsmntree_init(new_array->elements, JSMNTREE_ELEMENT_ARRAY, tokens[i].size);
+        node->all = 1;
+        jsmntree_projection_clear(node);
+    }
 
-                        ++base_array->size;
+    return root;
+}
 
-                        stack_node snode = { tokens[i].end, new_array, JSMNTREE_ARRAY };
-                        adt_stack_push(s, &snode);
-                    }
-                    break;
-                }
-            }
-            break;
+void
+jsmntree_projection_free(jsmntree_projection * projection)
+{
+    if(projection == NULL)
+        return;
 
-        case JSMN_STRING:
-            {
-                switch(tsc->c_type)
-                {
-                case JSMNTREE_OBJECT:
-                    {
-                        jsmntree_object *   base_object         = (jsmntree_object *)tsc->c;
-                        jsmntree_member **  new_member_array    = base_object->members;
-                        jsmntree_member *   new_member  = new_member_array[base_object->size];
-
-                        new_member->value_type          = JSMNTREE_STRING;
-                        new_member->value               = jsmntree_alloc(JSMNTREE_STRING, tokens[i].end - tokens[i].start + 1);
-                        jsmntree_init(new_member->value, JSMNTREE_STRING, tokens[i].end - tokens[i].start + 1);
-
-                        char *              new_string  = new_member->value;
-                        strncpy(new_string, &js[tokens[i].start], tokens[i].end - tokens[i].start);
-                        new_string[tokens[i].end - tokens[i].start] = '\0';
-
-                        ++base_object->size;
-                    }
-                    break;
+    jsmntree_projection_clear(projection);
+    free(projection);
+}
 
-                case JSMNTREE_ARRAY:
-                    {
-                        jsmntree_array *    base_array          = (jsmntree_array *)tsc->c;
-                        jsmntree_element ** new_element_array   = base_array->elements;
-                        new_element_array[base_array->size]     = jsmntree_alloc(JSMNTREE_ELEMENT, 1);
-                        jsmntree_init(new_element_array[base_array->size], JSMNTREE_ELEMENT, 1);
+/**
+ * Find which part of the members named `name' is built: NULL if none,
+ * a node with `all' set if all of it.
+ */
+static const jsmntree_projection *
+jsmntree_projection_find(const jsmntree_projection * node, const char * name, const size_t length)
+{
+    const jsmntree_projection * wildcard    = NULL;
+    const uint32_t              hash        = jsmntree_hash_name(name, length);
+    size_t                      i;
 
-                        jsmntree_element *  new_element = new_element_array[base_array->size];
-                        new_element->value_type         = JSMNTREE_STRING;
-                        new_element->value              = jsmntree_alloc(JSMNTREE_STRING, tokens[i].end - tokens[i].start + 1);
-                        jsmntree_init(new_element->value, JSMNTREE_STRING, tokens[i].end - tokens[i].start + 1);
+    for(i = 0; i < node->num_children; ++i)
+    {
+        const jsmntree_projection * child = &node->children[i];
 
-                        char *              new_string  = new_element->value;
-                        strncpy(new_string, &js[tokens[i].start], tokens[i].end - tokens[i].start);
-                        new_string[tokens[i].end - tokens[i].start] = '\0';
+        if(child->wildcard)
+            wildcard = child;
+        else if(child->hash == hash && child->name_length == length &&
+                memcmp(child->name, name, length) == 0)
+            return child;
+    }
 
-                        ++base_array->size;
-                    }
-                    break;
-                }
-            }
-            break;
+    return wildcard;
+}
 
-        case JSMN_PRIMITIVE:
-            {
-                char temp_string[10] = { 0, };
+/**
+ * As jsmntree_projection_find(), for the name of a member as it is in the
+ * JSON string: it is decoded first if it has escapes or is not valid, as
+ * the name of the member will be.
+ * @param       node        Node to search; set to what is found
+ * @return      0 on success, JSMN_ERROR_NOMEM otherwise
+ */
+static int
+jsmntree_projection_find_raw(const jsmntree_projection ** node, const char * name, const size_t length)
+{
+    char    local[256];
+    char *  decoded     = local;
 
-                switch(tsc->c_type)
-                {
-                case JSMNTREE_OBJECT:
-                    {
-                        jsmntree_object *   base_object         = (jsmntree_object *)tsc->c;
-                        jsmntree_member **  new_member_array    = base_object->members;
-                        jsmntree_member *   new_member  = new_member_array[base_object->size];
-
-                        strncpy(temp_string, &js[tokens[i].start], tokens[i].end - tokens[i].start);
-                        temp_string[tokens[i].end - tokens[i].start] = '\0';
-
-                        if(strcmp(temp_string, "null") == 0)
-                        {
-                            new_member->value_type      = JSMNTREE_NULL;
-                            new_member->value           = NULL;
-                        }
-                        else if(strcmp(temp_string, "true") == 0 ||
-                                strcmp(temp_string, "false") == 0)
-                        {
-                            new_member->value_type      = JSMNTREE_BOOLEAN;
-                            new_member->value           = jsmntree_alloc(JSMNTREE_BOOLEAN, 1);
-                            jsmntree_init(new_member->value, JSMNTREE_BOOLEAN, 1);
-
-                            *(int *)new_member->value   =
-                                ((strcmp(temp_string, "true") == 0) ? 1 : 0);
-                        }
-                        else
-                        {
-                            new_member->value_type      = JSMNTREE_NUMBER;
-                            new_member->value           = jsmntree_alloc(JSMNTREE_NUMBER, 1);
-                            jsmntree_init(new_member->value, JSMNTREE_NUMBER, 1);
-
-                            *(int *)new_member->value   = atoi(temp_string);
-                        }
-
-                        ++base_object->size;
-                    }
-                    break;
+    if(memchr(name, '\\', length) == NULL && jsmntree_string_validate(name, length) == 0)
+    {
+        *node = jsmntree_projection_find(*node, name, length);
+        return 0;
+    }
 
-                case JSMNTREE_ARRAY:
-                    {
-                        jsmntree_array *    base_array          = (jsmntree_array *)tsc->c;
-                        jsmntree_element ** new_element_array   = base_array->elements;
-                        new_element_array[base_array->size]     = jsmntree_alloc(JSMNTREE_ELEMENT, 1);
-                        jsmntree_init(new_element_array[base_array->size], JSMNTREE_ELEMENT, 1);
-
-                        jsmntree_element *  new_element = new_element_array[base_array->size];
-
-                        strncpy(temp_string, &js[tokens[i].start], tokens[i].end - tokens[i].start);
-                        temp_string[tokens[i].end - tokens[i].start] = '\0';
-
-                        if(strcmp(temp_string, "null") == 0)
-                        {
-                            new_element->value_type     = JSMNTREE_NULL;
-                            new_element->value          = NULL;
-                        }
-                        else if(strcmp(temp_string, "true") == 0 ||
-                                strcmp(temp_string, "false") == 0)
-                        {
-                            new_element->value_type     = JSMNTREE_BOOLEAN;
-                            new_element->value          = jsmntree_alloc(JSMNTREE_BOOLEAN, 1);
-                            jsmntree_init(new_element->value, JSMNTREE_BOOLEAN, 1);
-
-                            *(int *)new_element->value  =
-                                ((strcmp(temp_string, "true") == 0) ? 1 : 0);
-                        }
-                        else
-                        {
-                            new_element->value_type     = JSMNTREE_NUMBER;
-                            new_element->value          = jsmntree_alloc(JSMNTREE_NUMBER, 1);
-                            jsmntree_init(new_element->value, JSMNTREE_NUMBER, 1);
-
-                            *(int *)new_element->value  = atoi(temp_string);
-                        }
-
-                        ++base_array->size;
-                    }
-                    break;
-                }
-            }
-            break;
-        
-#if 0
-        default:
-            /* Destroy all nodes */
-            return NULL;
-            break;
-#endif
-        }
+    if(JSMNTREE_UNESCAPED_MAX(length) > sizeof(local))
+    {
+        decoded = malloc(JSMNTREE_UNESCAPED_MAX(length));
+        if(decoded == NULL)
+            return JSMN_ERROR_NOMEM;
     }
 
-    adt_stack_destroy(s);
+    *node = jsmntree_projection_find(*node, decoded, jsmntree_string_unescape_lossy(name, length, decoded));
 
-    return root;
+    if(decoded != local)
+        free(decoded);
+
+    return 0;
 }
 
-static void jsmntree_free_object(jsmntree_object *);
-static void jsmntree_free_array(jsmntree_array *);
+/* Add member `position' to an index which has a free slot */
+static void
+jsmntree_index_put(jsmntree_index * index, const uint32_t hash, const size_t position)
+{
+    size_t slot = hash & index->mask;
 
-void
-jsmntree_free_tree(jsmntree_object * object)
+    while(index->slots[slot].member != 0)
+        slot = (slot + 1) & index->mask;
+
+    index->slots[slot].hash     = hash;
+    index->slots[slot].member   = position + 1;
+}
+
+/* Slot of member `position', which must be in the index */
+static size_t
+jsmntree_index_find(const jsmntree_index * index, const uint32_t hash, const size_t position)
 {
-    jsmntree_free_object(object);
-    jsmntree_dealloc(object);
+    size_t slot = hash & index->mask;
+
+    while(index->slots[slot].member != position + 1)
+        slot = (slot + 1) & index->mask;
+
+    return slot;
 }
 
+/**
+ * Empty a slot of an index. The slots probed past it are shifted back,
+ * so that no lookup stops short at the hole.
+ */
 static void
-jsmntree_free_object(jsmntree_object * object)
+jsmntree_index_erase(jsmntree_index * index, size_t slot)
 {
-    if(object == NULL)
-        return;
+    size_t next = slot;
 
-    while(object->size > 0)
+    for(;;)
     {
-        jsmntree_dealloc(object->members[object->size - 1]->name);
-
-        switch(object->members[object->size - 1]->value_type)
-        {
-        case JSMNTREE_OBJECT:
-            jsmntree_free_object(object->members[object->size - 1]->value);
+        next = (next + 1) & index->mask;
+        if(index->slots[next].member == 0)
             break;
 
-        case JSMNTREE_ARRAY:
-            jsmntree_free_array(object->members[object->size - 1]->value);
-            break;
-        }
+        /* Where the slot at `next' would rather be */
+        const size_t home = index->slots[next].hash & index->mask;
 
-        jsmntree_dealloc(object->members[object->size - 1]->value);
-        jsmntree_dealloc(object->members[object->size - 1]);
-        --object->size;
+        if(((next - home) & index->mask) >= ((next - slot) & index->mask))
+        {
+            index->slots[slot]  = index->slots[next];
+            slot                = next;
+        }
     }
 
-    jsmntree_dealloc(object->members);
+    index->slots[slot].member = 0;
 }
 
+/**
+ * Build the hash index of an object if it is large enough to be worth
+ * it. Objects are indexed as they are completed, so that lookups on a
+ * finished tree only read it.
+ */
 static void
-jsmntree_free_array(jsmntree_array * array)
+jsmntree_index_object(jsmntree_builder * builder, jsmntree_object * object)
 {
-    if(array == NULL)
+    if(object->size <= JSMNTREE_INDEX_THRESHOLD)
         return;
 
-    while(array->size > 0)
+    size_t num_slots = 1;
+    while(num_slots < object->size * 2)
+        num_slots <<= 1;
+
+    jsmntree_index * index = jsmntree_alloc_bytes(builder,
+            sizeof(jsmntree_index) + sizeof(jsmntree_index_slot) * num_slots);
+    if(index == NULL)
+        return;
+
+    memset(index->slots, 0, sizeof(jsmntree_index_slot) * num_slots);
+    index->mask = num_slots - 1;
+
+    size_t i;
+    for(i = 0; i < object->size; ++i)
+    {
+        const jsmntree_member * member = &object->members[i];
+        jsmntree_index_put(index, jsmntree_hash_name(member->name, member->name_length), i);
+    }
+
+    object->index = index;
+}
+
+/**
+ * Position of the first member named `key' in an expanded object, or
+ * `object->size' if there is none. With `interned', names are compared
+ * by pointer only.
+ */
+static size_t
+jsmntree_object_position(const jsmntree_object * object, const char * key,
+                            const size_t keylen, const int interned)
+{
+    size_t i;
+
+    if(object->index != NULL)
     {
-        switch(array->elements[array->size - 1]->value_type)
+        const jsmntree_index *  index   = object->index;
+        uint32_t                hash    = jsmntree_hash_name(key, keylen);
+        size_t                  slot    = hash & index->mask;
+        size_t                  first   = object->size;
+
+        /* Duplicate names may lie anywhere in the run of slots */
+        while(index->slots[slot].member != 0)
         {
-        case JSMNTREE_OBJECT:
-            jsmntree_free_object(array->elements[array->size - 1]->value);
-            break;
+            const size_t            position    = index->slots[slot].member - 1;
+            const jsmntree_member * member      = &object->members[position];
 
-        case JSMNTREE_ARRAY:
-            jsmntree_free_array(array->elements[array->size - 1]->value);
-            break;
+            if(position < first && index->slots[slot].hash == hash &&
+                    (interned ? member->name == key : jsmntree_member_is(member, key, keylen)))
+                first = position;
+
+            slot = (slot + 1) & index->mask;
         }
 
-        jsmntree_dealloc(array->elements[array->size - 1]->value);
-        jsmntree_dealloc(array->elements[array->size - 1]);
-        --array->size;
+        return first;
+    }
+
+    for(i = 0; i < object->size; ++i)
+    {
+        const jsmntree_member * member = &object->members[i];
+
+        if(interned ? member->name == key : jsmntree_member_is(member, key, keylen))
+            break;
     }
 
-    jsmntree_dealloc(array->elements);
+    return i;
 }
 
-static void jsmntree_fprint_object(FILE *, jsmntree_object *);
-static void jsmntree_fprint_array(FILE *, jsmntree_array *);
+/**
+ * Copy a string into a tree, NUL-terminated.
+ */
+static char *
+jsmntree_copy_string(jsmntree_builder * builder, const char * string, const size_t length)
+{
+    char * new_string = jsmntree_alloc(builder, JSMNTREE_STRING, length + 1);
 
-void
-jsmntree_fprint_tree(FILE * stream, jsmntree_object * object)
+    if(new_string == NULL)
+        return NULL;
+
+    memcpy(new_string, string, length);
+    new_string[length] = '\0';
+
+    return new_string;
+}
+
+/* Copy the name of a member into a tree, interned if the tree interns names */
+static char *
+jsmntree_copy_name(jsmntree_builder * builder, const char * name, const size_t length)
 {
-    jsmntree_fprint_object(stream, object);
-    fprintf(stream, "\n");
+    if(builder->intern != NULL)
+        return (char *)jsmntree_intern_string(builder->intern, name, length);
+
+    return jsmntree_copy_string(builder, name, length);
+}
+
+/**
+ * Whether a string of a tree was copied into it. With JSMNTREE_ZERO_COPY,
+ * strings without escapes are views into the JSON string instead.
+ */
+static int
+jsmntree_owns_string(const jsmntree_builder * builder, const char * string)
+{
+#ifdef JSMNTREE_ZERO_COPY
+    const uintptr_t address = (uintptr_t)string;
+
+    return address < (uintptr_t)builder->js || address >= (uintptr_t)builder->js + builder->len;
+#else /* JSMNTREE_ZERO_COPY */
+    (void)builder;
+    (void)string;
+
+    return 1;
+#endif /* JSMNTREE_ZERO_COPY */
 }
 
+/* Count a string which is not valid JSON text; it is decoded with replacements */
 static void
-jsmntree_fprint_object(FILE * stream, jsmntree_object * object)
+jsmntree_invalid_string(jsmntree_builder * builder)
 {
-    if(object == NULL)
-        return;
+    if(builder->stats != NULL)
+        __atomic_fetch_add(&builder->stats->invalid_strings, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Make the string of a JSMN_STRING token, with its escapes decoded, and
+ * what is not valid in it replaced. With JSMNTREE_ZERO_COPY, a valid
+ * string without escapes is a view into `js' which is not NUL-terminated.
+ * @param       length      Set to the length of the string
+ */
+static char *
+jsmntree_make_string(jsmntree_builder * builder, const char * js, const jsmntok_t * token,
+                        size_t * length)
+{
+    const char *    string      = &js[token->start];
+    const size_t    raw_length  = token->end - token->start;
 
-    fprintf(stream, "{ ");
+    *length = raw_length;
 
-    int i;
+#ifdef JSMNTREE_ZERO_COPY
+    if(memchr(string, '\\', raw_length) == NULL && jsmntree_string_validate(string, raw_length) == 0)
+        return (char *)string;
+#endif /* JSMNTREE_ZERO_COPY */
 
-    for(i = 0; i < object->size; ++i)
+    char * new_string = jsmntree_alloc(builder, JSMNTREE_STRING, raw_length + 1);
+
+    if(new_string == NULL)
+        return NULL;
+
+    /* A decoded string is never longer, so it is decoded in place */
+    *length = jsmntree_string_unescape(string, raw_length, new_string);
+    if(*length == (size_t)-1)
     {
-        fprintf(stream, "\"%s\": ", object->members[i]->name);
+        /* Replacements may make it longer */
+        jsmntree_invalid_string(builder);
+        if(builder->arena == NULL)
+            jsmntree_dealloc(builder, new_string);
 
-        switch(object->members[i]->value_type)
-        {
-        case JSMNTREE_OBJECT:
-            jsmntree_fprint_object(stream, object->members[i]->value);
-            break;
+        new_string = jsmntree_alloc(builder, JSMNTREE_STRING, JSMNTREE_UNESCAPED_MAX(raw_length) + 1);
+        if(new_string == NULL)
+            return NULL;
 
-        case JSMNTREE_ARRAY:
-            jsmntree_fprint_array(stream, object->members[i]->value);
-            break;
+        *length = jsmntree_string_unescape_lossy(string, raw_length, new_string);
+    }
 
-        case JSMNTREE_STRING:
-            fprintf(stream, "\"%s\"", (char *)object->members[i]->value);
-            break;
+    new_string[*length] = '\0';
 
-        case JSMNTREE_NUMBER:
-            fprintf(stream, "%d", *(int *)object->members[i]->value);
-            break;
+    return new_string;
+}
 
-        case JSMNTREE_BOOLEAN:
-            fprintf(stream, "%s", (((*(int *)object->members[i]->value) == 0) ? "false" : "true"));
-            break;
-            
-        case JSMNTREE_NULL:
-            fprintf(stream, "null");
-            break;
+/**
+ * Make the string of a JSMN_STRING token a value, with its escapes
+ * decoded: inline if it is short enough, as jsmntree_make_string()
+ * otherwise.
+ * @return      0 on success, -1 if out of memory
+ */
+static int
+jsmntree_make_string_value(jsmntree_builder * builder, const char * js, const jsmntok_t * token,
+                            jsmntree_value * value, uint32_t * value_length)
+{
+    const char *    string      = &js[token->start];
+    const size_t    raw_length  = token->end - token->start;
+    size_t          length;
+    char *          new_string;
+
+    if(raw_length <= JSMNTREE_INLINE_MAX)
+    {
+        length = jsmntree_string_unescape(string, raw_length, value->string);
+        if(length != (size_t)-1)
+        {
+            value->string[length]   = '\0';
+            *value_length           = length;
+            return 0;
         }
+    }
+
+    /* Long, or made longer by replacements */
+    new_string = jsmntree_make_string(builder, js, token, &length);
+    if(new_string == NULL)
+        return -1;
+
+    *value_length = length;
 
-        if(i < object->size - 1)
-            fprintf(stream, ", ");
+    if(length > JSMNTREE_INLINE_MAX)
+    {
+        value->pointer = new_string;
+        return 0;
     }
-    fprintf(stream, " }");
+
+    /* Escapes made it short enough after all */
+    memcpy(value->string, new_string, length + 1);
+    if(builder->arena == NULL)
+        jsmntree_dealloc(builder, new_string);
+
+    return 0;
 }
 
-static void
-jsmntree_fprint_array(FILE * stream, jsmntree_array * array)
+/**
+ * Make the name of a member from a JSMN_STRING token, interned if the
+ * tree interns names.
+ * @param       length      Set to the length of the name
+ */
+static char *
+jsmntree_make_name(jsmntree_builder * builder, const char * js, const jsmntok_t * token,
+                    size_t * length)
 {
-    if(array == NULL)
-        return;
+    const char *    name        = &js[token->start];
+    const size_t    raw_length  = token->end - token->start;
+    char            local[256];
+    char *          decoded     = local;
+    const char *    interned;
 
-    fprintf(stream, "[ ");
+    if(builder->intern == NULL)
+        return jsmntree_make_string(builder, js, token, length);
 
-    int i;
+    *length = raw_length;
 
-    for(i = 0; i < array->size; ++i)
+    /* Names are decoded before they are interned, if they need to be */
+    if(memchr(name, '\\', raw_length) == NULL && jsmntree_string_validate(name, raw_length) == 0)
+        return (char *)jsmntree_intern_string(builder->intern, name, raw_length);
+
+    if(raw_length > sizeof(local))
     {
-        switch(array->elements[i]->value_type)
-        {
-        case JSMNTREE_OBJECT:
-            jsmntree_fprint_object(stream, array->elements[i]->value);
-            break;
+        decoded = malloc(raw_length);
+        if(decoded == NULL)
+            return NULL;
+    }
 
-        case JSMNTREE_ARRAY:
-            jsmntree_fprint_array(stream, array->elements[i]->value);
-            break;
+    *length = jsmntree_string_unescape(name, raw_length, decoded);
+    if(*length == (size_t)-1)
+    {
+        /* Replacements may make it longer */
+        jsmntree_invalid_string(builder);
+        if(decoded != local)
+            free(decoded);
+
+        decoded = (JSMNTREE_UNESCAPED_MAX(raw_length) > sizeof(local))
+                    ? malloc(JSMNTREE_UNESCAPED_MAX(raw_length)) : local;
+        if(decoded == NULL)
+            return NULL;
 
-        case JSMNTREE_STRING:
-            fprintf(stream, "\"%s\"", (char *)array->elements[i]->value);
-            break;
+        *length = jsmntree_string_unescape_lossy(name, raw_length, decoded);
+    }
 
-        case JSMNTREE_NUMBER:
-            fprintf(stream, "%d", *(int *)array->elements[i]->value);
-            break;
+    interned = jsmntree_intern_string(builder->intern, decoded, *length);
 
-        case JSMNTREE_BOOLEAN:
-            fprintf(stream, "%s", (((*(int *)array->elements[i]->value) == 0) ? "false" : "true"));
-            break;
-            
-        case JSMNTREE_NULL:
-            fprintf(stream, "null");
-            break;
-        }
+    if(decoded != local)
+        free(decoded);
+
+    return (char *)interned;
+}
+
+void
+jsmntree_element_set_string(jsmntree_element * element, const char * string, const size_t length)
+{
+    element->value_length   = length;
+    element->value_type     = JSMNTREE_STRING;
 
-        if(i < array->size - 1)
-            fprintf(stream, ", ");
+    if(length > JSMNTREE_INLINE_MAX)
+    {
+        element->value.pointer = (char *)string;
+        return;
     }
-    fprintf(stream, " ]");
+
+    memcpy(element->value.string, string, length);
+    element->value.string[length] = '\0';
 }
+
+char *
+jsmntree_string_dup(const char * string, const size_t length)
+{
+    char * new_string = malloc(length + 1);
+
+    if(new_string == NULL)
+        return NULL;
+
+    memcpy(new_string, string, length);
+    new_string[length] = '\0';
+
+    return new_string;
+}
+
+void
+jsmntree_options_init(jsmntree_options * options)
+{
+    options->flags          = 0;
+    options->arena          = NULL;
+    options->intern         = NULL;
+    options->num_threads    = 0;
+    options->projection     = NULL;
+    memset(&options->allocator, 0, sizeof(options->allocator));
+    options->stats          = NULL;
+}
+
+void
+jsmntree_stats_init(jsmntree_stats * stats)
+{
+    memset(stats, 0, sizeof(jsmntree_stats));
+}
+
+jsmntree_stats *
+jsmntree_get_stats(jsmntree_object * object)
+{
+    return (object != NULL && object->tree != NULL) ? object->tree->builder.stats : NULL;
+}
+
+jsmntree_object *
+jsmntree_make_tree(const char * js, const size_t len,
+                    const jsmntok_t * tokens, const unsigned int num_tokens)
+{
+    return jsmntree_make_tree_ex(js, len, tokens, num_tokens, NULL);
+}
+
+/**
+ * Check that the bytes from `from' to `to' of `js' are whitespace, with
+ * a single `separator' among them unless it is 0.
+ * @return      1 if so, 0 otherwise
+ */
+static int
+jsmntree_check_gap(const char * js, size_t from, const size_t to, const char separator)
+{
+    int seen = (separator == 0);
+
+    for(; from < to; ++from)
+    {
+        if(js[from] == separator && !seen)
+            seen = 1;
+        else if(js[from] != ' ' && js[from] != '\t' && js[from] != '\r' && js[from] != '\n')
+            return 0;
+    }
+
+    return seen;
+}
+
+/**
+ * Check what jsmn lets through between tokens, as it is not strict: it
+ * takes "[1 2]", "[[]1]" or "{"a" 1}" alike. Items are separated by a
+ * ',', names are strings followed by a ':' and a value, and nothing but
+ * whitespace follows the root.
+ * @return      0 if the tokens are those of JSON, JSMN_ERROR_INVAL, or
+ *              JSMN_ERROR_NOMEM
+ */
+static int
+jsmntree_check_tokens(const char * js, const size_t len,
+                        const jsmntok_t * tokens, const unsigned int num_tokens)
+{
+    typedef struct
+    {
+        int             end;
+        int             object;
+        unsigned int    items;
+    }
+    open_node;
+
+    adt_stack *     s       = adt_stack_create(sizeof(open_node));
+    size_t          pos     = 0;
+    size_t          trail;
+    unsigned int    i;
+    int             r       = 0;
+
+    if(s == NULL)
+        return JSMN_ERROR_NOMEM;
+
+    for(i = 0; i <= num_tokens && r == 0; ++i)
+    {
+        size_t  start;
+        char    separator   = 0;
+
+        /* Close the containers which end before this token */
+        while(adt_stack_size(s) > 0 &&
+                (i == num_tokens || tokens[i].start >= ((open_node *)adt_stack_top(s))->end))
+        {
+            open_node * top = adt_stack_top(s);
+
+            /* Nothing before the closing bracket, nor a name without a value */
+            if(!jsmntree_check_gap(js, pos, top->end - 1, 0) || (top->object && top->items % 2 != 0))
+            {
+                r = JSMN_ERROR_INVAL;
+                break;
+            }
+
+            pos = top->end;
+            adt_stack_pop(s);
+        }
+
+        if(r != 0 || i == num_tokens)
+            break;
+
+        if(adt_stack_size(s) == 0)
+        {
+            /* Only the root is at the top level */
+            if(i > 0)
+            {
+                r = JSMN_ERROR_INVAL;
+                break;
+            }
+        }
+        else
+        {
+            open_node * top = adt_stack_top(s);
+
+            if(top->object && top->items % 2 == 0 && tokens[i].type != JSMN_STRING)
+            {
+                r = JSMN_ERROR_INVAL;
+                break;
+            }
+
+            if(top->items > 0)
+                separator = (top->object && top->items % 2 != 0) ? ':' : ',';
+
+            ++top->items;
+        }
+
+        /* A string starts at its quote */
+        start = tokens[i].start - (tokens[i].type == JSMN_STRING);
+        if(!jsmntree_check_gap(js, pos, start, separator))
+        {
+            r = JSMN_ERROR_INVAL;
+            break;
+        }
+
+        if(tokens[i].type == JSMN_OBJECT || tokens[i].type == JSMN_ARRAY)
+        {
+            open_node node = { tokens[i].end, tokens[i].type == JSMN_OBJECT, 0 };
+
+            adt_stack_push(s, &node);
+            pos = tokens[i].start + 1;
+        }
+        else
+            pos = tokens[i].end + (tokens[i].type == JSMN_STRING);
+    }
+
+    adt_stack_destroy(s);
+
+    /* jsmn stops at a '\0' */
+    for(trail = pos; r == 0 && trail < len && js[trail] != '\0'; ++trail)
+        ;
+
+    if(r == 0 && !jsmntree_check_gap(js, pos, trail, 0))
+        r = JSMN_ERROR_INVAL;
+
+    return r;
+}
+
+int
+jsmntree_parse_tokens(const char * js, const size_t len,
+                        jsmntok_t ** tokens, unsigned int * capacity)
+{
+    jsmn_parser parser;
+    int         r;
+
+    /* A guess of one token per 16 bytes; jsmn only counts without tokens */
+    if(*tokens == NULL || *capacity == 0)
+    {
+        unsigned int    new_capacity    = (unsigned int)(len / 16) + 64;
+        jsmntok_t *     new_tokens      = realloc(*tokens, sizeof(jsmntok_t) * new_capacity);
+
+        if(new_tokens == NULL)
+            return JSMN_ERROR_NOMEM;
+
+        *tokens     = new_tokens;
+        *capacity   = new_capacity;
+    }
+
+    jsmn_init(&parser);
+
+    /* Grow the tokens geometrically; jsmn resumes where it stopped */
+    while((r = jsmn_parse(&parser, js, len, *tokens, *capacity)) == JSMN_ERROR_NOMEM)
+    {
+        unsigned int    new_capacity    = *capacity * 2;
+        jsmntok_t *     new_tokens;
+
+        if(new_capacity < *capacity)
+            return JSMN_ERROR_NOMEM;
+
+        new_tokens = realloc(*tokens, sizeof(jsmntok_t) * new_capacity);
+        if(new_tokens == NULL)
+            return JSMN_ERROR_NOMEM;
+
+        *tokens     = new_tokens;
+        *capacity   = new_capacity;
+    }
+
+    if(r > 0)
+    {
+        const int checked = jsmntree_check_tokens(js, len, *tokens, (unsigned int)r);
+
+        if(checked != 0)
+            return checked;
+    }
+
+    return r;
+}
+
+typedef struct jsmntree_fused_buffers jsmntree_fused_buffers;
+
+static int jsmntree_parse_fused(const char *, const size_t, const jsmntree_options *,
+                                jsmntree_fused_buffers *, jsmntree_object **);
+
+int
+jsmntree_parse_buffer(const char * js, const size_t len,
+                        const jsmntree_options * options, jsmntree_object ** tree)
+{
+    jsmntok_t *     tokens      = NULL;
+    unsigned int    capacity    = 0;
+    int             r;
+
+    *tree = NULL;
+
+    /* Lazy trees, projections and threads work on tokens */
+    if(options != NULL && (options->flags & JSMNTREE_FLAG_FUSED) &&
+            !(options->flags & JSMNTREE_FLAG_LAZY) && options->projection == NULL &&
+            options->num_threads <= 1)
+        return jsmntree_parse_fused(js, len, options, NULL, tree);
+
+    r = jsmntree_parse_tokens(js, len, &tokens, &capacity);
+    if(r < 0)
+    {
+        free(tokens);
+        return r;
+    }
+
+    jsmntree_object * root;
+
+    r = jsmntree_build_tree(js, len, tokens, r, options, &root);
+    if(r != 0)
+    {
+        free(tokens);
+        return r;
+    }
+
+    /* A lazy tree reads its tokens later on; others are done with them */
+    if(options != NULL && (options->flags & JSMNTREE_FLAG_LAZY))
+        ((jsmntree_tree *)root)->owned_tokens = tokens;
+    else
+        free(tokens);
+
+    *tree = root;
+
+    return 0;
+}
+
+const char *
+jsmntree_map_file(const char * path, const jsmntree_options * options, size_t * size)
+{
+    struct stat st;
+    void *      mapping;
+    int         fd;
+
+    fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return NULL;
+
+    if(fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    /* Nothing to map */
+    if(st.st_size == 0)
+    {
+        close(fd);
+        *size = 0;
+        return "";
+    }
+
+    mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapping == MAP_FAILED)
+        return NULL;
+
+#ifdef MADV_SEQUENTIAL
+    madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+#endif /* MADV_SEQUENTIAL */
+#ifdef MADV_HUGEPAGE
+    if(options != NULL && (options->flags & JSMNTREE_FLAG_HUGEPAGE))
+        madvise(mapping, st.st_size, MADV_HUGEPAGE);
+#endif /* MADV_HUGEPAGE */
+
+    *size = st.st_size;
+
+    return mapping;
+}
+
+void
+jsmntree_unmap_file(const char * data, const size_t size)
+{
+    if(data != NULL && size > 0)
+        munmap((void *)data, size);
+}
+
+int
+jsmntree_make_tree_from_file(const char * path, const jsmntree_options * options,
+                                jsmntree_object ** tree)
+{
+    size_t          size;
+    const char *    mapping;
+    int             r;
+
+    *tree = NULL;
+
+    mapping = jsmntree_map_file(path, options, &size);
+    if(mapping == NULL)
+        return JSMNTREE_ERROR_IO;
+
+    r = jsmntree_parse_buffer(mapping, size, options, tree);
+    if(r != 0)
+    {
+        jsmntree_unmap_file(mapping, size);
+        return r;
+    }
+
+#ifndef JSMNTREE_ZERO_COPY
+    /* Strings are copied, so only a lazy tree reads the file later on */
+    if(options == NULL || !(options->flags & JSMNTREE_FLAG_LAZY))
+    {
+        jsmntree_unmap_file(mapping, size);
+        return 0;
+    }
+#endif /* ! JSMNTREE_ZERO_COPY */
+
+    ((jsmntree_tree *)*tree)->mapping       = (void *)mapping;
+    ((jsmntree_tree *)*tree)->mapping_size  = size;
+
+    return 0;
+}
+
+/**
+ * Make an object or an array for a JSMN_OBJECT or JSMN_ARRAY token. With
+ * JSMNTREE_FLAG_LAZY, it is left unexpanded: it only remembers `token'.
+ * @return      Container, or NULL if out of memory
+ */
+static void *
+jsmntree_make_container(jsmntree_builder * builder, const jsmntok_t * token,
+                        const jsmntreetype_t type)
+{
+    const jsmntreetype_t    items_type  = (type == JSMNTREE_OBJECT) ? JSMNTREE_MEMBER_ARRAY
+                                                                    : JSMNTREE_ELEMENT_ARRAY;
+    void *                  container   = jsmntree_alloc(builder, type, 1);
+    void *                  items       = NULL;
+
+    if(container == NULL)
+        return NULL;
+
+    jsmntree_init(container, type, 1);
+
+    if(!(builder->flags & JSMNTREE_FLAG_LAZY))
+    {
+        items = jsmntree_alloc(builder, items_type, token->size);
+        if(items == NULL && token->size > 0)
+        {
+            if(builder->arena == NULL)
+                jsmntree_dealloc(builder, container);
+            return NULL;
+        }
+
+        if(items != NULL)
+            jsmntree_init(items, items_type, token->size);
+    }
+
+    if(type == JSMNTREE_OBJECT)
+    {
+        jsmntree_object * new_object    = container;
+        new_object->tree                = builder->tree;
+
+        if(builder->flags & JSMNTREE_FLAG_LAZY)
+            new_object->token           = token;
+        else
+        {
+            new_object->members         = items;
+            new_object->capacity        = token->size;
+        }
+    }
+    else
+    {
+        jsmntree_array *  new_array     = container;
+        new_array->tree                 = builder->tree;
+
+        if(builder->flags & JSMNTREE_FLAG_LAZY)
+            new_array->token            = token;
+        else
+        {
+            new_array->elements         = items;
+            new_array->capacity         = token->size;
+        }
+    }
+
+    return container;
+}
+
+/* Index of the token past the subtree of token `index' */
+static unsigned int
+jsmntree_skip(const jsmntree_builder * builder, const unsigned int index)
+{
+    const jsmntok_t *   tokens  = builder->tokens;
+    const int           end     = tokens[index].end;
+    unsigned int        i       = index + 1;
+
+    while(i < builder->num_tokens && tokens[i].type != JSMN_UNDEFINED && tokens[i].start < end)
+        ++i;
+
+    return i;
+}
+
+/* Set the size of a completed container, and index it if it is an object */
+static void
+jsmntree_complete(jsmntree_builder * builder, void * container,
+                    const jsmntreetype_t type, const size_t size)
+{
+    if(type == JSMNTREE_OBJECT)
+    {
+        ((jsmntree_object *)container)->size = size;
+        jsmntree_index_object(builder, container);
+    }
+    else
+        ((jsmntree_array *)container)->size = size;
+}
+
+/**
+ * Fill the members of an object or the elements of an array, from slot
+ * `slot' on, with the values of tokens `begin' up to `limit'. `end' is
+ * the end offset of the container in `js'. Its member or element array
+ * must be allocated. Nested containers are built too, unless they are
+ * lazy. Unless `partial', the container is completed at the end;
+ * otherwise other slots are left to someone else. If out of memory, the
+ * building stops: the value which could not be made is left null, and
+ * the containers hold what they got so far, so that the tree can still
+ * be freed as a whole. So it does if the tokens do not nest as those of
+ * JSON do: a token is in a container if it starts before its end, and
+ * a container has no more items than its token says.
+ * @return      0 on success, JSMN_ERROR_INVAL, or JSMN_ERROR_NOMEM
+ */
+static int
+jsmntree_build_range(jsmntree_builder * builder, void * container,
+                    const jsmntreetype_t type, const int end, const size_t slot,
+                    const unsigned int begin, const unsigned int limit, const int partial)
+{
+    typedef struct
+    {
+        int             end;
+        void *          c;
+        jsmntreetype_t  c_type;
+        size_t          slot;
+        const jsmntree_projection * projection;
+    }
+    stack_node;
+
+    const char *        js          = builder->js;
+    const jsmntok_t *   tokens      = builder->tokens;
+    int                 r           = 0;
+
+    adt_stack *         s       = adt_stack_create(sizeof(stack_node));
+    if(s == NULL)
+        return JSMN_ERROR_NOMEM;
+
+    {
+        stack_node      snode   = { end, container, type, slot, partial ? NULL : builder->projection };
+        adt_stack_push(s, &snode);
+    }
+
+    unsigned int i;
+    for(i = begin; i < limit && tokens[i].type != JSMN_UNDEFINED; ++i)
+    {
+        while(adt_stack_size(s) > 0 &&
+                tokens[i].start >= ((stack_node *)adt_stack_top(s))->end)
+        {
+            stack_node *    done    = (stack_node *)adt_stack_top(s);
+            jsmntree_complete(builder, done->c, done->c_type, done->slot);
+
+            adt_stack_pop(s);
+        }
+
+        /* Past the end of the container */
+        if(adt_stack_size(s) == 0)
+            break;
+
+        stack_node *        tsc             = (stack_node *)adt_stack_top(s);
+        jsmntree_value *    value;
+        uint32_t *          value_length;
+        jsmntreetype_t *    value_type;
+        const jsmntree_projection * projection  = tsc->projection;
+
+        if(tsc->c_type == JSMNTREE_OBJECT)
+        {
+            /* A name is a string followed by ':' and a value */
+            if(tsc->slot >= ((jsmntree_object *)tsc->c)->capacity ||
+                    tokens[i].type != JSMN_STRING || tokens[i].size != 1 ||
+                    i + 1 >= limit || tokens[i + 1].type == JSMN_UNDEFINED)
+            {
+                r = JSMN_ERROR_INVAL;
+                break;
+            }
+
+            if(projection != NULL)
+            {
+                if(jsmntree_projection_find_raw(&projection, &js[tokens[i].start],
+                                                tokens[i].end - tokens[i].start) != 0)
+                {
+                    r = JSMN_ERROR_NOMEM;
+                    break;
+                }
+
+                if(projection == NULL)
+                {
+                    /* Skip the member and the subtree of its value */
+                    i = jsmntree_skip(builder, i + 1) - 1;
+                    continue;
+                }
+
+                if(projection->all)
+                    projection = NULL;
+            }
+
+            jsmntree_object *   base_object         = (jsmntree_object *)tsc->c;
+            jsmntree_member *   new_member          = &base_object->members[tsc->slot];
+            new_member->name                        = jsmntree_make_name(builder, js, &tokens[i],
+                                                                            &new_member->name_length);
+            if(new_member->name == NULL)
+            {
+                r = JSMN_ERROR_NOMEM;
+                break;
+            }
+
+            value                                   = &new_member->value;
+            value_length                            = &new_member->value_length;
+            value_type                              = &new_member->value_type;
+            ++tsc->slot;
+            ++i;
+        }
+        else
+        {
+            jsmntree_array *    base_array          = (jsmntree_array *)tsc->c;
+            jsmntree_element *  new_element;
+
+            if(tsc->slot >= base_array->capacity)
+            {
+                r = JSMN_ERROR_INVAL;
+                break;
+            }
+
+            new_element                             = &base_array->elements[tsc->slot];
+
+            value                                   = &new_element->value;
+            value_length                            = &new_element->value_length;
+            value_type                              = &new_element->value_type;
+            ++tsc->slot;
+        }
+
+        switch(tokens[i].type)
+        {
+        case JSMN_OBJECT:
+        case JSMN_ARRAY:
+            {
+                *value_type     = (tokens[i].type == JSMN_OBJECT) ? JSMNTREE_OBJECT : JSMNTREE_ARRAY;
+                value->pointer  = jsmntree_make_container(builder, &tokens[i], *value_type);
+
+                if(value->pointer == NULL)
+                {
+                    *value_type = JSMNTREE_NULL;
+                    r           = JSMN_ERROR_NOMEM;
+                }
+                else if(builder->flags & JSMNTREE_FLAG_LAZY)
+                {
+                    /* Skip the subtree; it is built when it is expanded */
+                    i = jsmntree_skip(builder, i) - 1;
+                }
+                else
+                {
+                    stack_node snode = { tokens[i].end, value->pointer, *value_type, 0, projection };
+                    adt_stack_push(s, &snode);
+                }
+            }
+            break;
+
+        case JSMN_STRING:
+            *value_type     = JSMNTREE_STRING;
+            if(jsmntree_make_string_value(builder, js, &tokens[i], value, value_length) < 0)
+            {
+                *value_type = JSMNTREE_NULL;
+                r           = JSMN_ERROR_NOMEM;
+            }
+            break;
+
+        case JSMN_PRIMITIVE:
+            *value_type     = jsmntree_decode_primitive(js, &tokens[i], value);
+            break;
+
+        default:
+            break;
+        }
+
+        if(r != 0)
+            break;
+    }
+
+    while(adt_stack_size(s) > 0)
+    {
+        stack_node *        done    = (stack_node *)adt_stack_top(s);
+        if(!partial || adt_stack_size(s) > 1)
+            jsmntree_complete(builder, done->c, done->c_type, done->slot);
+
+        adt_stack_pop(s);
+    }
+
+    adt_stack_destroy(s);
+
+    return r;
+}
+
+/**
+ * Fill the members of an object or the elements of an array from the
+ * tokens following its token `index'.
+ * @return      0 on success, JSMN_ERROR_INVAL, or JSMN_ERROR_NOMEM
+ */
+static int
+jsmntree_build(jsmntree_builder * builder, void * container,
+                const jsmntreetype_t type, const unsigned int index)
+{
+    return jsmntree_build_range(builder, container, type, builder->tokens[index].end, 0,
+                                index + 1, builder->num_tokens, 0);
+}
+
+/* Tasks per thread a tree is split into */
+#define JSMNTREE_PARALLEL_TASKS     16
+
+/* Fewest tokens per task */
+#define JSMNTREE_PARALLEL_GRAIN     1024
+
+/**
+ * A run of slots of a container, filled from a run of tokens by one
+ * thread. An empty run only stands for a split object to be indexed.
+ * @param       container   Object or array
+ * @param       type        Type of `container'
+ * @param       end         End offset of `container' in `js'
+ * @param       slot        First slot to fill
+ * @param       begin       First token
+ * @param       limit       Token past the last one
+ */
+typedef struct
+{
+    void *              container;
+    jsmntreetype_t      type;
+    int                 end;
+    size_t              slot;
+    unsigned int        begin;
+    unsigned int        limit;
+}
+jsmntree_build_task;
+
+/**
+ * Tasks a tree is split into for jsmntree_build_parallel().
+ * @param       tasks       Tasks, in document order
+ * @param       num_tasks   Number of `tasks'
+ * @param       capacity    Allocated number of `tasks'
+ * @param       grain       Tokens per task, roughly
+ * @param       next        Next task to take
+ * @param       failed      0, or the error some task ran into:
+ *                          JSMN_ERROR_INVAL or JSMN_ERROR_NOMEM; the tasks
+ *                          left are skipped then
+ */
+typedef struct
+{
+    jsmntree_build_task *   tasks;
+    size_t                  num_tasks;
+    size_t                  capacity;
+    unsigned int            grain;
+    size_t                  next;
+    int                     failed;
+}
+jsmntree_build_plan;
+
+/**
+ * A thread building tasks of a plan.
+ * @param       builder     Builder with the arena of the thread
+ * @param       plan        Plan
+ */
+typedef struct
+{
+    jsmntree_builder        builder;
+    jsmntree_build_plan *   plan;
+}
+jsmntree_build_worker;
+
+/**
+ * Plan a task. If out of memory, the run is built right away instead,
+ * and a split object is left without an index.
+ */
+static void
+jsmntree_plan_add(jsmntree_builder * builder, jsmntree_build_plan * plan,
+                    void * container, const jsmntreetype_t type, const int end,
+                    const size_t slot, const unsigned int begin, const unsigned int limit)
+{
+    if(plan->num_tasks == plan->capacity)
+    {
+        size_t                  new_capacity    = (plan->capacity > 0) ? plan->capacity * 2 : 64;
+        jsmntree_build_task *   new_tasks       = realloc(plan->tasks, sizeof(jsmntree_build_task) * new_capacity);
+
+        if(new_tasks == NULL)
+        {
+            if(begin < limit && plan->failed == 0)
+                plan->failed = jsmntree_build_range(builder, container, type, end, slot,
+                                                    begin, limit, 1);
+            return;
+        }
+
+        plan->tasks     = new_tasks;
+        plan->capacity  = new_capacity;
+    }
+
+    jsmntree_build_task task = { container, type, end, slot, begin, limit };
+    plan->tasks[plan->num_tasks++] = task;
+}
+
+/**
+ * Split a container whose subtree is larger than a grain. Its children
+ * are gathered into runs of about a grain of tokens, which are planned
+ * as tasks; a child larger than a grain gets its slot here and is split
+ * in turn. The container is sized here, since every slot will be filled.
+ */
+static void
+jsmntree_plan_split(jsmntree_builder * builder, jsmntree_build_plan * plan,
+                    void * container, const jsmntreetype_t type, const unsigned int index)
+{
+    const jsmntok_t *   tokens      = builder->tokens;
+    const int           end         = tokens[index].end;
+    unsigned int        i           = index + 1;
+    unsigned int        run_begin   = i;
+    size_t              run_slot    = 0;
+    size_t              slot        = 0;
+
+    while(plan->failed == 0 &&
+            i < builder->num_tokens && tokens[i].type != JSMN_UNDEFINED && tokens[i].start < end)
+    {
+        /* The value of a member follows its name */
+        unsigned int    value   = (type == JSMNTREE_OBJECT) ? i + 1 : i;
+        unsigned int    next;
+
+        /* As jsmntree_build_range() checks them */
+        if(slot >= ((type == JSMNTREE_OBJECT) ? ((jsmntree_object *)container)->capacity
+                                                : ((jsmntree_array *)container)->capacity) ||
+                value >= builder->num_tokens || tokens[value].type == JSMN_UNDEFINED ||
+                (type == JSMNTREE_OBJECT && (tokens[i].type != JSMN_STRING || tokens[i].size != 1)))
+        {
+            plan->failed = JSMN_ERROR_INVAL;
+            break;
+        }
+
+        next = jsmntree_skip(builder, value);
+
+        if(next - value > plan->grain &&
+                (tokens[value].type == JSMN_OBJECT || tokens[value].type == JSMN_ARRAY))
+        {
+            jsmntree_value *    child;
+            jsmntreetype_t *    child_type;
+
+            if(run_begin < i)
+                jsmntree_plan_add(builder, plan, container, type, end, run_slot, run_begin, i);
+            run_begin   = i;
+
+            if(type == JSMNTREE_OBJECT)
+            {
+                jsmntree_member *   member  = &((jsmntree_object *)container)->members[slot];
+
+                member->name                = jsmntree_make_name(builder, builder->js, &tokens[i],
+                                                                    &member->name_length);
+                if(member->name == NULL)
+                {
+                    plan->failed = JSMN_ERROR_NOMEM;
+                    break;
+                }
+
+                child                       = &member->value;
+                child_type                  = &member->value_type;
+            }
+            else
+            {
+                jsmntree_element *  element = &((jsmntree_array *)container)->elements[slot];
+
+                child                       = &element->value;
+                child_type                  = &element->value_type;
+            }
+
+            *child_type     = (tokens[value].type == JSMN_OBJECT) ? JSMNTREE_OBJECT : JSMNTREE_ARRAY;
+            child->pointer  = jsmntree_make_container(builder, &tokens[value], *child_type);
+            ++slot;
+
+            if(child->pointer == NULL)
+            {
+                *child_type     = JSMNTREE_NULL;
+                plan->failed    = JSMN_ERROR_NOMEM;
+                break;
+            }
+
+            jsmntree_plan_split(builder, plan, child->pointer, *child_type, value);
+            run_begin   = next;
+            run_slot    = slot;
+        }
+        else
+        {
+            ++slot;
+            if(next - run_begin >= plan->grain)
+            {
+                jsmntree_plan_add(builder, plan, container, type, end, run_slot, run_begin, next);
+                run_begin   = next;
+                run_slot    = slot;
+            }
+        }
+
+        i = next;
+    }
+
+    if(run_begin < i)
+        jsmntree_plan_add(builder, plan, container, type, end, run_slot, run_begin, i);
+
+    if(type == JSMNTREE_OBJECT)
+    {
+        ((jsmntree_object *)container)->size = slot;
+
+        /* Indexed once all of its tasks are done */
+        jsmntree_plan_add(builder, plan, container, type, end, slot, i, i);
+    }
+    else
+        ((jsmntree_array *)container)->size = slot;
+}
+
+static void *
+jsmntree_build_worker_main(void * arg)
+{
+    jsmntree_build_worker * worker  = arg;
+    jsmntree_build_plan *   plan    = worker->plan;
+    size_t                  k;
+
+    while((k = __atomic_fetch_add(&plan->next, 1, __ATOMIC_RELAXED)) < plan->num_tasks)
+    {
+        const jsmntree_build_task * task = &plan->tasks[k];
+        int                         r;
+
+        if(task->begin < task->limit && __atomic_load_n(&plan->failed, __ATOMIC_RELAXED) == 0 &&
+                (r = jsmntree_build_range(&worker->builder, task->container, task->type, task->end,
+                                            task->slot, task->begin, task->limit, 1)) != 0)
+            __atomic_store_n(&plan->failed, r, __ATOMIC_RELAXED);
+    }
+
+    return NULL;
+}
+
+/**
+ * Build the whole tree under the root on `num_threads' threads, the
+ * calling thread included. Large containers are split into runs of
+ * tokens which the threads take in turn. In an arena tree, each other
+ * thread allocates from its own arena, which is kept in the tree.
+ * @return      0 on success, JSMN_ERROR_INVAL, or JSMN_ERROR_NOMEM
+ */
+static int
+jsmntree_build_parallel(jsmntree_builder * builder, jsmntree_object * root,
+                        const size_t len, const unsigned int num_threads)
+{
+    jsmntree_tree *         tree        = builder->tree;
+    jsmntree_build_plan     plan        = { NULL, 0, 0, 0, 0, 0 };
+    jsmntree_build_worker * workers;
+    pthread_t *             threads;
+    unsigned int            num_started = 0;
+    int                     spawn;
+    size_t                  k;
+
+    plan.grain = builder->num_tokens / (num_threads * JSMNTREE_PARALLEL_TASKS);
+    if(plan.grain < JSMNTREE_PARALLEL_GRAIN)
+        plan.grain = JSMNTREE_PARALLEL_GRAIN;
+
+    jsmntree_plan_split(builder, &plan, root, JSMNTREE_OBJECT, 0);
+
+    workers = calloc(num_threads - 1, sizeof(jsmntree_build_worker));
+    threads = calloc(num_threads - 1, sizeof(pthread_t));
+    spawn   = (workers != NULL && threads != NULL);
+
+    if(spawn && builder->arena != NULL)
+    {
+        tree->arenas    = calloc(num_threads - 1, sizeof(jsmntree_arena *));
+        spawn           = (tree->arenas != NULL);
+    }
+
+    /* Whatever cannot be started is left to the calling thread */
+    for(; spawn && num_started < num_threads - 1; ++num_started)
+    {
+        jsmntree_build_worker * worker = &workers[num_started];
+
+        worker->builder = *builder;
+        worker->plan    = &plan;
+
+        if(builder->arena != NULL)
+        {
+            worker->builder.arena = jsmntree_arena_create(
+                    jsmntree_arena_capacity(len / num_threads, builder->num_tokens / num_threads));
+            if(worker->builder.arena == NULL)
+                break;
+
+            tree->arenas[tree->num_arenas++] = worker->builder.arena;
+        }
+
+        if(pthread_create(&threads[num_started], NULL, jsmntree_build_worker_main, worker) != 0)
+            break;
+    }
+
+    /* The calling thread builds with the arena of the tree */
+    {
+        jsmntree_build_worker self = { *builder, &plan };
+        jsmntree_build_worker_main(&self);
+    }
+
+    while(num_started > 0)
+    {
+        --num_started;
+        pthread_join(threads[num_started], NULL);
+    }
+
+    /* Index the split objects now that they are whole */
+    for(k = 0; !plan.failed && k < plan.num_tasks; ++k)
+    {
+        if(plan.tasks[k].type == JSMNTREE_OBJECT &&
+                ((jsmntree_object *)plan.tasks[k].container)->index == NULL)
+            jsmntree_index_object(builder, plan.tasks[k].container);
+    }
+
+    free(threads);
+    free(workers);
+    free(plan.tasks);
+
+    return plan.failed;
+}
+
+/**
+ * Allocate a tree with an empty root object, and the arena and the
+ * interning table `options' ask for. An arena of the tree's own is sized
+ * from `len' and `num_tokens'.
+ * @return      Tree, or NULL if out of memory
+ */
+static jsmntree_tree *
+jsmntree_create_tree(const char * js, const size_t len,
+                        const jsmntok_t * tokens, const unsigned int num_tokens,
+                        const jsmntree_options * options)
+{
+    jsmntree_builder    builder     = { NULL, NULL, 0, js, len, tokens, num_tokens, NULL, NULL,
+                                        { NULL, NULL, NULL }, NULL };
+    int                 owns_arena  = 0;
+    int                 owns_intern = 0;
+
+    if(options != NULL)
+    {
+        builder.flags       = options->flags;
+        builder.stats       = options->stats;
+        if(options->allocator.malloc != NULL && options->allocator.free != NULL)
+            builder.allocator   = options->allocator;
+        builder.projection  = options->projection;
+        if(builder.projection != NULL && builder.projection->all)
+            builder.projection  = NULL;
+
+        /* Skipped members are not built later on either */
+        if(builder.projection != NULL)
+            builder.flags  &= ~JSMNTREE_FLAG_LAZY;
+    }
+
+    if(builder.flags & JSMNTREE_FLAG_ARENA)
+    {
+        builder.arena = options->arena;
+        if(builder.arena == NULL)
+        {
+            builder.arena = jsmntree_arena_create(jsmntree_arena_capacity(len, num_tokens));
+            if(builder.arena == NULL)
+                return NULL;
+
+            owns_arena = 1;
+        }
+    }
+
+    if(builder.flags & JSMNTREE_FLAG_INTERN)
+    {
+        builder.intern = options->intern;
+        if(builder.intern == NULL)
+        {
+            builder.intern = jsmntree_intern_create();
+            if(builder.intern == NULL)
+            {
+                if(owns_arena)
+                    jsmntree_arena_destroy(builder.arena);
+                return NULL;
+            }
+
+            owns_intern = 1;
+        }
+    }
+
+    jsmntree_tree *     tree    = jsmntree_alloc_bytes(&builder, sizeof(jsmntree_tree));
+    if(tree == NULL)
+    {
+        if(owns_intern)
+            jsmntree_intern_destroy(builder.intern);
+        if(owns_arena)
+            jsmntree_arena_destroy(builder.arena);
+        return NULL;
+    }
+
+    builder.tree                = tree;
+    tree->builder               = builder;
+    tree->owns_arena            = owns_arena;
+    tree->owns_intern           = owns_intern;
+    tree->owned_tokens          = NULL;
+    tree->mapping               = NULL;
+    tree->mapping_size          = 0;
+    tree->arenas                = NULL;
+    tree->num_arenas            = 0;
+
+    /* The root is always expanded */
+    jsmntree_init(&tree->root, JSMNTREE_OBJECT, 1);
+    tree->root.tree             = tree;
+
+    return tree;
+}
+
+int
+jsmntree_build_tree(const char * js, const size_t len,
+                    const jsmntok_t * tokens, const unsigned int num_tokens,
+                    const jsmntree_options * options, jsmntree_object ** tree)
+{
+    *tree = NULL;
+
+    if(num_tokens == 0 || tokens[0].type != JSMN_OBJECT)
+        return JSMNTREE_ERROR_INVTOK;
+
+    jsmntree_stats *    stats       = (options != NULL) ? options->stats : NULL;
+    const double        start       = (stats != NULL) ? jsmntree_clock() : 0;
+    jsmntree_tree *     new_tree    = jsmntree_create_tree(js, len, tokens, num_tokens, options);
+
+    if(new_tree == NULL)
+        return JSMN_ERROR_NOMEM;
+
+    jsmntree_builder *  builder     = &new_tree->builder;
+    jsmntree_object *   root        = &new_tree->root;
+    int                 r;
+
+    root->members               = jsmntree_alloc(builder, JSMNTREE_MEMBER_ARRAY, tokens[0].size);
+    if(root->members == NULL && tokens[0].size > 0)
+    {
+        jsmntree_free_tree(root);
+        return JSMN_ERROR_NOMEM;
+    }
+
+    root->capacity              = tokens[0].size;
+    jsmntree_init(root->members, JSMNTREE_MEMBER_ARRAY, tokens[0].size);
+
+    if(options != NULL && options->num_threads > 1 && num_tokens >= JSMNTREE_PARALLEL_THRESHOLD &&
+            builder->projection == NULL && !(builder->flags & (JSMNTREE_FLAG_LAZY | JSMNTREE_FLAG_INTERN)))
+        r = jsmntree_build_parallel(builder, root, len, options->num_threads);
+    else
+        r = jsmntree_build(builder, root, JSMNTREE_OBJECT, 0);
+
+    /* The projection need not outlive the tree */
+    builder->projection         = NULL;
+
+    /* What is built so far is freed as a whole */
+    if(r != 0)
+    {
+        jsmntree_free_tree(root);
+        return r;
+    }
+
+    if(stats != NULL)
+        stats->build_seconds += jsmntree_clock() - start;
+
+    *tree = root;
+
+    return 0;
+}
+
+jsmntree_object *
+jsmntree_make_tree_ex(const char * js, const size_t len,
+                    const jsmntok_t * tokens, const unsigned int num_tokens,
+                    const jsmntree_options * options)
+{
+    jsmntree_object * tree;
+
+    jsmntree_build_tree(js, len, tokens, num_tokens, options, &tree);
+
+    return tree;
+}
+
+int
+jsmntree_object_expand(jsmntree_object * object)
+{
+    if(object == NULL || object->token == NULL)
+        return 0;
+
+    jsmntree_builder *  builder = &object->tree->builder;
+    unsigned int        index   = object->token - builder->tokens;
+
+    object->members             = jsmntree_alloc(builder, JSMNTREE_MEMBER_ARRAY, object->token->size);
+    if(object->members == NULL && object->token->size > 0)
+        return -1;
+    jsmntree_init(object->members, JSMNTREE_MEMBER_ARRAY, object->token->size);
+    object->capacity            = object->token->size;
+
+    object->token               = NULL;
+
+    return (jsmntree_build(builder, object, JSMNTREE_OBJECT, index) != 0) ? -1 : 0;
+}
+
+int
+jsmntree_array_expand(jsmntree_array * array)
+{
+    if(array == NULL || array->token == NULL)
+        return 0;
+
+    jsmntree_builder *  builder = &array->tree->builder;
+    unsigned int        index   = array->token - builder->tokens;
+
+    array->elements             = jsmntree_alloc(builder, JSMNTREE_ELEMENT_ARRAY, array->token->size);
+    if(array->elements == NULL && array->token->size > 0)
+        return -1;
+    jsmntree_init(array->elements, JSMNTREE_ELEMENT_ARRAY, array->token->size);
+    array->capacity             = array->token->size;
+
+    array->token                = NULL;
+
+    return (jsmntree_build(builder, array, JSMNTREE_ARRAY, index) != 0) ? -1 : 0;
+}
+
+jsmntree_member *
+jsmntree_object_get(jsmntree_object * object, const char * key, const size_t keylen)
+{
+    if(object == NULL || jsmntree_object_expand(object) < 0)
+        return NULL;
+
+    size_t position = jsmntree_object_position(object, key, keylen, 0);
+
+    return (position < object->size) ? &object->members[position] : NULL;
+}
+
+jsmntree_member *
+jsmntree_object_get_interned(jsmntree_object * object, const char * key, const size_t keylen)
+{
+    if(object == NULL || jsmntree_object_expand(object) < 0)
+        return NULL;
+
+    size_t position = jsmntree_object_position(object, key, keylen, 1);
+
+    return (position < object->size) ? &object->members[position] : NULL;
+}
+
+int
+jsmntree_get_path(jsmntree_object * object, const char * path, jsmntree_element * result)
+{
+    jsmntree_element current;
+
+    current.value.pointer   = object;
+    current.value_length    = 0;
+    current.value_type      = JSMNTREE_OBJECT;
+
+    while(*path == '/')
+    {
+        const char *    segment = ++path;
+        size_t          length  = strcspn(segment, "/");
+
+        path += length;
+
+        if(current.value_type == JSMNTREE_OBJECT)
+        {
+            jsmntree_member * member = jsmntree_object_get(current.value.pointer, segment, length);
+            if(member == NULL)
+                return -1;
+
+            current.value           = member->value;
+            current.value_length    = member->value_length;
+            current.value_type      = member->value_type;
+        }
+        else if(current.value_type == JSMNTREE_ARRAY)
+        {
+            jsmntree_array *    array   = current.value.pointer;
+            size_t              index   = 0;
+            size_t              i;
+
+            if(length == 0 || jsmntree_array_expand(array) < 0)
+                return -1;
+
+            for(i = 0; i < length; ++i)
+            {
+                if(segment[i] < '0' || segment[i] > '9')
+                    return -1;
+                index = index * 10 + (segment[i] - '0');
+            }
+
+            if(index >= array->size)
+                return -1;
+
+            current = array->elements[index];
+        }
+        else
+            return -1;
+    }
+
+    if(*path != '\0')
+        return -1;
+
+    if(result != NULL)
+        *result = current;
+
+    return 0;
+}
+
+static void jsmntree_free_object(const jsmntree_tree *, jsmntree_object *);
+static void jsmntree_free_array(const jsmntree_tree *, jsmntree_array *);
+static void jsmntree_free_member(const jsmntree_tree *, jsmntree_member *);
+
+void
+jsmntree_free_tree(jsmntree_object * object)
+{
+    if(object == NULL)
+        return;
+
+    jsmntree_tree *         tree    = (jsmntree_tree *)object;
+    const jsmntree_builder  builder = tree->builder;
+    const double            start   = (builder.stats != NULL) ? jsmntree_clock() : 0;
+
+    free(tree->owned_tokens);
+
+    /* Nothing below reads the JSON string */
+    jsmntree_unmap_file(tree->mapping, tree->mapping_size);
+
+    if(tree->arenas != NULL)
+    {
+        unsigned int i;
+        for(i = 0; i < tree->num_arenas; ++i)
+            jsmntree_arena_destroy(tree->arenas[i]);
+
+        free(tree->arenas);
+    }
+
+    if(tree->owns_intern)
+        jsmntree_intern_destroy(tree->builder.intern);
+
+    /* Nodes in an arena go with the arena, all at once */
+    if(builder.arena != NULL)
+    {
+        if(tree->owns_arena)
+            jsmntree_arena_destroy(builder.arena);
+    }
+    else
+    {
+        jsmntree_free_object(tree, object);
+        jsmntree_dealloc(&builder, tree);
+    }
+
+    if(builder.stats != NULL)
+        builder.stats->free_seconds += jsmntree_clock() - start;
+}
+
+/* Free what a member or an element value points to */
+static void
+jsmntree_free_value(const jsmntree_tree * tree, jsmntree_value * value,
+                    const size_t value_length, const jsmntreetype_t value_type)
+{
+    switch(value_type)
+    {
+    case JSMNTREE_OBJECT:
+        jsmntree_free_object(tree, value->pointer);
+        jsmntree_dealloc(&tree->builder, value->pointer);
+        break;
+
+    case JSMNTREE_ARRAY:
+        jsmntree_free_array(tree, value->pointer);
+        jsmntree_dealloc(&tree->builder, value->pointer);
+        break;
+
+    case JSMNTREE_STRING:
+        if(value_length > JSMNTREE_INLINE_MAX && jsmntree_owns_string(&tree->builder, value->pointer))
+            jsmntree_dealloc(&tree->builder, value->pointer);
+        break;
+
+    default:
+        /* Scalars are stored inline */
+        break;
+    }
+}
+
+static void
+jsmntree_free_object(const jsmntree_tree * tree, jsmntree_object * object)
+{
+    if(object == NULL)
+        return;
+
+    while(object->size > 0)
+    {
+        jsmntree_free_member(tree, &object->members[object->size - 1]);
+        --object->size;
+    }
+
+    jsmntree_dealloc(&tree->builder, object->members);
+    jsmntree_dealloc(&tree->builder, object->index);
+    object->index = NULL;
+}
+
+/* Free what a member points to; the member is part of its object */
+static void
+jsmntree_free_member(const jsmntree_tree * tree, jsmntree_member * member)
+{
+    /* Interned names belong to the interning table */
+    if(tree->builder.intern == NULL && jsmntree_owns_string(&tree->builder, member->name))
+        jsmntree_dealloc(&tree->builder, member->name);
+
+    jsmntree_free_value(tree, &member->value, member->value_length, member->value_type);
+}
+
+static void
+jsmntree_free_array(const jsmntree_tree * tree, jsmntree_array * array)
+{
+    if(array == NULL)
+        return;
+
+    while(array->size > 0)
+    {
+        jsmntree_element * element = &array->elements[array->size - 1];
+
+        jsmntree_free_value(tree, &element->value, element->value_length, element->value_type);
+        --array->size;
+    }
+
+    jsmntree_dealloc(&tree->builder, array->elements);
+}
+
+/**
+ * An open object or array of the fused parser.
+ * @param       container   Object or array
+ * @param       type        JSMNTREE_OBJECT or JSMNTREE_ARRAY
+ * @param       first       Index of its first member or element in the
+ *                          members or elements pending
+ */
+typedef struct
+{
+    void *              container;
+    jsmntreetype_t      type;
+    size_t              first;
+}
+jsmntree_fused_frame;
+
+/**
+ * Arrays of pending members and elements which outlive a fused parse, so
+ * that the next one reuses them; see jsmntree_fused.
+ * @param       members     Members
+ * @param       members_capacity    Allocated number of `members'
+ * @param       elements    Elements
+ * @param       elements_capacity   Allocated number of `elements'
+ */
+struct jsmntree_fused_buffers
+{
+    jsmntree_member *   members;
+    size_t              members_capacity;
+    jsmntree_element *  elements;
+    size_t              elements_capacity;
+};
+
+/**
+ * State of the fused parser. Members and elements are held in `members'
+ * and `elements' until their container is closed, so that it gets an
+ * array of exactly their number. Containers close in the reverse order
+ * they open in, so those of the innermost are always the last ones.
+ * @param       builder     Builder of the tree
+ * @param       js          JSON string
+ * @param       p           Next byte to parse
+ * @param       end         End of `js'
+ * @param       members     Members of the open objects
+ * @param       num_members Number of `members'
+ * @param       members_capacity    Allocated number of `members'
+ * @param       elements    Elements of the open arrays
+ * @param       num_elements    Number of `elements'
+ * @param       elements_capacity   Allocated number of `elements'
+ */
+typedef struct
+{
+    jsmntree_builder *  builder;
+    const char *        js;
+    const char *        p;
+    const char *        end;
+    jsmntree_member *   members;
+    size_t              num_members;
+    size_t              members_capacity;
+    jsmntree_element *  elements;
+    size_t              num_elements;
+    size_t              elements_capacity;
+}
+jsmntree_fused;
+
+/* Parser states: what may come next in the innermost container */
+enum
+{
+    JSMNTREE_FUSED_FIRST,   /* A value, or the end right after the start */
+    JSMNTREE_FUSED_NEXT,    /* A value, after ',' */
+    JSMNTREE_FUSED_AFTER,   /* ',' or the end, after a value */
+};
+
+static const char *
+jsmntree_fused_skip(const char * p, const char * end)
+{
+    while(p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t'))
+        ++p;
+
+    return p;
+}
+
+/**
+ * Add an empty member or element to the end of `*items'.
+ * @return      The item, or NULL if out of memory
+ */
+static void *
+jsmntree_fused_push(void ** items, size_t * size, size_t * capacity, const size_t item_size)
+{
+    if(*size == *capacity)
+    {
+        const size_t    new_capacity    = (*capacity > 0) ? *capacity * 2 : 256;
+        void *          new_items       = realloc(*items, item_size * new_capacity);
+
+        if(new_items == NULL)
+            return NULL;
+
+        *items      = new_items;
+        *capacity   = new_capacity;
+    }
+
+    return memset((char *)*items + item_size * (*size)++, 0, item_size);
+}
+
+/**
+ * Close the innermost container: give it its pending members or elements.
+ * @return      0 on success, -1 if out of memory; they are released then
+ */
+static int
+jsmntree_fused_close(jsmntree_fused * f, const jsmntree_fused_frame * frame)
+{
+    jsmntree_builder *  builder     = f->builder;
+    size_t              size;
+    size_t              i;
+
+    if(frame->type == JSMNTREE_OBJECT)
+    {
+        jsmntree_object *   object      = frame->container;
+
+        size            = f->num_members - frame->first;
+        f->num_members  = frame->first;
+
+        if(size > 0)
+        {
+            object->members = jsmntree_alloc(builder, JSMNTREE_MEMBER_ARRAY, size);
+            if(object->members == NULL)
+            {
+                /* Nodes in an arena go with the arena */
+                for(i = 0; builder->arena == NULL && i < size; ++i)
+                    jsmntree_free_member(builder->tree, &f->members[frame->first + i]);
+
+                return -1;
+            }
+
+            memcpy(object->members, &f->members[frame->first], sizeof(jsmntree_member) * size);
+        }
+
+        object->capacity = size;
+    }
+    else
+    {
+        jsmntree_array *    array       = frame->container;
+
+        size            = f->num_elements - frame->first;
+        f->num_elements = frame->first;
+
+        if(size > 0)
+        {
+            array->elements = jsmntree_alloc(builder, JSMNTREE_ELEMENT_ARRAY, size);
+            if(array->elements == NULL)
+            {
+                for(i = 0; builder->arena == NULL && i < size; ++i)
+                {
+                    jsmntree_element * element = &f->elements[frame->first + i];
+
+                    jsmntree_free_value(builder->tree, &element->value, element->value_length,
+                                        element->value_type);
+                }
+
+                return -1;
+            }
+
+            memcpy(array->elements, &f->elements[frame->first], sizeof(jsmntree_element) * size);
+        }
+
+        array->capacity = size;
+    }
+
+    jsmntree_complete(builder, frame->container, frame->type, size);
+
+    return 0;
+}
+
+/* Find the end of the string at `f->p', check its escapes, and make a token of its contents */
+static int
+jsmntree_fused_string(jsmntree_fused * f, jsmntok_t * token)
+{
+    const char *    begin   = f->p + 1;
+    const char *    quote   = begin;
+    const char *    p;
+
+    for(;;)
+    {
+        const char * backslash;
+
+        quote = memchr(quote, '"', f->end - quote);
+        if(quote == NULL)
+            return JSMN_ERROR_PART;
+
+        /* Escaped if preceded by an odd number of backslashes */
+        for(backslash = quote; backslash > begin && backslash[-1] == '\\'; --backslash)
+            ;
+
+        if(((quote - backslash) & 1) == 0)
+            break;
+
+        ++quote;
+    }
+
+    /* Escapes are checked as jsmn checks them */
+    for(p = memchr(begin, '\\', quote - begin); p != NULL; p = memchr(p, '\\', quote - p))
+    {
+        int i;
+
+        switch(*++p)
+        {
+        case '"': case '/': case '\\': case 'b': case 'f': case 'r': case 'n': case 't':
+            ++p;
+            break;
+
+        case 'u':
+            for(i = 1; i <= 4; ++i)
+            {
+                if(p + i >= quote || !isxdigit((unsigned char)p[i]))
+                    return JSMN_ERROR_INVAL;
+            }
+
+            p += 5;
+            break;
+
+        default:
+            return JSMN_ERROR_INVAL;
+        }
+    }
+
+    token->type     = JSMN_STRING;
+    token->start    = begin - f->js;
+    token->end      = quote - f->js;
+    token->size     = 0;
+    f->p            = quote + 1;
+
+    return 0;
+}
+
+/**
+ * Parse a value into a member or an element. An object or an array is
+ * pushed onto `stack', still open.
+ * @return      0 on success, or an error of jsmntree_parse_buffer()
+ */
+static int
+jsmntree_fused_value(jsmntree_fused * f, jsmntree_fused_frame * stack, unsigned int * depth,
+                        jsmntree_value * value, uint32_t * value_length, jsmntreetype_t * value_type)
+{
+    jsmntree_builder *  builder = f->builder;
+    jsmntok_t           token;
+    const char *        p;
+    int                 r;
+
+    switch(*f->p)
+    {
+    case '{':
+    case '[':
+        if(*depth == JSMNTREE_FUSED_MAX_DEPTH)
+            return JSMNTREE_ERROR_DEPTH;
+
+        *value_type     = (*f->p == '{') ? JSMNTREE_OBJECT : JSMNTREE_ARRAY;
+        value->pointer  = jsmntree_alloc(builder, *value_type, 1);
+        if(value->pointer == NULL)
+        {
+            *value_type = JSMNTREE_UNDEFINED;
+            return JSMN_ERROR_NOMEM;
+        }
+
+        jsmntree_init(value->pointer, *value_type, 1);
+        if(*value_type == JSMNTREE_OBJECT)
+            ((jsmntree_object *)value->pointer)->tree   = builder->tree;
+        else
+            ((jsmntree_array *)value->pointer)->tree    = builder->tree;
+
+        stack[*depth].container = value->pointer;
+        stack[*depth].type      = *value_type;
+        stack[*depth].first     = (*value_type == JSMNTREE_OBJECT) ? f->num_members : f->num_elements;
+        ++*depth;
+        ++f->p;
+        return 0;
+
+    case '"':
+        r = jsmntree_fused_string(f, &token);
+        if(r != 0)
+            return r;
+
+        *value_type     = JSMNTREE_STRING;
+        if(jsmntree_make_string_value(builder, f->js, &token, value, value_length) < 0)
+        {
+            *value_type = JSMNTREE_UNDEFINED;
+            return JSMN_ERROR_NOMEM;
+        }
+
+        return 0;
+
+    default:
+        /* A primitive runs up to a delimiter, as jsmn reads it */
+        for(p = f->p; p < f->end; ++p)
+        {
+            if(*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n' ||
+                    *p == ',' || *p == ']' || *p == '}' || *p == ':')
+                break;
+
+            if((unsigned char)*p < 32 || (unsigned char)*p >= 127)
+                return JSMN_ERROR_INVAL;
+        }
+
+        if(p == f->end)
+            return JSMN_ERROR_PART;
+
+        if(p == f->p)
+            return JSMN_ERROR_INVAL;
+
+        token.type      = JSMN_PRIMITIVE;
+        token.start     = f->p - f->js;
+        token.end       = p - f->js;
+        token.size      = 0;
+        f->p            = p;
+
+        *value_type     = jsmntree_decode_primitive(f->js, &token, value);
+        return 0;
+    }
+}
+
+/**
+ * Make a tree in a single pass over a JSON string, with no tokens: nodes
+ * are made as the bytes are read, and the containers open on the way are
+ * kept in a stack of JSMNTREE_FUSED_MAX_DEPTH frames on the C stack. As
+ * jsmntree_parse_buffer(), but lazy trees, projections and threads are
+ * not supported.
+ * @param       buffers     Pending members and elements to start with and
+ *                          to keep, or NULL to release them at the end
+ */
+static int
+jsmntree_parse_fused(const char * js, const size_t len, const jsmntree_options * options,
+                        jsmntree_fused_buffers * buffers, jsmntree_object ** tree)
+{
+    jsmntree_fused_frame    stack[JSMNTREE_FUSED_MAX_DEPTH];
+    unsigned int            depth   = 0;
+    int                     state   = JSMNTREE_FUSED_FIRST;
+    const char *            end     = js + len;
+    const char *            p       = jsmntree_fused_skip(js, end);
+    jsmntree_stats *        stats   = (options != NULL) ? options->stats : NULL;
+    const double            start   = (stats != NULL) ? jsmntree_clock() : 0;
+    int                     r       = 0;
+
+    if(p == end || *p != '{')
+        return JSMNTREE_ERROR_INVTOK;
+
+    /* An arena of the tree's own is sized for one token per 8 bytes */
+    jsmntree_tree *         new_tree = jsmntree_create_tree(js, len, NULL, (unsigned int)(len / 8), options);
+    if(new_tree == NULL)
+        return JSMN_ERROR_NOMEM;
+
+    new_tree->builder.num_tokens = 0;
+
+    jsmntree_fused          f       = { &new_tree->builder, js, p + 1, end, NULL, 0, 0, NULL, 0, 0 };
+
+    if(buffers != NULL)
+    {
+        f.members           = buffers->members;
+        f.members_capacity  = buffers->members_capacity;
+        f.elements          = buffers->elements;
+        f.elements_capacity = buffers->elements_capacity;
+    }
+
+    stack[0].container  = &new_tree->root;
+    stack[0].type       = JSMNTREE_OBJECT;
+    stack[0].first      = 0;
+    depth               = 1;
+
+    while(depth > 0)
+    {
+        jsmntree_fused_frame *  frame   = &stack[depth - 1];
+        const char              close   = (frame->type == JSMNTREE_OBJECT) ? '}' : ']';
+        jsmntree_value *        value;
+        uint32_t *              value_length;
+        jsmntreetype_t *        value_type;
+
+        f.p = jsmntree_fused_skip(f.p, end);
+        if(f.p == end)
+        {
+            r = JSMN_ERROR_PART;
+            break;
+        }
+
+        if(state == JSMNTREE_FUSED_AFTER && *f.p == ',')
+        {
+            ++f.p;
+            state = JSMNTREE_FUSED_NEXT;
+            continue;
+        }
+
+        if(state != JSMNTREE_FUSED_NEXT && *f.p == close)
+        {
+            ++f.p;
+            if(jsmntree_fused_close(&f, frame) < 0)
+            {
+                r = JSMN_ERROR_NOMEM;
+                break;
+            }
+
+            --depth;
+            state = JSMNTREE_FUSED_AFTER;
+            continue;
+        }
+
+        if(state == JSMNTREE_FUSED_AFTER)
+        {
+            r = JSMN_ERROR_INVAL;
+            break;
+        }
+
+        if(frame->type == JSMNTREE_OBJECT)
+        {
+            jsmntree_member *   member;
+            jsmntok_t           name;
+
+            if(*f.p != '"')
+            {
+                r = JSMN_ERROR_INVAL;
+                break;
+            }
+
+            r = jsmntree_fused_string(&f, &name);
+            if(r != 0)
+                break;
+
+            member = jsmntree_fused_push((void **)&f.members, &f.num_members, &f.members_capacity,
+                                            sizeof(jsmntree_member));
+            if(member == NULL)
+            {
+                r = JSMN_ERROR_NOMEM;
+                break;
+            }
+
+            member->name = jsmntree_make_name(f.builder, js, &name, &member->name_length);
+            if(member->name == NULL)
+            {
+                r = JSMN_ERROR_NOMEM;
+                break;
+            }
+
+            f.p = jsmntree_fused_skip(f.p, end);
+            if(f.p == end || *f.p != ':')
+            {
+                r = (f.p == end) ? JSMN_ERROR_PART : JSMN_ERROR_INVAL;
+                break;
+            }
+
+            f.p = jsmntree_fused_skip(f.p + 1, end);
+            if(f.p == end)
+            {
+                r = JSMN_ERROR_PART;
+                break;
+            }
+
+            value           = &member->value;
+            value_length    = &member->value_length;
+            value_type      = &member->value_type;
+        }
+        else
+        {
+            jsmntree_element * element = jsmntree_fused_push((void **)&f.elements, &f.num_elements,
+                                                            &f.elements_capacity, sizeof(jsmntree_element));
+            if(element == NULL)
+            {
+                r = JSMN_ERROR_NOMEM;
+                break;
+            }
+
+            value           = &element->value;
+            value_length    = &element->value_length;
+            value_type      = &element->value_type;
+        }
+
+        r = jsmntree_fused_value(&f, stack, &depth, value, value_length, value_type);
+        if(r != 0)
+            break;
+
+        state = (&stack[depth - 1] != frame) ? JSMNTREE_FUSED_FIRST : JSMNTREE_FUSED_AFTER;
+    }
+
+    /* Only whitespace after the root, up to a '\0' as jsmn reads it */
+    if(r == 0)
+    {
+        f.p = jsmntree_fused_skip(f.p, end);
+        if(f.p != end && *f.p != '\0')
+            r = JSMN_ERROR_INVAL;
+    }
+
+    if(r != 0)
+    {
+        /* Close what is open, so that the tree is freed as a whole */
+        while(depth > 0)
+            jsmntree_fused_close(&f, &stack[--depth]);
+    }
+
+    if(buffers != NULL)
+    {
+        buffers->members            = f.members;
+        buffers->members_capacity   = f.members_capacity;
+        buffers->elements           = f.elements;
+        buffers->elements_capacity  = f.elements_capacity;
+    }
+    else
+    {
+        free(f.members);
+        free(f.elements);
+    }
+
+    if(r != 0)
+    {
+        jsmntree_free_tree(&new_tree->root);
+        return r;
+    }
+
+    if(stats != NULL)
+        stats->build_seconds += jsmntree_clock() - start;
+
+    *tree = &new_tree->root;
+
+    return 0;
+}
+
+/**
+ * What a context keeps from tree to tree.
+ * @param       options     Options trees are made with, with the arena and
+ *                          the interning table of the context
+ * @param       owns_intern Whether `options.intern' is released with the
+ *                          context
+ * @param       tokens      Tokens of the current tree
+ * @param       tokens_capacity Allocated number of `tokens'
+ * @param       buffers     Pending members and elements of the fused parser
+ * @param       tree        Current tree, or NULL
+ */
+struct jsmntree_context
+{
+    jsmntree_options        options;
+    int                     owns_intern;
+    jsmntok_t *             tokens;
+    unsigned int            tokens_capacity;
+    jsmntree_fused_buffers  buffers;
+    jsmntree_object *       tree;
+};
+
+jsmntree_context *
+jsmntree_context_create(const jsmntree_options * options)
+{
+    jsmntree_context * context = calloc(1, sizeof(jsmntree_context));
+
+    if(context == NULL)
+        return NULL;
+
+    if(options != NULL)
+        context->options = *options;
+    else
+        jsmntree_options_init(&context->options);
+
+    context->options.flags         |= JSMNTREE_FLAG_ARENA;
+    context->options.num_threads    = 0;
+
+    context->options.arena = jsmntree_arena_create(64 * 1024);
+    if(context->options.arena == NULL)
+    {
+        free(context);
+        return NULL;
+    }
+
+    if((context->options.flags & JSMNTREE_FLAG_INTERN) && context->options.intern == NULL)
+    {
+        context->options.intern = jsmntree_intern_create();
+        if(context->options.intern == NULL)
+        {
+            jsmntree_arena_destroy(context->options.arena);
+            free(context);
+            return NULL;
+        }
+
+        context->owns_intern = 1;
+    }
+
+    return context;
+}
+
+int
+jsmntree_context_parse(jsmntree_context * context, const char * js, const size_t len,
+                        jsmntree_object ** tree)
+{
+    const jsmntree_options *    options = &context->options;
+    int                         r;
+
+    *tree = NULL;
+    jsmntree_reset(context);
+
+    /* As jsmntree_parse_buffer(), but the tokens are kept */
+    if((options->flags & JSMNTREE_FLAG_FUSED) && !(options->flags & JSMNTREE_FLAG_LAZY) &&
+            options->projection == NULL)
+        r = jsmntree_parse_fused(js, len, options, &context->buffers, tree);
+    else
+    {
+        r = jsmntree_parse_tokens(js, len, &context->tokens, &context->tokens_capacity);
+        if(r < 0)
+            return r;
+
+        r = jsmntree_build_tree(js, len, context->tokens, r, options, tree);
+    }
+
+    context->tree = *tree;
+
+    return r;
+}
+
+void
+jsmntree_reset(jsmntree_context * context)
+{
+    if(context == NULL)
+        return;
+
+    /* The nodes are in the arena; this only does the rest */
+    jsmntree_free_tree(context->tree);
+    context->tree = NULL;
+
+    jsmntree_arena_reset(context->options.arena);
+}
+
+void
+jsmntree_context_destroy(jsmntree_context * context)
+{
+    if(context == NULL)
+        return;
+
+    jsmntree_reset(context);
+
+    jsmntree_arena_destroy(context->options.arena);
+    if(context->owns_intern)
+        jsmntree_intern_destroy(context->options.intern);
+
+    free(context->tokens);
+    free(context->buffers.members);
+    free(context->buffers.elements);
+    free(context);
+}
+
+static void jsmntree_stats_object(const jsmntree_tree *, const jsmntree_object *,
+                                    jsmntree_stats *, const size_t);
+static void jsmntree_stats_array(const jsmntree_tree *, const jsmntree_array *,
+                                    jsmntree_stats *, const size_t);
+
+/* Count a member or an element value, and walk into it */
+static void
+jsmntree_stats_value(const jsmntree_tree * tree, const jsmntree_value * value,
+                        const size_t value_length, const jsmntreetype_t value_type,
+                        jsmntree_stats * stats, const size_t depth)
+{
+    switch(value_type)
+    {
+    case JSMNTREE_OBJECT:
+        jsmntree_stats_object(tree, value->pointer, stats, depth + 1);
+        break;
+
+    case JSMNTREE_ARRAY:
+        jsmntree_stats_array(tree, value->pointer, stats, depth + 1);
+        break;
+
+    case JSMNTREE_STRING:
+        ++stats->counts[JSMNTREE_STRING];
+        if(value_length <= JSMNTREE_INLINE_MAX)
+            stats->scalar_bytes += sizeof(jsmntree_value);
+        else if(jsmntree_owns_string(&tree->builder, value->pointer))
+            stats->string_bytes += value_length + 1;
+        break;
+
+    default:
+        if(value_type <= JSMNTREE_REAL)
+            ++stats->counts[value_type];
+        stats->scalar_bytes += sizeof(jsmntree_value);
+        break;
+    }
+}
+
+static void
+jsmntree_stats_object(const jsmntree_tree * tree, const jsmntree_object * object,
+                        jsmntree_stats * stats, const size_t depth)
+{
+    size_t i;
+
+    ++stats->counts[JSMNTREE_OBJECT];
+    stats->node_bytes   += sizeof(jsmntree_object) + sizeof(jsmntree_member) * object->capacity;
+    if(object->index != NULL)
+        stats->pointer_bytes += sizeof(jsmntree_index)
+                                + sizeof(jsmntree_index_slot) * (object->index->mask + 1);
+
+    if(depth > stats->max_depth)
+        stats->max_depth = depth;
+
+    for(i = 0; i < object->size; ++i)
+    {
+        const jsmntree_member * member = &object->members[i];
+
+        ++stats->counts[JSMNTREE_MEMBER];
+        if(tree->builder.intern == NULL && jsmntree_owns_string(&tree->builder, member->name))
+            stats->string_bytes += member->name_length + 1;
+
+        jsmntree_stats_value(tree, &member->value, member->value_length, member->value_type,
+                                stats, depth);
+    }
+}
+
+static void
+jsmntree_stats_array(const jsmntree_tree * tree, const jsmntree_array * array,
+                        jsmntree_stats * stats, const size_t depth)
+{
+    size_t i;
+
+    ++stats->counts[JSMNTREE_ARRAY];
+    stats->node_bytes   += sizeof(jsmntree_array) + sizeof(jsmntree_element) * array->capacity;
+
+    if(depth > stats->max_depth)
+        stats->max_depth = depth;
+
+    for(i = 0; i < array->size; ++i)
+    {
+        const jsmntree_element * element = &array->elements[i];
+
+        ++stats->counts[JSMNTREE_ELEMENT];
+
+        jsmntree_stats_value(tree, &element->value, element->value_length, element->value_type,
+                                stats, depth);
+    }
+}
+
+void
+jsmntree_stats_collect(jsmntree_object * object, jsmntree_stats * stats)
+{
+    memset(stats->counts, 0, sizeof(stats->counts));
+    stats->string_bytes     = 0;
+    stats->pointer_bytes    = 0;
+    stats->node_bytes       = 0;
+    stats->scalar_bytes     = 0;
+    stats->max_depth        = 0;
+
+    if(object != NULL)
+        jsmntree_stats_object(object->tree, object, stats, 1);
+}
+
+/**
+ * Make room for one more item in an array of `size' items of `item_size'
+ * bytes, doubling `*capacity' when it is full. In an arena, the old
+ * array is left behind; it goes with the arena. An allocator without
+ * realloc gets a new array, and the old one is released.
+ * @return      Array, or NULL if out of memory (`array' is unchanged)
+ */
+static void *
+jsmntree_grow(jsmntree_builder * builder, void * array, size_t * capacity,
+                const size_t size, const size_t item_size)
+{
+    size_t  new_capacity;
+    void *  new_array;
+
+    if(size < *capacity)
+        return array;
+
+    new_capacity = (*capacity > 0) ? *capacity * 2 : 4;
+
+    if(builder->arena == NULL && builder->allocator.malloc == NULL)
+    {
+        if(builder->stats != NULL)
+        {
+            __atomic_fetch_add(&builder->stats->allocations, 1, __ATOMIC_RELAXED);
+            __atomic_fetch_add(&builder->stats->allocated_bytes, item_size * new_capacity, __ATOMIC_RELAXED);
+        }
+
+        new_array = realloc(array, item_size * new_capacity);
+    }
+    else
+    {
+        new_array = jsmntree_alloc_bytes(builder, item_size * new_capacity);
+        if(new_array == NULL)
+            return NULL;
+
+        if(size > 0)
+            memcpy(new_array, array, item_size * size);
+        if(builder->arena == NULL)
+            jsmntree_dealloc(builder, array);
+    }
+
+    if(new_array != NULL)
+        *capacity = new_capacity;
+
+    return new_array;
+}
+
+/**
+ * Set a member or an element value to a copy of `source', releasing the
+ * old value. A string is copied; an object or an array is made empty.
+ * @return      0 on success, -1 if out of memory (the old value is kept)
+ */
+static int
+jsmntree_set_value(jsmntree_tree * tree, jsmntree_value * value, uint32_t * value_length,
+                    jsmntreetype_t * value_type, const jsmntree_element * source)
+{
+    jsmntree_builder *  builder     = &tree->builder;
+    jsmntree_value      new_value   = source->value;
+    uint32_t            new_length  = 0;
+
+    switch(source->value_type)
+    {
+    case JSMNTREE_OBJECT:
+    case JSMNTREE_ARRAY:
+        new_value.pointer = jsmntree_alloc(builder, source->value_type, 1);
+        if(new_value.pointer == NULL)
+            return -1;
+
+        jsmntree_init(new_value.pointer, source->value_type, 1);
+        if(source->value_type == JSMNTREE_OBJECT)
+            ((jsmntree_object *)new_value.pointer)->tree    = tree;
+        else
+            ((jsmntree_array *)new_value.pointer)->tree     = tree;
+        break;
+
+    case JSMNTREE_STRING:
+        /* A short string is inline, and so copied already */
+        new_length = source->value_length;
+        if(new_length <= JSMNTREE_INLINE_MAX)
+            break;
+
+        new_value.pointer = jsmntree_copy_string(builder, source->value.pointer, new_length);
+        if(new_value.pointer == NULL)
+            return -1;
+        break;
+
+    default:
+        /* Scalars are stored inline */
+        break;
+    }
+
+    /* Only now, since `source' may be part of the old value */
+    if(builder->arena == NULL)
+        jsmntree_free_value(tree, value, *value_length, *value_type);
+
+    *value          = new_value;
+    *value_length   = new_length;
+    *value_type     = source->value_type;
+
+    return 0;
+}
+
+/**
+ * Index the member just put at `position' of an object, if the object
+ * is, or has just become, large enough to be indexed. The index is
+ * rebuilt, twice as large, once it is half full.
+ */
+static void
+jsmntree_index_insert(jsmntree_builder * builder, jsmntree_object * object, const size_t position)
+{
+    jsmntree_index *            index   = object->index;
+    const jsmntree_member *     member  = &object->members[position];
+    size_t                      slot;
+
+    if(index == NULL || object->size * 2 > index->mask + 1)
+    {
+        object->index = NULL;
+        jsmntree_index_object(builder, object);
+
+        if(object->index != NULL || index == NULL || object->size > index->mask)
+        {
+            /* Without a free slot left, lookups scan the members */
+            if(index != NULL && builder->arena == NULL)
+                jsmntree_dealloc(builder, index);
+            return;
+        }
+
+        /* Out of memory: the old index has room still */
+        object->index = index;
+    }
+
+    /* Members after `position' have moved up */
+    if(position + 1 < object->size)
+    {
+        for(slot = 0; slot <= index->mask; ++slot)
+        {
+            if(index->slots[slot].member > position)
+                ++index->slots[slot].member;
+        }
+    }
+
+    jsmntree_index_put(index, jsmntree_hash_name(member->name, member->name_length), position);
+}
+
+jsmntree_member *
+jsmntree_object_insert(jsmntree_object * object, const size_t position,
+                        const char * name, const size_t name_length, const jsmntree_element * value)
+{
+    if(object == NULL || jsmntree_object_expand(object) < 0 || position > object->size)
+        return NULL;
+
+    jsmntree_tree *     tree    = object->tree;
+    jsmntree_builder *  builder = &tree->builder;
+    jsmntree_member     member;
+
+    /* Made first, so that the members are left as they are if it fails */
+    memset(&member, 0, sizeof(member));
+    member.name                 = jsmntree_copy_name(builder, name, name_length);
+    member.name_length          = name_length;
+
+    if(member.name == NULL ||
+            jsmntree_set_value(tree, &member.value, &member.value_length, &member.value_type, value) < 0)
+    {
+        if(builder->arena == NULL)
+            jsmntree_free_member(tree, &member);
+        return NULL;
+    }
+
+    jsmntree_member *   members = jsmntree_grow(builder, object->members, &object->capacity,
+                                                object->size, sizeof(jsmntree_member));
+    if(members == NULL)
+    {
+        if(builder->arena == NULL)
+            jsmntree_free_member(tree, &member);
+        return NULL;
+    }
+    object->members             = members;
+
+    memmove(&members[position + 1], &members[position],
+            sizeof(jsmntree_member) * (object->size - position));
+    members[position] = member;
+    ++object->size;
+
+    jsmntree_index_insert(builder, object, position);
+
+    return &members[position];
+}
+
+jsmntree_member *
+jsmntree_object_set(jsmntree_object * object, const char * name, const size_t name_length,
+                    const jsmntree_element * value)
+{
+    if(object == NULL || jsmntree_object_expand(object) < 0)
+        return NULL;
+
+    size_t position = jsmntree_object_position(object, name, name_length, 0);
+
+    if(position == object->size)
+        return jsmntree_object_insert(object, position, name, name_length, value);
+
+    jsmntree_member * member = &object->members[position];
+
+    if(jsmntree_set_value(object->tree, &member->value, &member->value_length,
+                            &member->value_type, value) < 0)
+        return NULL;
+
+    return member;
+}
+
+int
+jsmntree_object_remove(jsmntree_object * object, const char * name, const size_t name_length)
+{
+    if(object == NULL || jsmntree_object_expand(object) < 0)
+        return -1;
+
+    const size_t        position    = jsmntree_object_position(object, name, name_length, 0);
+    const size_t        last        = object->size - 1;
+
+    if(position == object->size)
+        return -1;
+
+    jsmntree_index *    index       = object->index;
+
+    /* The last member takes the place of the removed one */
+    if(index != NULL)
+    {
+        jsmntree_index_erase(index, jsmntree_index_find(index,
+                    jsmntree_hash_name(name, name_length), position));
+
+        if(position != last)
+        {
+            const jsmntree_member * moved = &object->members[last];
+
+            index->slots[jsmntree_index_find(index,
+                    jsmntree_hash_name(moved->name, moved->name_length), last)].member = position + 1;
+        }
+    }
+
+    if(object->tree->builder.arena == NULL)
+        jsmntree_free_member(object->tree, &object->members[position]);
+
+    object->members[position] = object->members[last];
+    --object->size;
+
+    return 0;
+}
+
+jsmntree_element *
+jsmntree_array_insert(jsmntree_array * array, const size_t position, const jsmntree_element * value)
+{
+    if(array == NULL || jsmntree_array_expand(array) < 0 || position > array->size)
+        return NULL;
+
+    jsmntree_tree *     tree        = array->tree;
+    jsmntree_builder *  builder     = &tree->builder;
+    jsmntree_element    element;
+
+    /* Made before the elements move, since `value' may be one of them */
+    memset(&element, 0, sizeof(element));
+    if(jsmntree_set_value(tree, &element.value, &element.value_length, &element.value_type, value) < 0)
+        return NULL;
+
+    jsmntree_element *  elements    = jsmntree_grow(builder, array->elements, &array->capacity,
+                                                    array->size, sizeof(jsmntree_element));
+    if(elements == NULL)
+    {
+        if(builder->arena == NULL)
+            jsmntree_free_value(tree, &element.value, element.value_length, element.value_type);
+        return NULL;
+    }
+    array->elements                 = elements;
+
+    memmove(&elements[position + 1], &elements[position],
+            sizeof(jsmntree_element) * (array->size - position));
+    elements[position] = element;
+    ++array->size;
+
+    return &elements[position];
+}
+
+jsmntree_element *
+jsmntree_array_append(jsmntree_array * array, const jsmntree_element * value)
+{
+    if(array == NULL || jsmntree_array_expand(array) < 0)
+        return NULL;
+
+    return jsmntree_array_insert(array, array->size, value);
+}
+
+jsmntree_element *
+jsmntree_array_set(jsmntree_array * array, const size_t position, const jsmntree_element * value)
+{
+    if(array == NULL || jsmntree_array_expand(array) < 0 || position >= array->size)
+        return NULL;
+
+    jsmntree_element * element = &array->elements[position];
+
+    if(jsmntree_set_value(array->tree, &element->value, &element->value_length,
+                            &element->value_type, value) < 0)
+        return NULL;
+
+    return element;
+}
+
+int
+jsmntree_array_remove(jsmntree_array * array, const size_t position)
+{
+    if(array == NULL || jsmntree_array_expand(array) < 0 || position >= array->size)
+        return -1;
+
+    jsmntree_element * element = &array->elements[position];
+
+    if(array->tree->builder.arena == NULL)
+        jsmntree_free_value(array->tree, &element->value, element->value_length, element->value_type);
+
+    /* Elements keep their order */
+    memmove(&array->elements[position], &array->elements[position + 1],
+            sizeof(jsmntree_element) * (array->size - position - 1));
+    --array->size;
+
+    return 0;
+}
+
+#undef JSMNTREE_PARALLEL_GRAIN
+#undef JSMNTREE_PARALLEL_TASKS
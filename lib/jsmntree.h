@@ -2,6 +2,8 @@
 #define JSMNTREE_H_ 1
 
 #include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>  /* FILE */
 #include "jsmn/jsmn.h" /* jsmntok_t (http://zserge.com/jsmn.html) */
 
 #ifdef __cplusplus
@@ -15,7 +17,9 @@ extern "C"
  *      o Object
  *      o Array
  *      o String
- *      o Number
+ *      o Number (JSMNTREE_NUMBER if it fits in int64_t,
+ *                JSMNTREE_UNSIGNED if it only fits in uint64_t,
+ *                JSMNTREE_REAL otherwise)
  *      o Boolean (true/false)
  *      o null
  */
@@ -33,82 +37,820 @@ typedef enum
     JSMNTREE_ELEMENT    = 9,
     JSMNTREE_MEMBER_ARRAY   = 10,
     JSMNTREE_ELEMENT_ARRAY  = 11,
+    JSMNTREE_UNSIGNED   = 12,
+    JSMNTREE_REAL       = 13,
 }
 jsmntreetype_t;
 
+/* Longest string stored inline in a value, without its NUL */
+#define JSMNTREE_INLINE_MAX     15
+
+/**
+ * A value of a member or an element. Scalars, and strings of at most
+ * JSMNTREE_INLINE_MAX bytes, are stored inline; read a string with
+ * JSMNTREE_VALUE_STRING().
+ * @param       pointer     Object, array or longer string
+ * @param       integer     Number
+ * @param       uinteger    Unsigned
+ * @param       real        Real
+ * @param       boolean     Boolean (0 or 1)
+ * @param       string      Short string, NUL-terminated
+ */
+typedef union
+{
+    void *              pointer;
+    int64_t             integer;
+    uint64_t            uinteger;
+    double              real;
+    int                 boolean;
+    char                string[JSMNTREE_INLINE_MAX + 1];
+}
+jsmntree_value;
+
+/**
+ * The string of a value of type JSMNTREE_STRING, `length' bytes long:
+ * inline if it is short enough, pointed to otherwise.
+ */
+#define JSMNTREE_VALUE_STRING(value, length) \
+    ((length) <= JSMNTREE_INLINE_MAX ? (char *)(value)->string : (char *)(value)->pointer)
+
 enum jsmntree_error
 {
     /* Invalid token */
     JSMNTREE_ERROR_INVTOK   = -4,
+    /* A file cannot be opened or mapped */
+    JSMNTREE_ERROR_IO       = -5,
+    /* Nested too deep */
+    JSMNTREE_ERROR_DEPTH    = -6,
 };
 
 /**
  * A name/value pair.
+ *
+ * Strings are NUL-terminated UTF-8 copies with their escapes decoded
+ * (see jsmntree_string_unescape()), so they may hold NULs. If the library
+ * is built with JSMNTREE_ZERO_COPY, `name' and string values without
+ * escapes point into the JSON string the tree is made from instead, are
+ * not NUL-terminated, and must not outlive it; short string values are
+ * inline all the same. Use the lengths in both cases. What is not valid
+ * in a string is replaced by U+FFFD (see
+ * jsmntree_string_unescape_lossy()).
  * @param       name        Name (string)
  * @param       value       Value
+ * @param       name_length Length of `name'
+ * @param       value_length    Length of `value' if it is a string
  * @param       value_type  Type of `value' (object, array, string etc.)
  */
 typedef struct
 {
     char *              name;
-    void *              value;
+    jsmntree_value      value;
+    size_t              name_length;
+    uint32_t            value_length;
     jsmntreetype_t      value_type;
 }
 jsmntree_member;
 
 /**
  * A value, which can be a string, or a number, or boolean, or null, or
- * an object or an array.
+ * an object or an array. Strings are as in jsmntree_member. To pass a
+ * string to the functions which change a tree, set it with
+ * jsmntree_element_set_string().
  * @param       value       Value
+ * @param       value_length    Length of `value' if it is a string
  * @param       value_type  Type of `value' (object, array, string etc.)
  */
 typedef struct
 {
-    void *              value;
+    jsmntree_value      value;
+    uint32_t            value_length;
     jsmntreetype_t      value_type;
 }
 jsmntree_element;
 
+/**
+ * Objects with more members than this get a hash index of their members
+ * when a tree is made; smaller objects are scanned linearly.
+ */
+#ifndef JSMNTREE_INDEX_THRESHOLD
+#define JSMNTREE_INDEX_THRESHOLD    16
+#endif /* ! JSMNTREE_INDEX_THRESHOLD */
+
+/* Hash index of the members of an object, by name. Opaque. */
+typedef struct jsmntree_index jsmntree_index;
+
+/* Tree a container belongs to. Opaque. */
+struct jsmntree_tree;
+
 /**
  * An object, which is an unordered set of name/value pairs.
+ *
+ * An object of a tree made with JSMNTREE_FLAG_LAZY may be unexpanded:
+ * `token' is set, and `members' is empty until jsmntree_object_expand().
+ * The accessors and the serializer expand objects as they go. Members
+ * are stored in `members' by value, so a pointer to one is only valid
+ * until the object is changed.
  * @param       size        Size of array `members'
  * @param       capacity    Allocated memory size of array `members'
  * @param       members     Array of name/value pair
+ * @param       index       Hash index of `members', or NULL
+ * @param       token       Token of an unexpanded object, or NULL
+ * @param       tree        Tree the object belongs to
  */
 typedef struct
 {
-    size_t              size;
-    size_t              capacity;
-    jsmntree_member **  members;
+    size_t                  size;
+    size_t                  capacity;
+    jsmntree_member *       members;
+    jsmntree_index *        index;
+    const jsmntok_t *       token;
+    struct jsmntree_tree *  tree;
 }
 jsmntree_object;
 
 /**
- * An array, which is an ordered collection of values.
+ * An array, which is an ordered collection of values. It may be
+ * unexpanded like an object; see jsmntree_array_expand(). Elements are
+ * stored by value as members are.
  * @param       size        Size of array `elements'
  * @param       capacity    Allocated memory size of array `elements'
  * @param       elements    Array of value
+ * @param       token       Token of an unexpanded array, or NULL
+ * @param       tree        Tree the array belongs to
  */
 typedef struct
 {
-    size_t              size;
-    size_t              capacity;
-    jsmntree_element ** elements;
+    size_t                  size;
+    size_t                  capacity;
+    jsmntree_element *      elements;
+    const jsmntok_t *       token;
+    struct jsmntree_tree *  tree;
 }
 jsmntree_array;
 
+/**
+ * A region of memory which the nodes of a JSON tree are carved from.
+ * Allocation is a pointer bump, and the whole region is released at
+ * once. Opaque; see jsmntree_arena_create().
+ */
+typedef struct jsmntree_arena jsmntree_arena;
+
+/**
+ * A table of interned strings: equal strings interned in the same table
+ * are the same immutable string. Not thread-safe. Opaque; see
+ * jsmntree_intern_create().
+ */
+typedef struct jsmntree_intern jsmntree_intern;
+
+/**
+ * A set of key paths, e.g. "/user/id" and "/items/price", selecting the
+ * members a tree is built with. Each path is a JSON Pointer of member
+ * names (with "~1" for '/' and "~0" for '~'), where "*" stands for any
+ * name that is not given explicitly at the same level. Arrays are
+ * transparent: a path applies to the objects in an array as to the
+ * array itself. A member on a path is built with its whole value if the
+ * path ends there; other members are skipped with their whole subtree.
+ * Opaque; see jsmntree_projection_create().
+ */
+typedef struct jsmntree_projection jsmntree_projection;
+
+/**
+ * A context trees are made in one after the other, e.g. for a stream of
+ * messages of much the same shape. Everything a tree is made with is
+ * kept from one tree to the next: the arena its nodes, member and element
+ * arrays, strings and indexes are carved from, the tokens, the pending
+ * members and elements of the fused parser, and the interning table. Once
+ * these are grown to fit the largest tree, making another allocates no
+ * memory. Not thread-safe: a thread should have a context of its own.
+ * Opaque; see jsmntree_context_create().
+ */
+typedef struct jsmntree_context jsmntree_context;
+
+/**
+ * An allocator for the nodes, strings and indexes of a tree made without
+ * JSMNTREE_FLAG_ARENA. Arenas and interning tables get their blocks from
+ * malloc() in any case.
+ * @param       malloc      Allocate `size' bytes; NULL if out of memory
+ * @param       free        Release memory from `malloc'
+ * @param       context     Passed to `malloc' and `free'
+ */
+typedef struct
+{
+    void *              (*malloc)(void * context, size_t size);
+    void                (*free)(void * context, void * ptr);
+    void *              context;
+}
+jsmntree_allocator;
+
+/**
+ * Statistics of a tree. The allocations, invalid strings and timings are
+ * recorded as the tree is made, serialized and freed, if the tree is made
+ * with `stats' in jsmntree_options, and are added up over every tree made
+ * with the same `stats'. The rest is filled by jsmntree_stats_collect().
+ * @param       counts      Number of nodes by jsmntreetype_t: objects,
+ *                          arrays, members, elements, and values by type
+ * @param       string_bytes    Bytes of strings copied into the tree,
+ *                          NULs included; interned names and inline
+ *                          strings are left out
+ * @param       pointer_bytes   Bytes of hash indexes
+ * @param       node_bytes  Bytes of objects, arrays, and member and
+ *                          element arrays, unused capacity included
+ * @param       scalar_bytes    Bytes of numbers, booleans, nulls and short
+ *                          strings, which are stored inline in members
+ *                          and elements
+ * @param       max_depth   Deepest nesting of objects and arrays; the root
+ *                          object is at depth 1
+ * @param       allocations Allocations made for the tree, from the heap or
+ *                          from its arena
+ * @param       allocated_bytes Bytes of `allocations'
+ * @param       invalid_strings Strings with a malformed escape or which
+ *                          are not UTF-8, decoded with replacements
+ * @param       build_seconds   Time taken to make the trees
+ * @param       print_seconds   Time taken to serialize them
+ * @param       free_seconds    Time taken to free them
+ */
+typedef struct
+{
+    size_t              counts[JSMNTREE_REAL + 1];
+    size_t              string_bytes;
+    size_t              pointer_bytes;
+    size_t              node_bytes;
+    size_t              scalar_bytes;
+    size_t              max_depth;
+    size_t              allocations;
+    size_t              allocated_bytes;
+    size_t              invalid_strings;
+    double              build_seconds;
+    double              print_seconds;
+    double              free_seconds;
+}
+jsmntree_stats;
+
+/**
+ * Flags for jsmntree_options.
+ *      o JSMNTREE_FLAG_ARENA   Build the tree in an arena. If `arena' is
+ *                              NULL, the tree gets its own arena sized
+ *                              from `len' and `num_tokens', and it is
+ *                              released by jsmntree_free_tree().
+ *      o JSMNTREE_FLAG_INTERN  Intern member names. If `intern' is NULL,
+ *                              the tree gets its own table, which is
+ *                              released by jsmntree_free_tree().
+ *      o JSMNTREE_FLAG_LAZY    Build nested objects and arrays only when
+ *                              they are first accessed. The JSON string
+ *                              and the tokens must outlive the tree, and
+ *                              expanding is not thread-safe.
+ *      o JSMNTREE_FLAG_HUGEPAGE    Hint the kernel to back a file mapped
+ *                              by jsmntree_make_tree_from_file() with
+ *                              huge pages.
+ *      o JSMNTREE_FLAG_FUSED   Make the tree of jsmntree_parse_buffer()
+ *                              and jsmntree_make_tree_from_file() in a
+ *                              single pass over the JSON string, without
+ *                              tokens. Lazy trees, projections and more
+ *                              than one thread need tokens, so they are
+ *                              made in two passes anyway.
+ */
+enum jsmntree_flag
+{
+    JSMNTREE_FLAG_ARENA     = 1 << 0,
+    JSMNTREE_FLAG_INTERN    = 1 << 1,
+    JSMNTREE_FLAG_LAZY      = 1 << 2,
+    JSMNTREE_FLAG_HUGEPAGE  = 1 << 3,
+    JSMNTREE_FLAG_FUSED     = 1 << 4,
+};
+
+/**
+ * Options for jsmntree_make_tree_ex(). Initialise with
+ * jsmntree_options_init() before setting any field.
+ * @param       flags       Bitwise OR of enum jsmntree_flag
+ * @param       arena       Arena owned by the caller, or NULL
+ * @param       intern      Interning table owned by the caller, or NULL.
+ *                          It must outlive the trees made with it, and
+ *                          can be shared by any number of them.
+ * @param       num_threads Threads to build a tree of at least
+ *                          JSMNTREE_PARALLEL_THRESHOLD tokens with, the
+ *                          calling thread included; 0 or 1 for the
+ *                          calling thread alone. Lazy trees, and trees
+ *                          which intern names, are always built by the
+ *                          calling thread alone. The other threads of
+ *                          an arena tree allocate from arenas of their
+ *                          own, so jsmntree_free_tree() must be called
+ *                          even if `arena' is the caller's.
+ * @param       projection  Members to build, or NULL for all. It needs
+ *                          to outlive the making of a tree only. With a
+ *                          projection, JSMNTREE_FLAG_LAZY is ignored and
+ *                          `num_threads' is 1.
+ * @param       allocator   Allocator of the tree; malloc() and free()
+ *                          unless both of its functions are set
+ * @param       stats       Statistics to record allocations and timings
+ *                          of the tree in, or NULL. They must outlive the
+ *                          tree, and may be shared by several trees.
+ */
+typedef struct
+{
+    unsigned int        flags;
+    jsmntree_arena *    arena;
+    jsmntree_intern *   intern;
+    unsigned int        num_threads;
+    const jsmntree_projection * projection;
+    jsmntree_allocator  allocator;
+    jsmntree_stats *    stats;
+}
+jsmntree_options;
+
+/**
+ * Trees with fewer tokens than this are built by the calling thread
+ * alone, whatever `num_threads' is.
+ */
+#ifndef JSMNTREE_PARALLEL_THRESHOLD
+#define JSMNTREE_PARALLEL_THRESHOLD 65536
+#endif /* ! JSMNTREE_PARALLEL_THRESHOLD */
+
+/**
+ * Deepest nesting of a tree made with JSMNTREE_FLAG_FUSED. The stack of
+ * open containers lives on the C stack.
+ */
+#ifndef JSMNTREE_FUSED_MAX_DEPTH
+#define JSMNTREE_FUSED_MAX_DEPTH    1024
+#endif /* ! JSMNTREE_FUSED_MAX_DEPTH */
+
 /**
  * Make a JSON tree.
+ * @return      Tree, or NULL if the first token is not an object, if the
+ *              tokens do not nest as those of JSON do (e.g. a name without
+ *              a value, or more items than a container's token counts),
+ *              or if out of memory; nothing is left allocated then
  */
 jsmntree_object *
 jsmntree_make_tree(const char * js, const size_t len,
                     const jsmntok_t * tokens, const unsigned int num_tokens);
 
 /**
- * Free the memory space of JSON tree.
+ * Make a JSON tree with options. If `options' is NULL, this is the same
+ * as jsmntree_make_tree().
+ */
+jsmntree_object *
+jsmntree_make_tree_ex(const char * js, const size_t len,
+                    const jsmntok_t * tokens, const unsigned int num_tokens,
+                    const jsmntree_options * options);
+
+/**
+ * Parse a JSON string into a token array which grows as needed. The
+ * array may be empty (NULL and 0) or reused from an earlier call; it is
+ * reallocated geometrically, and `tokens' and `capacity' are updated.
+ * Release it with free(). What jsmn takes but JSON does not, e.g. items
+ * without a ',' between them or content after the root, is refused.
+ * @return      Number of tokens, or JSMN_ERROR_INVAL or JSMN_ERROR_PART
+ *              on malformed JSON, or JSMN_ERROR_NOMEM
+ */
+int jsmntree_parse_tokens(const char * js, const size_t len,
+                            jsmntok_t ** tokens, unsigned int * capacity);
+
+/**
+ * Parse a JSON string of any size and make a tree of it with `options',
+ * which may be NULL. The tokens are released once the tree is made, or
+ * with the tree if it is lazy.
+ * @param       tree        Set to the tree made, or NULL on error
+ * @return      0 on success, JSMN_ERROR_INVAL or JSMN_ERROR_PART on
+ *              malformed JSON, JSMNTREE_ERROR_INVTOK if the root is not
+ *              an object, JSMNTREE_ERROR_DEPTH if nested deeper than
+ *              JSMNTREE_FUSED_MAX_DEPTH with JSMNTREE_FLAG_FUSED, or
+ *              JSMN_ERROR_NOMEM
+ */
+int jsmntree_parse_buffer(const char * js, const size_t len,
+                            const jsmntree_options * options, jsmntree_object ** tree);
+
+/**
+ * Map a file read-only, with a hint of sequential access (and of huge
+ * pages with JSMNTREE_FLAG_HUGEPAGE in `options', which may be NULL).
+ * Release it with jsmntree_unmap_file().
+ * @param       size        Set to the size of the file
+ * @return      Contents of the file, or NULL if it cannot be opened or
+ *              mapped
+ */
+const char *
+jsmntree_map_file(const char * path, const jsmntree_options * options, size_t * size);
+
+/**
+ * Release a file mapped with jsmntree_map_file().
+ */
+void jsmntree_unmap_file(const char * data, const size_t size);
+
+/**
+ * Map a JSON file read-only and make a tree of it, as with
+ * jsmntree_parse_buffer(). The file is parsed straight from the page
+ * cache without being copied. If the tree refers to the file (it is
+ * lazy, or the library is built with JSMNTREE_ZERO_COPY), the mapping is
+ * released with the tree; otherwise once the tree is made.
+ * @param       tree        Set to the tree made, or NULL on error
+ * @return      0 on success, JSMNTREE_ERROR_IO if the file cannot be
+ *              opened or mapped, or an error of jsmntree_parse_buffer()
+ */
+int jsmntree_make_tree_from_file(const char * path, const jsmntree_options * options,
+                                    jsmntree_object ** tree);
+
+/**
+ * Build the members of an unexpanded object. Does nothing if the object
+ * is already expanded.
+ * @return      0 on success, -1 if out of memory or if its tokens do not
+ *              nest as those of JSON do; what is built so far is kept
+ */
+int jsmntree_object_expand(jsmntree_object * object);
+
+/**
+ * Build the elements of an unexpanded array. Does nothing if the array
+ * is already expanded.
+ * @return      0 on success, -1 if out of memory or if its tokens do not
+ *              nest as those of JSON do; what is built so far is kept
+ */
+int jsmntree_array_expand(jsmntree_array * array);
+
+/**
+ * Free the memory space of JSON tree. A tree built in an arena owned by
+ * the caller is left to jsmntree_arena_reset() or
+ * jsmntree_arena_destroy().
  */
 void jsmntree_free_tree(jsmntree_object * jsmntree);
 
+/**
+ * Decode a JSMN_PRIMITIVE token into `value' without allocating. true,
+ * false and null are told apart by their first byte; numbers are read
+ * straight from `js'.
+ * @return      Type of the value; JSMNTREE_UNDEFINED if it is invalid
+ */
+jsmntreetype_t
+jsmntree_decode_primitive(const char * js, const jsmntok_t * token, jsmntree_value * value);
+
+/**
+ * Find the member named `key' in an object. Uses the hash index of the
+ * object if it has one. Returns NULL if there is no such member.
+ */
+jsmntree_member *
+jsmntree_object_get(jsmntree_object * object, const char * key, const size_t keylen);
+
+/**
+ * Find the member named `key' in an object, where `key' is a string
+ * interned in the table the tree was made with. Names are compared by
+ * pointer only. Returns NULL if there is no such member.
+ */
+jsmntree_member *
+jsmntree_object_get_interned(jsmntree_object * object, const char * key, const size_t keylen);
+
+/**
+ * Find a value by its path from an object, e.g. "/servlet/0/init-param".
+ * Each segment following a '/' is a member name for an object, or a
+ * decimal index for an array, as in a JSON Pointer without escapes. An
+ * empty path is the object itself.
+ * @param       result      Filled with the value found; may be NULL
+ * @return      0 if found, -1 otherwise
+ */
+int
+jsmntree_get_path(jsmntree_object * object, const char * path, jsmntree_element * result);
+
+/**
+ * Set the value of the first member named `name' in an object, or add
+ * the member at the end if there is none. The value is copied into the
+ * tree as described below, and the old one is released.
+ *
+ * Values given to this and the following functions are copied so: a string
+ * is copied as it is (decoded, not escaped), an object or an array is
+ * made empty, to be filled through the member or element returned,
+ * and other values are copied as they are. The member or element
+ * returned is valid until its object or array is changed again. Member
+ * and element arrays grow geometrically, so that adding is amortized
+ * O(1). Nodes of an arena tree that are replaced or removed stay in the
+ * arena until it is released. None of these functions are thread-safe.
+ * @return      The member, or NULL if out of memory
+ */
+jsmntree_member *
+jsmntree_object_set(jsmntree_object * object, const char * name, const size_t name_length,
+                    const jsmntree_element * value);
+
+/**
+ * Add a member at `position' of an object, before the member there,
+ * whether or not a member of that name exists. Adding at the end is
+ * O(1) amortized; elsewhere the later members are moved up.
+ * @return      The member, or NULL if `position' is past the end or if
+ *              out of memory
+ */
+jsmntree_member *
+jsmntree_object_insert(jsmntree_object * object, const size_t position,
+                        const char * name, const size_t name_length, const jsmntree_element * value);
+
+/**
+ * Remove the first member named `name' from an object, and release it.
+ * The last member takes its place, so this is O(1), and the hash index
+ * of the object is kept up to date.
+ * @return      0 on success, -1 if there is no such member
+ */
+int jsmntree_object_remove(jsmntree_object * object, const char * name, const size_t name_length);
+
+/**
+ * Append an element to an array.
+ * @return      The element, or NULL if out of memory
+ */
+jsmntree_element *
+jsmntree_array_append(jsmntree_array * array, const jsmntree_element * value);
+
+/**
+ * Insert an element at `position' of an array, before the element there.
+ * @return      The element, or NULL if `position' is past the end or if
+ *              out of memory
+ */
+jsmntree_element *
+jsmntree_array_insert(jsmntree_array * array, const size_t position, const jsmntree_element * value);
+
+/**
+ * Replace the value of the element at `position' of an array, and
+ * release the old one.
+ * @return      The element, or NULL if `position' is past the end or if
+ *              out of memory
+ */
+jsmntree_element *
+jsmntree_array_set(jsmntree_array * array, const size_t position, const jsmntree_element * value);
+
+/**
+ * Remove the element at `position' of an array, and release it. The
+ * elements after it move down, so they keep their order.
+ * @return      0 on success, -1 if `position' is past the end
+ */
+int jsmntree_array_remove(jsmntree_array * array, const size_t position);
+
+/**
+ * Make an element a string value, e.g. to pass to jsmntree_object_set().
+ * A string of at most JSMNTREE_INLINE_MAX bytes is copied inline; a
+ * longer one is pointed to, and must outlive the element. `length' must
+ * fit in 32 bits.
+ */
+void jsmntree_element_set_string(jsmntree_element * element, const char * string, const size_t length);
+
+/**
+ * Make a NUL-terminated copy of a string in a tree, e.g. a view made with
+ * JSMNTREE_ZERO_COPY. Release it with free().
+ */
+char * jsmntree_string_dup(const char * string, const size_t length);
+
+/**
+ * Decode the escapes of the contents of a JSON string (what is between
+ * its quotes) into `dst', which has room for `length' bytes: a decoded
+ * string is never longer, so `dst' may be `string' itself. "\uXXXX"
+ * escapes become UTF-8, surrogate pairs included, and the rest is checked
+ * to be UTF-8 as it is copied. `dst' is not NUL-terminated.
+ * @return      Length of the decoded string, or (size_t)-1 if an escape is
+ *              malformed or the string is not UTF-8
+ */
+size_t jsmntree_string_unescape(const char * string, const size_t length, char * dst);
+
+/* Room needed to decode a string `length' bytes long, replacements included */
+#define JSMNTREE_UNESCAPED_MAX(length)  ((length) * 3)
+
+/**
+ * Decode the escapes of the contents of a JSON string as
+ * jsmntree_string_unescape(), but replace what is not valid by U+FFFD
+ * instead of failing: each byte which is not part of a UTF-8 character,
+ * the backslash of a malformed escape, and a "\uXXXX" escape of a lone
+ * surrogate. `dst' has room for JSMNTREE_UNESCAPED_MAX(length) bytes, and
+ * is not `string'.
+ * @return      Length of the decoded string
+ */
+size_t jsmntree_string_unescape_lossy(const char * string, const size_t length, char * dst);
+
+/**
+ * Check that a string is UTF-8, without decoding escapes.
+ * @return      0 if it is, -1 otherwise
+ */
+int jsmntree_string_validate(const char * string, const size_t length);
+
+/* Room needed to escape a string `length' bytes long */
+#define JSMNTREE_ESCAPED_MAX(length)    ((length) * 6)
+
+/**
+ * Escape a string as the contents of a JSON string into `dst', which has
+ * room for JSMNTREE_ESCAPED_MAX(length) bytes: '"', '\\' and control
+ * characters are escaped, and the rest is copied as it is. `dst' is not
+ * NUL-terminated.
+ * @return      Length of the escaped string
+ */
+size_t jsmntree_string_escape(const char * string, const size_t length, char * dst);
+
+/**
+ * Set all options to their defaults (malloc, no flags).
+ */
+void jsmntree_options_init(jsmntree_options * options);
+
+/**
+ * Set all statistics to 0.
+ */
+void jsmntree_stats_init(jsmntree_stats * stats);
+
+/**
+ * Statistics a tree records its allocations and timings in, i.e. `stats'
+ * of the options it was made with. `object' may be any object of it.
+ */
+jsmntree_stats * jsmntree_get_stats(jsmntree_object * object);
+
+/**
+ * Count the nodes of a tree or a subtree, and the bytes they use, into
+ * `stats'; the allocations and timings are left as they are. Lazy
+ * containers which are not expanded yet are counted, but not walked.
+ */
+void jsmntree_stats_collect(jsmntree_object * object, jsmntree_stats * stats);
+
+/**
+ * Compile key paths into a projection. An empty path selects everything.
+ * @return      Projection, or NULL if a path is neither empty nor starts
+ *              with '/', or if out of memory
+ */
+jsmntree_projection *
+jsmntree_projection_create(const char * const * paths, const size_t num_paths);
+
+/**
+ * Release a projection.
+ */
+void jsmntree_projection_free(jsmntree_projection * projection);
+
+/**
+ * Create an arena. `capacity' is the size of the first block; the arena
+ * grows by chaining blocks when it runs out.
+ */
+jsmntree_arena * jsmntree_arena_create(const size_t capacity);
+
+/**
+ * Upper bound of the bytes needed to build a tree from `num_tokens'
+ * tokens of a `len' bytes long JSON string, so that a single block is
+ * enough. Strings which are not valid and get replacement characters may
+ * take more, and the arena then grows.
+ */
+size_t jsmntree_arena_capacity(const size_t len, const unsigned int num_tokens);
+
+/**
+ * Allocate `size' bytes from the arena. Returns NULL if out of memory.
+ */
+void * jsmntree_arena_alloc(jsmntree_arena * arena, const size_t size);
+
+/**
+ * Release every allocation at once but keep the memory for reuse. If the
+ * arena had to grow, its blocks are merged into one big enough for the
+ * next tree of the same size, or kept as they are if there is not enough
+ * memory for it.
+ */
+void jsmntree_arena_reset(jsmntree_arena * arena);
+
+/**
+ * Release the arena and every allocation made from it.
+ */
+void jsmntree_arena_destroy(jsmntree_arena * arena);
+
+/**
+ * Create a context to make trees with `options', which may be NULL. The
+ * trees are made with JSMNTREE_FLAG_ARENA in an arena of the context,
+ * and by the calling thread alone; `options.arena' and
+ * `options.num_threads' are not used. With JSMNTREE_FLAG_INTERN and no
+ * `options.intern', the context has an interning table of its own, which
+ * keeps the names of every tree made in it. A projection or statistics
+ * in `options' must outlive the context.
+ * @return      Context, or NULL if out of memory
+ */
+jsmntree_context * jsmntree_context_create(const jsmntree_options * options);
+
+/**
+ * Parse a JSON string and make a tree of it in a context, as with
+ * jsmntree_parse_buffer(). The tree made before is released first, as
+ * with jsmntree_reset(). The tree is valid until the context is reset
+ * or destroyed, and must not be released with jsmntree_free_tree().
+ * With JSMNTREE_FLAG_LAZY, or with JSMNTREE_ZERO_COPY, `js' must outlive
+ * the tree.
+ * @param       tree        Set to the tree made, or NULL on error
+ * @return      0 on success, or an error of jsmntree_parse_buffer()
+ */
+int jsmntree_context_parse(jsmntree_context * context, const char * js, const size_t len,
+                            jsmntree_object ** tree);
+
+/**
+ * Release the tree of a context, if any, but keep its memory for the next
+ * tree. If the arena had to grow, it becomes a single block big enough
+ * for a tree of the same size.
+ */
+void jsmntree_reset(jsmntree_context * context);
+
+/**
+ * Release a context, its tree and all its memory.
+ */
+void jsmntree_context_destroy(jsmntree_context * context);
+
+/**
+ * Create an empty interning table.
+ */
+jsmntree_intern * jsmntree_intern_create(void);
+
+/**
+ * Intern a string. Returns the NUL-terminated string in the table equal
+ * to `string', adding a copy if there is none; NULL if out of memory.
+ */
+const char *
+jsmntree_intern_string(jsmntree_intern * intern, const char * string, const size_t length);
+
+/**
+ * Find the string in the table equal to `string', or NULL if it has not
+ * been interned.
+ */
+const char *
+jsmntree_intern_find(const jsmntree_intern * intern, const char * string, const size_t length);
+
+/**
+ * Release an interning table and all its strings.
+ */
+void jsmntree_intern_destroy(jsmntree_intern * intern);
+
+/**
+ * Layout of serialized JSON.
+ *      o JSMNTREE_FORMAT_MINIFIED  No whitespace at all
+ *      o JSMNTREE_FORMAT_SPACED    A space inside brackets and braces,
+ *                                  and after ':' and ',', on one line
+ *      o JSMNTREE_FORMAT_PRETTY    A member or element per line, indented
+ */
+typedef enum
+{
+    JSMNTREE_FORMAT_MINIFIED    = 0,
+    JSMNTREE_FORMAT_SPACED      = 1,
+    JSMNTREE_FORMAT_PRETTY      = 2,
+}
+jsmntree_format_style;
+
+/**
+ * Format of serialized JSON.
+ * @param       style       Layout
+ * @param       indent      Spaces per level of JSMNTREE_FORMAT_PRETTY
+ */
+typedef struct
+{
+    jsmntree_format_style   style;
+    unsigned int            indent;
+}
+jsmntree_format;
+
+/**
+ * A growable buffer serialized JSON is appended to. Initialise all fields
+ * to 0, and release with jsmntree_buffer_free().
+ * @param       data        Bytes; not NUL-terminated
+ * @param       size        Number of bytes in `data'
+ * @param       capacity    Allocated memory size of `data'
+ */
+typedef struct
+{
+    char *              data;
+    size_t              size;
+    size_t              capacity;
+}
+jsmntree_buffer;
+
+/**
+ * A sink of serialized JSON. Called with large chunks; returns 0 on
+ * success, or anything else to stop serializing.
+ */
+typedef int (*jsmntree_write_fn)(void * context, const char * data, const size_t length);
+
+/**
+ * Serialize a tree to a sink. `format' may be NULL for minified JSON.
+ * @return      0 on success, -1 if out of memory or the sink failed
+ */
+int jsmntree_serialize(jsmntree_object * object, const jsmntree_format * format,
+                        jsmntree_write_fn write, void * context);
+
+/**
+ * Serialize a tree to the end of a buffer.
+ * @return      0 on success, -1 if out of memory
+ */
+int jsmntree_serialize_buffer(jsmntree_object * object, const jsmntree_format * format,
+                                jsmntree_buffer * buffer);
+
+/**
+ * Serialize a value of any type, e.g. a scalar, to the end of a buffer.
+ * @return      0 on success, -1 if out of memory
+ */
+int jsmntree_serialize_value(const jsmntree_element * element, const jsmntree_format * format,
+                                jsmntree_buffer * buffer);
+
+/**
+ * Serialize a tree followed by a newline, and write it to a stream with
+ * a single fwrite().
+ * @return      0 on success, -1 on error
+ */
+int jsmntree_fwrite_tree(FILE * stream, jsmntree_object * object, const jsmntree_format * format);
+
+/**
+ * Append bytes to the end of a buffer.
+ * @return      0 on success, -1 if out of memory
+ */
+int jsmntree_buffer_append(jsmntree_buffer * buffer, const char * data, const size_t length);
+
+/**
+ * Release the memory of a buffer and make it empty.
+ */
+void jsmntree_buffer_free(jsmntree_buffer * buffer);
+
+/**
+ * Print a tree in JSMNTREE_FORMAT_SPACED followed by a newline.
+ */
 void jsmntree_fprint_tree(FILE * stream, jsmntree_object * object);
 
 #ifdef __cplusplus
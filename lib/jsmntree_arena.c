@@ -0,0 +1,168 @@
+#include <stdlib.h>
+
+#include "jsmntree.h"
+
+/* Every allocation is aligned to this */
+#define JSMNTREE_ARENA_ALIGN    (sizeof(double) > sizeof(void *) ? sizeof(double) : sizeof(void *))
+
+#define JSMNTREE_ARENA_ROUND(n) \
+    (((n) + JSMNTREE_ARENA_ALIGN - 1) & ~(JSMNTREE_ARENA_ALIGN - 1))
+
+/**
+ * A block of an arena.
+ * @param       next        Previous block (blocks are chained newest first)
+ * @param       size        Usable bytes in `data'
+ * @param       used        Bytes handed out from `data'
+ */
+typedef struct jsmntree_arena_block
+{
+    struct jsmntree_arena_block *   next;
+    size_t                          size;
+    size_t                          used;
+}
+jsmntree_arena_block;
+
+struct jsmntree_arena
+{
+    jsmntree_arena_block *  head;
+};
+
+#define JSMNTREE_ARENA_DATA(block) \
+    ((char *)(block) + JSMNTREE_ARENA_ROUND(sizeof(jsmntree_arena_block)))
+
+static jsmntree_arena_block *
+jsmntree_arena_block_create(const size_t size)
+{
+    jsmntree_arena_block * block =
+        malloc(JSMNTREE_ARENA_ROUND(sizeof(jsmntree_arena_block)) + size);
+
+    if(block == NULL)
+        return NULL;
+
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+
+    return block;
+}
+
+jsmntree_arena *
+jsmntree_arena_create(const size_t capacity)
+{
+    jsmntree_arena * arena = malloc(sizeof(jsmntree_arena));
+
+    if(arena == NULL)
+        return NULL;
+
+    arena->head = jsmntree_arena_block_create(JSMNTREE_ARENA_ROUND(capacity));
+    if(arena->head == NULL)
+    {
+        free(arena);
+        return NULL;
+    }
+
+    return arena;
+}
+
+size_t
+jsmntree_arena_capacity(const size_t len, const unsigned int num_tokens)
+{
+    /*
+     * Members and elements are stored by value in their parent's array,
+     * so each token costs at most one member. A container also costs its
+     * object (or array), the rounding of its array of items, and if it is
+     * an indexed object the header of its index and up to four 8-byte
+     * slots per member. Scalars and short strings are inline in their
+     * value; other strings and names cost their bytes, which add up to at
+     * most `len', plus a NUL and rounding. The tree itself comes once.
+     */
+    size_t per_token    = sizeof(jsmntree_member)
+                        + JSMNTREE_ARENA_ROUND(sizeof(jsmntree_object))
+                        + sizeof(uint64_t) * 4
+                        + JSMNTREE_ARENA_ALIGN * 3;
+
+    return (size_t)num_tokens * per_token + len + JSMNTREE_ARENA_ALIGN * 64;
+}
+
+void *
+jsmntree_arena_alloc(jsmntree_arena * arena, const size_t size)
+{
+    jsmntree_arena_block *  block   = arena->head;
+    size_t                  rsize   = JSMNTREE_ARENA_ROUND(size);
+
+    if(block->size - block->used < rsize)
+    {
+        size_t new_size = block->size * 2;
+        if(new_size < rsize)
+            new_size = rsize;
+
+        block = jsmntree_arena_block_create(new_size);
+        if(block == NULL)
+            return NULL;
+
+        block->next = arena->head;
+        arena->head = block;
+    }
+
+    void * ret = JSMNTREE_ARENA_DATA(block) + block->used;
+    block->used += rsize;
+
+    return ret;
+}
+
+void
+jsmntree_arena_reset(jsmntree_arena * arena)
+{
+    if(arena == NULL)
+        return;
+
+    if(arena->head->next != NULL)
+    {
+        /* Merge the chain into one block, if there is memory for it */
+        size_t                  total   = 0;
+        jsmntree_arena_block *  block;
+        jsmntree_arena_block *  merged;
+
+        for(block = arena->head; block != NULL; block = block->next)
+            total += block->size;
+
+        merged = jsmntree_arena_block_create(total);
+        if(merged != NULL)
+        {
+            block = arena->head;
+            while(block != NULL)
+            {
+                jsmntree_arena_block * next = block->next;
+                free(block);
+                block = next;
+            }
+
+            arena->head = merged;
+        }
+        /* Otherwise the chain is kept, and allocated from its newest block */
+    }
+
+    arena->head->used = 0;
+}
+
+void
+jsmntree_arena_destroy(jsmntree_arena * arena)
+{
+    if(arena == NULL)
+        return;
+
+    jsmntree_arena_block * block = arena->head;
+
+    while(block != NULL)
+    {
+        jsmntree_arena_block * next = block->next;
+        free(block);
+        block = next;
+    }
+
+    free(arena);
+}
+
+#undef JSMNTREE_ARENA_DATA
+#undef JSMNTREE_ARENA_ROUND
+#undef JSMNTREE_ARENA_ALIGN
@@ -0,0 +1,348 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "jsmntree_batch.h"
+#include "jsmn/jsmn.h"
+
+/* Bytes of documents per task */
+#define JSMNTREE_BATCH_CHUNK    (1024 * 1024)
+
+/* Tasks a worker may run ahead of the output, per worker */
+#define JSMNTREE_BATCH_WINDOW   4
+
+/**
+ * A run of whole lines, processed by one worker.
+ * @param       begin       First byte
+ * @param       length      Number of bytes
+ * @param       output      Output of the documents
+ * @param       done        Whether the task is processed
+ * @param       status      Result of the task; 0 on success
+ */
+typedef struct
+{
+    const char *        begin;
+    size_t              length;
+    jsmntree_buffer     output;
+    int                 done;
+    int                 status;
+}
+jsmntree_batch_task;
+
+/**
+ * State shared by the workers and the writer. Fields below `lock' are
+ * guarded by it.
+ * @param       options     Options documents are made with
+ * @param       process     Called with each document
+ * @param       context     Context of `process'
+ * @param       tasks       Tasks, in input order
+ * @param       num_tasks   Number of `tasks'
+ * @param       window      Tasks which may be processed ahead of the output
+ * @param       next        Next task to take
+ * @param       written     Number of tasks written out
+ * @param       stop        Nonzero once no more task should be taken
+ * @param       claimable   Signalled when `written' or `stop' changes
+ * @param       finished    Signalled when a task is done
+ */
+typedef struct
+{
+    jsmntree_options        options;
+    jsmntree_document_fn    process;
+    void *                  context;
+    jsmntree_batch_task *   tasks;
+    size_t                  num_tasks;
+    size_t                  window;
+
+    pthread_mutex_t         lock;
+    size_t                  next;
+    size_t                  written;
+    int                     stop;
+    pthread_cond_t          claimable;
+    pthread_cond_t          finished;
+}
+jsmntree_batch_state;
+
+/**
+ * A worker thread.
+ * @param       batch       Batch
+ * @param       trees       Context the documents are made in, which keeps
+ *                          their memory from document to document
+ */
+typedef struct
+{
+    jsmntree_batch_state *  batch;
+    jsmntree_context *      trees;
+}
+jsmntree_batch_worker;
+
+/* Split the input into tasks of whole lines */
+static int
+jsmntree_batch_split(jsmntree_batch_state * batch, const char * js, const size_t len)
+{
+    size_t  capacity    = len / JSMNTREE_BATCH_CHUNK + 1;
+    size_t  offset      = 0;
+
+    batch->tasks = calloc(capacity, sizeof(jsmntree_batch_task));
+    if(batch->tasks == NULL)
+        return JSMN_ERROR_NOMEM;
+
+    while(offset < len)
+    {
+        size_t          end     = offset + JSMNTREE_BATCH_CHUNK;
+        const char *    newline;
+
+        if(end >= len)
+            end = len;
+        else
+        {
+            newline = memchr(js + end, '\n', len - end);
+            end     = (newline != NULL) ? (size_t)(newline - js) + 1 : len;
+        }
+
+        /* Long lines make fewer tasks than guessed, never more */
+        batch->tasks[batch->num_tasks].begin    = js + offset;
+        batch->tasks[batch->num_tasks].length   = end - offset;
+        ++batch->num_tasks;
+
+        offset = end;
+    }
+
+    return 0;
+}
+
+/* Make the tree of a document and process it */
+static int
+jsmntree_batch_document(jsmntree_batch_worker * worker, jsmntree_batch_task * task,
+                        const char * js, const size_t len)
+{
+    jsmntree_object *   document;
+    int                 r       = jsmntree_context_parse(worker->trees, js, len, &document);
+
+    if(r != 0)
+        return r;
+
+    int stop = worker->batch->process(worker->batch->context, document, &task->output);
+
+    jsmntree_reset(worker->trees);
+
+    return (stop != 0) ? 1 : 0;
+}
+
+/* Process every non-blank line of a task */
+static int
+jsmntree_batch_run(jsmntree_batch_worker * worker, jsmntree_batch_task * task)
+{
+    const char *    p   = task->begin;
+    const char *    end = task->begin + task->length;
+
+    while(p < end)
+    {
+        const char *    line_end    = memchr(p, '\n', end - p);
+        const char *    next;
+        int             r;
+
+        if(line_end == NULL)
+            line_end = end;
+        next = line_end + 1;
+
+        /* Trim the line, including the '\r' of a CRLF */
+        while(p < line_end && (*p == ' ' || *p == '\t' || *p == '\r'))
+            ++p;
+        while(line_end > p && (line_end[-1] == ' ' || line_end[-1] == '\t' || line_end[-1] == '\r'))
+            --line_end;
+
+        if(p < line_end)
+        {
+            r = jsmntree_batch_document(worker, task, p, line_end - p);
+            if(r != 0)
+                return r;
+        }
+
+        p = next;
+    }
+
+    return 0;
+}
+
+static void *
+jsmntree_batch_worker_main(void * arg)
+{
+    jsmntree_batch_worker * worker  = arg;
+    jsmntree_batch_state *  batch   = worker->batch;
+
+    for(;;)
+    {
+        jsmntree_batch_task *   task;
+        int                     r;
+
+        pthread_mutex_lock(&batch->lock);
+        while(!batch->stop && batch->next < batch->num_tasks &&
+                batch->next >= batch->written + batch->window)
+            pthread_cond_wait(&batch->claimable, &batch->lock);
+
+        if(batch->stop || batch->next >= batch->num_tasks)
+        {
+            pthread_mutex_unlock(&batch->lock);
+            break;
+        }
+
+        task = &batch->tasks[batch->next++];
+        pthread_mutex_unlock(&batch->lock);
+
+        r = jsmntree_batch_run(worker, task);
+
+        pthread_mutex_lock(&batch->lock);
+        task->status    = r;
+        task->done      = 1;
+        /* Tasks before this one are all taken, so they still finish */
+        if(r != 0)
+        {
+            batch->stop = 1;
+            pthread_cond_broadcast(&batch->claimable);
+        }
+        pthread_cond_broadcast(&batch->finished);
+        pthread_mutex_unlock(&batch->lock);
+    }
+
+    return NULL;
+}
+
+static int
+jsmntree_batch_worker_init(jsmntree_batch_worker * worker, jsmntree_batch_state * batch)
+{
+    memset(worker, 0, sizeof(jsmntree_batch_worker));
+    worker->batch   = batch;
+    worker->trees   = jsmntree_context_create(&batch->options);
+
+    return (worker->trees != NULL) ? 0 : JSMN_ERROR_NOMEM;
+}
+
+static void
+jsmntree_batch_worker_destroy(jsmntree_batch_worker * worker)
+{
+    jsmntree_context_destroy(worker->trees);
+}
+
+int
+jsmntree_batch(const char * js, const size_t len, const jsmntree_options * options,
+                unsigned int num_threads,
+                jsmntree_document_fn process, void * process_context,
+                jsmntree_write_fn write, void * write_context)
+{
+    jsmntree_batch_state    batch;
+    jsmntree_batch_worker * workers;
+    pthread_t *             threads;
+    unsigned int            num_started = 0;
+    size_t                  i;
+    int                     ret         = 0;
+
+    memset(&batch, 0, sizeof(jsmntree_batch_state));
+    if(options != NULL)
+        batch.options = *options;
+    else
+        jsmntree_options_init(&batch.options);
+    batch.options.arena     = NULL;
+    batch.options.intern    = NULL;
+    /* Documents are built in parallel with each other instead */
+    batch.options.num_threads   = 0;
+    batch.process           = process;
+    batch.context           = process_context;
+
+    if(num_threads == 0)
+    {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        num_threads = (online > 0) ? (unsigned int)online : 1;
+    }
+    batch.window = (size_t)num_threads * JSMNTREE_BATCH_WINDOW;
+
+    ret = jsmntree_batch_split(&batch, js, len);
+    if(ret != 0)
+        return ret;
+
+    workers = calloc(num_threads, sizeof(jsmntree_batch_worker));
+    threads = calloc(num_threads, sizeof(pthread_t));
+    if(workers == NULL || threads == NULL)
+    {
+        free(workers);
+        free(threads);
+        free(batch.tasks);
+        return JSMN_ERROR_NOMEM;
+    }
+
+    pthread_mutex_init(&batch.lock, NULL);
+    pthread_cond_init(&batch.claimable, NULL);
+    pthread_cond_init(&batch.finished, NULL);
+
+    for(; num_started < num_threads; ++num_started)
+    {
+        ret = jsmntree_batch_worker_init(&workers[num_started], &batch);
+        if(ret == 0 && pthread_create(&threads[num_started], NULL,
+                                        jsmntree_batch_worker_main, &workers[num_started]) != 0)
+            ret = JSMN_ERROR_NOMEM;
+
+        if(ret != 0)
+        {
+            jsmntree_batch_worker_destroy(&workers[num_started]);
+            break;
+        }
+    }
+
+    /* Write the output of each task in order, as soon as it is done */
+    for(i = 0; ret == 0 && num_started > 0 && i < batch.num_tasks; ++i)
+    {
+        jsmntree_batch_task * task = &batch.tasks[i];
+
+        pthread_mutex_lock(&batch.lock);
+        while(!task->done)
+            pthread_cond_wait(&batch.finished, &batch.lock);
+        pthread_mutex_unlock(&batch.lock);
+
+        /* A stopped task has output up to where it stopped */
+        if(task->output.size > 0 &&
+                write(write_context, task->output.data, task->output.size) != 0)
+            ret = JSMNTREE_ERROR_IO;
+        else
+            ret = task->status;
+
+        jsmntree_buffer_free(&task->output);
+
+        pthread_mutex_lock(&batch.lock);
+        batch.written = i + 1;
+        if(ret != 0)
+            batch.stop = 1;
+        pthread_cond_broadcast(&batch.claimable);
+        pthread_mutex_unlock(&batch.lock);
+    }
+
+    if(ret != 0)
+    {
+        pthread_mutex_lock(&batch.lock);
+        batch.stop = 1;
+        pthread_cond_broadcast(&batch.claimable);
+        pthread_mutex_unlock(&batch.lock);
+    }
+
+    while(num_started > 0)
+    {
+        --num_started;
+        pthread_join(threads[num_started], NULL);
+        jsmntree_batch_worker_destroy(&workers[num_started]);
+    }
+
+    for(i = 0; i < batch.num_tasks; ++i)
+        jsmntree_buffer_free(&batch.tasks[i].output);
+
+    pthread_cond_destroy(&batch.finished);
+    pthread_cond_destroy(&batch.claimable);
+    pthread_mutex_destroy(&batch.lock);
+
+    free(threads);
+    free(workers);
+    free(batch.tasks);
+
+    return ret;
+}
+
+#undef JSMNTREE_BATCH_WINDOW
+#undef JSMNTREE_BATCH_CHUNK
@@ -0,0 +1,53 @@
+#ifndef JSMNTREE_BATCH_H_
+#define JSMNTREE_BATCH_H_ 1
+
+#include <stddef.h>
+#include "jsmntree.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+
+/**
+ * Called on a worker thread with the tree of each document of a batch.
+ * Whatever the document turns into is appended to `output', which is
+ * written out in input order. The tree is freed when this returns.
+ * Returns 0 to go on, or anything else to stop the batch.
+ */
+typedef int (*jsmntree_document_fn)(void * context, jsmntree_object * document,
+                                    jsmntree_buffer * output);
+
+/**
+ * Process newline-delimited JSON: every non-blank line is a document,
+ * whose root must be an object.
+ *
+ * The input is split on line boundaries into tasks of about a megabyte,
+ * which `num_threads' worker threads (0 for one per online processor)
+ * take in turn. Each worker makes its documents in a context of its own
+ * (see jsmntree_context_create()): they are built in an arena whatever
+ * the flags, and names are interned in a table of the worker's own with
+ * JSMNTREE_FLAG_INTERN; `options.arena' and `options.intern' are not
+ * used. The output of each
+ * task is handed to `write' on the calling thread, in input order.
+ * @param       js          Documents; must outlive the call only
+ * @param       options     Options documents are made with, or NULL
+ * @param       process     Called with each document; may be called
+ *                          from several threads at once
+ * @param       write       Sink of the output
+ * @return      0 on success, 1 if `process' stopped the batch,
+ *              JSMNTREE_ERROR_IO if the sink failed, or an error of
+ *              jsmntree_parse_buffer() for the first document that
+ *              failed; the output of every document before it is
+ *              written
+ */
+int jsmntree_batch(const char * js, const size_t len, const jsmntree_options * options,
+                    unsigned int num_threads,
+                    jsmntree_document_fn process, void * process_context,
+                    jsmntree_write_fn write, void * write_context);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* ! JSMNTREE_BATCH_H_ */
@@ -0,0 +1,267 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "jsmntree_binary.h"
+
+#define JSMNTREE_BINARY_MAGIC       "JSMNTREE"
+#define JSMNTREE_BINARY_BYTE_ORDER  0x01020304u
+
+uint64_t
+jsmntree_binary_hash(const char * js, const size_t len)
+{
+    uint64_t    hash    = 14695981039346656037ull;
+    size_t      i;
+
+    for(i = 0; i < len; ++i)
+    {
+        hash ^= (unsigned char)js[i];
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+int
+jsmntree_save_tape(const char * path, const jsmntree_tape * tape, const uint64_t source_hash)
+{
+    jsmntree_binary_header  header;
+    const size_t            length  = strlen(path);
+    char *                  temp    = malloc(length + sizeof(".XXXXXX"));
+    FILE *                  stream;
+    int                     fd;
+    int                     r       = 0;
+
+    if(temp == NULL)
+        return JSMN_ERROR_NOMEM;
+
+    /* A unique name next to `path', so that the rename is atomic */
+    memcpy(temp, path, length);
+    memcpy(&temp[length], ".XXXXXX", sizeof(".XXXXXX"));
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, JSMNTREE_BINARY_MAGIC, sizeof(header.magic));
+    header.version      = JSMNTREE_BINARY_VERSION;
+    header.byte_order   = JSMNTREE_BINARY_BYTE_ORDER;
+    header.source_hash  = source_hash;
+    header.tape_size    = jsmntree_tape_size(tape);
+
+    fd = mkstemp(temp);
+    if(fd < 0)
+    {
+        free(temp);
+        return JSMNTREE_ERROR_IO;
+    }
+
+    stream = fdopen(fd, "wb");
+    if(stream == NULL)
+    {
+        close(fd);
+        remove(temp);
+        free(temp);
+        return JSMNTREE_ERROR_IO;
+    }
+
+    /* mkstemp() makes the file private to its owner */
+    if(fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH) != 0 ||
+            fwrite(&header, sizeof(header), 1, stream) != 1 ||
+            fwrite(tape, header.tape_size, 1, stream) != 1)
+        r = JSMNTREE_ERROR_IO;
+
+    if(fclose(stream) != 0)
+        r = JSMNTREE_ERROR_IO;
+
+    if(r == 0 && rename(temp, path) != 0)
+        r = JSMNTREE_ERROR_IO;
+
+    if(r != 0)
+        remove(temp);
+
+    free(temp);
+
+    return r;
+}
+
+int
+jsmntree_save_binary(const char * path, jsmntree_object * tree, const uint64_t source_hash)
+{
+    jsmntree_tape * tape = jsmntree_tape_make_tree(tree);
+    int             r;
+
+    if(tape == NULL)
+        return JSMN_ERROR_NOMEM;
+
+    r = jsmntree_save_tape(path, tape, source_hash);
+    jsmntree_tape_free(tape);
+
+    return r;
+}
+
+/* Check that the string of a node lies within the string table */
+static int
+jsmntree_binary_check_string(const jsmntree_tape * tape, const jsmntree_tape_node * node)
+{
+    if(node->offset >= tape->strings_size ||
+            node->size >= tape->strings_size - node->offset ||
+            JSMNTREE_TAPE_STRINGS(tape)[node->offset + node->size] != '\0')
+        return -1;
+
+    return 0;
+}
+
+/* Whether the container or member on top of `open' holds as many nodes as its size says */
+#define JSMNTREE_BINARY_COUNTED(nodes, open, counts, depth) \
+    ((nodes)[(open)[(depth) - 1]].type == JSMNTREE_MEMBER || \
+        (nodes)[(open)[(depth) - 1]].size == (counts)[(depth) - 1])
+
+/**
+ * Check that the nodes of a mapped tape can be walked safely: every type
+ * is known, every subtree lies within its parent, objects hold members
+ * and members one value each, objects and arrays hold as many members or
+ * elements as their size says, and every string lies within the string
+ * table and is NUL-terminated.
+ * @return      0 if they can, or -1 if not or if out of memory
+ */
+static int
+jsmntree_binary_check(const jsmntree_tape * tape)
+{
+    const jsmntree_tape_node *  nodes   = JSMNTREE_TAPE_NODES(tape);
+    uint32_t *                  open    = malloc(sizeof(uint32_t) * 2 * (size_t)tape->num_nodes);
+    uint32_t *                  counts  = open + tape->num_nodes;
+    uint32_t                    depth   = 0;
+    uint32_t                    i;
+    int                         r       = 0;
+
+    if(open == NULL)
+        return -1;
+
+    for(i = 0; i < tape->num_nodes && r == 0; ++i)
+    {
+        const jsmntree_tape_node *  node    = &nodes[i];
+        const jsmntree_tape_node *  parent;
+
+        /* Close the containers and members which end before this node */
+        while(depth > 0 && nodes[open[depth - 1]].end <= i && r == 0)
+        {
+            if(!JSMNTREE_BINARY_COUNTED(nodes, open, counts, depth))
+                r = -1;
+            --depth;
+        }
+
+        parent = (depth > 0) ? &nodes[open[depth - 1]] : NULL;
+
+        if(r != 0 || node->end <= i || node->end > tape->num_nodes ||
+                (parent != NULL && node->end > parent->end) ||
+                (parent != NULL && parent->type == JSMNTREE_OBJECT && node->type != JSMNTREE_MEMBER) ||
+                (parent != NULL && parent->type == JSMNTREE_MEMBER &&
+                    (i != open[depth - 1] + 1 || node->end != parent->end)) ||
+                (node->type == JSMNTREE_MEMBER &&
+                    (parent == NULL || parent->type != JSMNTREE_OBJECT)))
+        {
+            r = -1;
+            break;
+        }
+
+        if(parent != NULL)
+            ++counts[depth - 1];
+
+        switch(node->type)
+        {
+        case JSMNTREE_OBJECT:
+        case JSMNTREE_ARRAY:
+            counts[depth]   = 0;
+            open[depth++]   = i;
+            break;
+
+        case JSMNTREE_MEMBER:
+            if(node->end < i + 2 || jsmntree_binary_check_string(tape, node) != 0)
+                r = -1;
+            else
+            {
+                counts[depth]   = 0;
+                open[depth++]   = i;
+            }
+            break;
+
+        case JSMNTREE_STRING:
+            if(node->end != i + 1 || jsmntree_binary_check_string(tape, node) != 0)
+                r = -1;
+            break;
+
+        case JSMNTREE_NUMBER:
+        case JSMNTREE_UNSIGNED:
+        case JSMNTREE_REAL:
+        case JSMNTREE_BOOLEAN:
+        case JSMNTREE_NULL:
+            if(node->end != i + 1)
+                r = -1;
+            break;
+
+        default:
+            r = -1;
+            break;
+        }
+    }
+
+    /* The rest end with the tape */
+    for(; depth > 0 && r == 0; --depth)
+    {
+        if(!JSMNTREE_BINARY_COUNTED(nodes, open, counts, depth))
+            r = -1;
+    }
+
+    free(open);
+
+    return r;
+}
+
+const jsmntree_tape *
+jsmntree_load_binary(const char * path, const uint64_t source_hash)
+{
+    const jsmntree_binary_header *  header;
+    const jsmntree_tape *           tape;
+    const char *                    mapping;
+    size_t                          size;
+
+    mapping = jsmntree_map_file(path, NULL, &size);
+    if(mapping == NULL)
+        return NULL;
+
+    header  = (const jsmntree_binary_header *)mapping;
+    tape    = (const jsmntree_tape *)(header + 1);
+
+    if(size < sizeof(jsmntree_binary_header) + sizeof(jsmntree_tape) ||
+            memcmp(header->magic, JSMNTREE_BINARY_MAGIC, sizeof(header->magic)) != 0 ||
+            header->version != JSMNTREE_BINARY_VERSION ||
+            header->byte_order != JSMNTREE_BINARY_BYTE_ORDER ||
+            (source_hash != 0 && header->source_hash != source_hash) ||
+            header->tape_size != size - sizeof(jsmntree_binary_header) ||
+            jsmntree_tape_size(tape) != header->tape_size ||
+            tape->num_nodes == 0 ||
+            JSMNTREE_TAPE_NODES(tape)[0].end != tape->num_nodes ||
+            jsmntree_binary_check(tape) != 0)
+    {
+        jsmntree_unmap_file(mapping, size);
+        return NULL;
+    }
+
+    return tape;
+}
+
+void
+jsmntree_unload_binary(const jsmntree_tape * tape)
+{
+    const jsmntree_binary_header * header;
+
+    if(tape == NULL)
+        return;
+
+    header = (const jsmntree_binary_header *)tape - 1;
+    jsmntree_unmap_file((const char *)header, sizeof(jsmntree_binary_header) + header->tape_size);
+}
+
+#undef JSMNTREE_BINARY_COUNTED
+#undef JSMNTREE_BINARY_BYTE_ORDER
+#undef JSMNTREE_BINARY_MAGIC
@@ -0,0 +1,80 @@
+#ifndef JSMNTREE_BINARY_H_
+#define JSMNTREE_BINARY_H_ 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include "jsmntree.h"
+#include "jsmntree_tape.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+
+/* Version of the snapshot format; older or newer snapshots are refused */
+#define JSMNTREE_BINARY_VERSION     2
+
+/**
+ * Header of a snapshot file, followed by a tape (see jsmntree_tape.h) as
+ * it is in memory. Since a tape refers to its nodes and strings by index
+ * and offset only, a mapped snapshot is used as is: there is nothing to
+ * parse and no pointer to fix up.
+ * @param       magic       "JSMNTREE"
+ * @param       version     JSMNTREE_BINARY_VERSION
+ * @param       byte_order  0x01020304 as written by the host
+ * @param       source_hash Hash of the JSON text the snapshot was made of
+ * @param       tape_size   Size of the tape in bytes
+ */
+typedef struct
+{
+    char                magic[8];
+    uint32_t            version;
+    uint32_t            byte_order;
+    uint64_t            source_hash;
+    uint64_t            tape_size;
+}
+jsmntree_binary_header;
+
+/**
+ * Hash of a JSON text (64-bit FNV-1a), to key a snapshot by its source.
+ */
+uint64_t jsmntree_binary_hash(const char * js, const size_t len);
+
+/**
+ * Save a tree as a snapshot file. The file is written under a unique
+ * temporary name in the same directory and renamed, so that a reader
+ * never maps a partial snapshot; it is readable by all and writable by
+ * its owner.
+ * @param       source_hash Hash of the JSON text of `tree', or 0
+ * @return      0 on success, JSMN_ERROR_NOMEM or JSMNTREE_ERROR_IO
+ */
+int jsmntree_save_binary(const char * path, jsmntree_object * tree, const uint64_t source_hash);
+
+/**
+ * Save a tape as a snapshot file, as jsmntree_save_binary().
+ */
+int jsmntree_save_tape(const char * path, const jsmntree_tape * tape, const uint64_t source_hash);
+
+/**
+ * Map a snapshot file read-only. The tape is ready at once; release it
+ * with jsmntree_unload_binary(), never with jsmntree_tape_free().
+ * @param       source_hash Hash of the JSON text the snapshot must have
+ *                          been made of, or 0 for any
+ * @return      Tape, or NULL if the file cannot be mapped, is not a
+ *              snapshot of this version and byte order, is truncated,
+ *              was made of another JSON text, has nodes or strings
+ *              out of bounds, or has objects or arrays whose size is not
+ *              the number of their members or elements
+ */
+const jsmntree_tape * jsmntree_load_binary(const char * path, const uint64_t source_hash);
+
+/**
+ * Unmap a tape from jsmntree_load_binary().
+ */
+void jsmntree_unload_binary(const jsmntree_tape * tape);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* ! JSMNTREE_BINARY_H_ */
@@ -0,0 +1,689 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "jsmntree_column.h"
+#include "jsmn/jsmn.h"
+
+/* Column of a key which is skipped */
+#define JSMNTREE_COLUMN_NONE    ((size_t)-1)
+
+/* Rows the columns have room for at first */
+#define JSMNTREE_COLUMN_ROWS    64
+
+/**
+ * A key of the first record of an append, with its column, so that the
+ * keys of the next records are matched by name only while in order.
+ * @param       name        Name, as it is in the record (escaped if it
+ *                          comes from tokens)
+ * @param       name_length Length of `name'
+ * @param       column      Index of its column, or JSMNTREE_COLUMN_NONE
+ */
+typedef struct
+{
+    const char *        name;
+    size_t              name_length;
+    size_t              column;
+}
+jsmntree_column_key;
+
+/**
+ * Keys of the first record of an append.
+ * @param       keys        Keys, in order
+ * @param       num_keys    Number of `keys'
+ * @param       learning    Whether the first record is being appended
+ */
+typedef struct
+{
+    jsmntree_column_key *   keys;
+    size_t                  num_keys;
+    int                     learning;
+}
+jsmntree_column_order;
+
+/* Bytes of a value of a column of type `type' */
+static size_t
+jsmntree_column_value_size(const jsmntreetype_t type)
+{
+    switch(type)
+    {
+    case JSMNTREE_NUMBER:
+        return sizeof(int64_t);
+
+    case JSMNTREE_REAL:
+        return sizeof(double);
+
+    case JSMNTREE_BOOLEAN:
+        return sizeof(uint8_t);
+
+    default:
+        return 0;
+    }
+}
+
+/**
+ * Make room for `capacity' rows in the values or strings of a column of
+ * `num_rows' rows. New rows are zeroed.
+ * @return      0 on success, JSMN_ERROR_NOMEM otherwise
+ */
+static int
+jsmntree_column_reserve_values(jsmntree_column * column, const size_t num_rows, const size_t capacity)
+{
+    const size_t value_size = jsmntree_column_value_size(column->type);
+
+    /* Columns of a given schema are added before any row */
+    if(capacity == 0)
+        return 0;
+
+    if(value_size > 0)
+    {
+        char * values = realloc(column->values, value_size * capacity);
+
+        if(values == NULL)
+            return JSMN_ERROR_NOMEM;
+
+        memset(&values[value_size * num_rows], 0, value_size * (capacity - num_rows));
+        column->values = values;
+    }
+    else if(column->type == JSMNTREE_STRING)
+    {
+        uint64_t * offsets = realloc(column->offsets, sizeof(uint64_t) * (capacity + 1));
+
+        if(offsets == NULL)
+            return JSMN_ERROR_NOMEM;
+
+        memset(&offsets[num_rows + 1], 0, sizeof(uint64_t) * (capacity - num_rows));
+        if(column->offsets == NULL)
+            offsets[0] = 0;
+        column->offsets = offsets;
+    }
+
+    return 0;
+}
+
+/* As jsmntree_column_reserve_values(), for the null bitmap too */
+static int
+jsmntree_column_reserve(jsmntree_column * column, const size_t num_rows, const size_t capacity)
+{
+    uint8_t * nulls;
+
+    if(capacity == 0)
+        return 0;
+
+    nulls = realloc(column->nulls, (capacity + 7) / 8);
+    if(nulls == NULL)
+        return JSMN_ERROR_NOMEM;
+
+    memset(&nulls[(num_rows + 7) / 8], 0, (capacity + 7) / 8 - (num_rows + 7) / 8);
+    column->nulls = nulls;
+
+    return jsmntree_column_reserve_values(column, num_rows, capacity);
+}
+
+/**
+ * Add a column of every row so far null.
+ * @param       index       Set to the index of the column
+ * @return      0 on success, JSMN_ERROR_NOMEM otherwise
+ */
+static int
+jsmntree_columns_new(jsmntree_columns * columns, const char * name, const size_t name_length,
+                        const jsmntreetype_t type, size_t * index)
+{
+    jsmntree_column *   column;
+    size_t              i;
+
+    if(columns->num_columns == columns->columns_capacity)
+    {
+        const size_t        new_capacity    = (columns->columns_capacity > 0)
+                                                ? columns->columns_capacity * 2 : 16;
+        jsmntree_column *   new_columns     = realloc(columns->columns,
+                                                        sizeof(jsmntree_column) * new_capacity);
+
+        if(new_columns == NULL)
+            return JSMN_ERROR_NOMEM;
+
+        columns->columns            = new_columns;
+        columns->columns_capacity   = new_capacity;
+    }
+
+    column = &columns->columns[columns->num_columns];
+    memset(column, 0, sizeof(jsmntree_column));
+    column->type = type;
+
+    column->name = malloc(name_length + 1);
+    if(column->name == NULL)
+        return JSMN_ERROR_NOMEM;
+
+    memcpy(column->name, name, name_length);
+    column->name[name_length]   = '\0';
+    column->name_length         = name_length;
+
+    if(jsmntree_column_reserve(column, 0, columns->rows_capacity) != 0)
+    {
+        free(column->name);
+        free(column->nulls);
+        free(column->values);
+        free(column->offsets);
+        return JSMN_ERROR_NOMEM;
+    }
+
+    for(i = 0; i < columns->num_rows; ++i)
+        column->nulls[i / 8] |= 1 << (i % 8);
+    column->num_nulls = columns->num_rows;
+
+    *index = columns->num_columns++;
+
+    return 0;
+}
+
+/**
+ * Give a column without values so far a type; every row is null, so its
+ * values are all zeroed.
+ * @return      0 on success, JSMN_ERROR_NOMEM otherwise
+ */
+static int
+jsmntree_column_set_type(jsmntree_columns * columns, jsmntree_column * column,
+                            const jsmntreetype_t type)
+{
+    column->type = type;
+
+    if(jsmntree_column_reserve_values(column, 0, columns->rows_capacity) != 0)
+    {
+        column->type = JSMNTREE_UNDEFINED;
+        return JSMN_ERROR_NOMEM;
+    }
+
+    return 0;
+}
+
+/* Turn a column of numbers into one of reals, in place */
+static void
+jsmntree_column_widen(jsmntree_columns * columns, jsmntree_column * column)
+{
+    char *  values  = column->values;
+    size_t  i;
+
+    for(i = 0; i < columns->num_rows; ++i)
+    {
+        int64_t integer;
+        double  real;
+
+        memcpy(&integer, &values[sizeof(int64_t) * i], sizeof(int64_t));
+        real = (double)integer;
+        memcpy(&values[sizeof(double) * i], &real, sizeof(double));
+    }
+
+    column->type = JSMNTREE_REAL;
+}
+
+/**
+ * Append a row, null in every column.
+ * @return      0 on success, JSMN_ERROR_NOMEM otherwise
+ */
+static int
+jsmntree_columns_begin_row(jsmntree_columns * columns)
+{
+    const size_t    row = columns->num_rows;
+    size_t          i;
+
+    if(row == columns->rows_capacity)
+    {
+        const size_t new_capacity = (row > 0) ? row * 2 : JSMNTREE_COLUMN_ROWS;
+
+        for(i = 0; i < columns->num_columns; ++i)
+            if(jsmntree_column_reserve(&columns->columns[i], row, new_capacity) != 0)
+                return JSMN_ERROR_NOMEM;
+
+        columns->rows_capacity = new_capacity;
+    }
+
+    /* Values of new rows are zeroed already */
+    for(i = 0; i < columns->num_columns; ++i)
+    {
+        jsmntree_column * column = &columns->columns[i];
+
+        column->nulls[row / 8] |= 1 << (row % 8);
+        ++column->num_nulls;
+
+        if(column->type == JSMNTREE_STRING)
+            column->offsets[row + 1] = column->offsets[row];
+    }
+
+    ++columns->num_rows;
+
+    return 0;
+}
+
+/**
+ * Put a value into the last row of a column. A value of another type
+ * leaves the row null, and one of a key already put in the row is
+ * ignored.
+ * @param       string      String of a JSMNTREE_STRING value
+ * @param       length      Length of `string'
+ * @param       escaped     Whether `string' is to be decoded
+ * @return      0 on success, JSMN_ERROR_NOMEM otherwise
+ */
+static int
+jsmntree_columns_put(jsmntree_columns * columns, jsmntree_column * column,
+                        const jsmntreetype_t type, const jsmntree_value * value,
+                        const char * string, const size_t length, const int escaped)
+{
+    const size_t    row         = columns->num_rows - 1;
+    int             matches     = 0;
+
+    if(type == JSMNTREE_NULL || !JSMNTREE_COLUMN_IS_NULL(column, row))
+        return 0;
+
+    if(column->type == JSMNTREE_UNDEFINED)
+    {
+        jsmntreetype_t new_type;
+
+        switch(type)
+        {
+        case JSMNTREE_NUMBER:
+        case JSMNTREE_REAL:
+        case JSMNTREE_BOOLEAN:
+        case JSMNTREE_STRING:
+            new_type = type;
+            break;
+
+        case JSMNTREE_UNSIGNED:
+            new_type = JSMNTREE_REAL;
+            break;
+
+        default:
+            new_type = JSMNTREE_UNDEFINED;
+            break;
+        }
+
+        if(new_type != JSMNTREE_UNDEFINED && jsmntree_column_set_type(columns, column, new_type) != 0)
+            return JSMN_ERROR_NOMEM;
+    }
+    else if(column->type == JSMNTREE_NUMBER && !columns->fixed &&
+            (type == JSMNTREE_UNSIGNED || type == JSMNTREE_REAL))
+        jsmntree_column_widen(columns, column);
+
+    switch(column->type)
+    {
+    case JSMNTREE_NUMBER:
+        if(type == JSMNTREE_NUMBER)
+        {
+            ((int64_t *)column->values)[row] = value->integer;
+            matches = 1;
+        }
+        break;
+
+    case JSMNTREE_REAL:
+        matches = 1;
+        if(type == JSMNTREE_NUMBER)
+            ((double *)column->values)[row] = (double)value->integer;
+        else if(type == JSMNTREE_UNSIGNED)
+            ((double *)column->values)[row] = (double)value->uinteger;
+        else if(type == JSMNTREE_REAL)
+            ((double *)column->values)[row] = value->real;
+        else
+            matches = 0;
+        break;
+
+    case JSMNTREE_BOOLEAN:
+        if(type == JSMNTREE_BOOLEAN)
+        {
+            ((uint8_t *)column->values)[row] = (uint8_t)value->boolean;
+            matches = 1;
+        }
+        break;
+
+    case JSMNTREE_STRING:
+        if(type == JSMNTREE_STRING)
+        {
+            /* Replacements of what is not valid may make it longer */
+            const size_t    room        = escaped ? JSMNTREE_UNESCAPED_MAX(length) : length;
+            size_t          decoded     = length;
+
+            if(column->num_bytes + room > column->bytes_capacity)
+            {
+                size_t  new_capacity    = (column->bytes_capacity > 0) ? column->bytes_capacity * 2 : 4096;
+                char *  new_bytes;
+
+                while(new_capacity < column->num_bytes + room)
+                    new_capacity *= 2;
+
+                new_bytes = realloc(column->bytes, new_capacity);
+                if(new_bytes == NULL)
+                    return JSMN_ERROR_NOMEM;
+
+                column->bytes           = new_bytes;
+                column->bytes_capacity  = new_capacity;
+            }
+
+            /* Decoded as in a tree */
+            if(escaped)
+                decoded = jsmntree_string_unescape_lossy(string, length, &column->bytes[column->num_bytes]);
+            else
+                memcpy(&column->bytes[column->num_bytes], string, length);
+
+            column->num_bytes          += decoded;
+            column->offsets[row + 1]    = column->num_bytes;
+            matches = 1;
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    if(!matches)
+    {
+        ++column->num_mismatches;
+        return 0;
+    }
+
+    column->nulls[row / 8] &= ~(1 << (row % 8));
+    --column->num_nulls;
+
+    return 0;
+}
+
+/**
+ * Find the column of a key, adding it if the schema is inferred.
+ * @param       index       Set to the index of the column, or to
+ *                          JSMNTREE_COLUMN_NONE if the key is skipped
+ * @return      0 on success, JSMN_ERROR_NOMEM otherwise
+ */
+static int
+jsmntree_columns_lookup(jsmntree_columns * columns, const char * name, const size_t name_length,
+                        size_t * index)
+{
+    size_t i;
+
+    for(i = 0; i < columns->num_columns; ++i)
+    {
+        const jsmntree_column * column = &columns->columns[i];
+
+        if(column->name_length == name_length && memcmp(column->name, name, name_length) == 0)
+        {
+            *index = i;
+            return 0;
+        }
+    }
+
+    *index = JSMNTREE_COLUMN_NONE;
+    if(columns->fixed)
+        return 0;
+
+    return jsmntree_columns_new(columns, name, name_length, JSMNTREE_UNDEFINED, index);
+}
+
+/**
+ * Put the value of the member at `position' of the last row into its
+ * column, matched by the order of the keys of the first record, or else
+ * by name.
+ * @param       escaped     Whether `name' and `string' are to be decoded
+ * @return      0 on success, JSMN_ERROR_NOMEM otherwise
+ */
+static int
+jsmntree_columns_member(jsmntree_columns * columns, jsmntree_column_order * order,
+                        const size_t position, const char * name, const size_t name_length,
+                        const jsmntreetype_t type, const jsmntree_value * value,
+                        const char * string, const size_t length, const int escaped)
+{
+    const jsmntree_column_key * key     = (position < order->num_keys) ? &order->keys[position] : NULL;
+    size_t                      index;
+    int                         r;
+
+    if(!order->learning && key != NULL && key->name_length == name_length &&
+            memcmp(key->name, name, name_length) == 0)
+        index = key->column;
+    else
+    {
+        char *  decoded         = NULL;
+        size_t  decoded_length  = name_length;
+
+        if(escaped && (memchr(name, '\\', name_length) != NULL ||
+                        jsmntree_string_validate(name, name_length) != 0))
+        {
+            decoded = malloc(JSMNTREE_UNESCAPED_MAX(name_length) + 1);
+            if(decoded == NULL)
+                return JSMN_ERROR_NOMEM;
+
+            decoded_length = jsmntree_string_unescape_lossy(name, name_length, decoded);
+        }
+
+        r = jsmntree_columns_lookup(columns, (decoded != NULL) ? decoded : name, decoded_length, &index);
+        free(decoded);
+        if(r != 0)
+            return r;
+
+        if(order->learning && key != NULL)
+        {
+            order->keys[position].name          = name;
+            order->keys[position].name_length   = name_length;
+            order->keys[position].column        = index;
+        }
+    }
+
+    if(index == JSMNTREE_COLUMN_NONE)
+        return 0;
+
+    return jsmntree_columns_put(columns, &columns->columns[index], type, value, string, length, escaped);
+}
+
+/**
+ * Start learning the order of the keys of a record of `size' members, if
+ * it is the first one.
+ * @return      0 on success, JSMN_ERROR_NOMEM otherwise
+ */
+static int
+jsmntree_column_order_begin(jsmntree_column_order * order, const size_t size)
+{
+    if(!order->learning)
+        return 0;
+
+    if(size > 0)
+    {
+        order->keys = malloc(sizeof(jsmntree_column_key) * size);
+        if(order->keys == NULL)
+            return JSMN_ERROR_NOMEM;
+    }
+
+    order->num_keys = size;
+
+    return 0;
+}
+
+void
+jsmntree_columns_init(jsmntree_columns * columns)
+{
+    memset(columns, 0, sizeof(jsmntree_columns));
+}
+
+int
+jsmntree_columns_add(jsmntree_columns * columns, const char * name, const size_t name_length,
+                        const jsmntreetype_t type)
+{
+    size_t index;
+
+    if(columns->num_rows > 0 || (type != JSMNTREE_NUMBER && type != JSMNTREE_REAL &&
+                                    type != JSMNTREE_BOOLEAN && type != JSMNTREE_STRING))
+        return JSMNTREE_ERROR_INVTOK;
+
+    columns->fixed = 1;
+
+    return jsmntree_columns_new(columns, name, name_length, type, &index);
+}
+
+jsmntree_column *
+jsmntree_columns_find(const jsmntree_columns * columns, const char * name, const size_t name_length)
+{
+    size_t i;
+
+    for(i = 0; i < columns->num_columns; ++i)
+    {
+        jsmntree_column * column = &columns->columns[i];
+
+        if(column->name_length == name_length && memcmp(column->name, name, name_length) == 0)
+            return column;
+    }
+
+    return NULL;
+}
+
+int
+jsmntree_columns_append_array(jsmntree_columns * columns, jsmntree_array * array)
+{
+    jsmntree_column_order   order   = { NULL, 0, 1 };
+    size_t                  i;
+    size_t                  j;
+    int                     r       = 0;
+
+    if(jsmntree_array_expand(array) != 0)
+        return JSMN_ERROR_NOMEM;
+
+    for(i = 0; r == 0 && i < array->size; ++i)
+    {
+        const jsmntree_element *    element = &array->elements[i];
+        jsmntree_object *           object  = element->value.pointer;
+
+        if(element->value_type != JSMNTREE_OBJECT)
+        {
+            ++columns->num_skipped;
+            continue;
+        }
+
+        if(jsmntree_object_expand(object) != 0 || jsmntree_columns_begin_row(columns) != 0 ||
+                jsmntree_column_order_begin(&order, object->size) != 0)
+        {
+            r = JSMN_ERROR_NOMEM;
+            break;
+        }
+
+        for(j = 0; r == 0 && j < object->size; ++j)
+        {
+            jsmntree_member * member = &object->members[j];
+
+            r = jsmntree_columns_member(columns, &order, j, member->name, member->name_length,
+                                        member->value_type, &member->value,
+                                        (member->value_type == JSMNTREE_STRING)
+                                            ? JSMNTREE_VALUE_STRING(&member->value, member->value_length)
+                                            : NULL,
+                                        member->value_length, 0);
+        }
+
+        order.learning = 0;
+    }
+
+    free(order.keys);
+
+    return r;
+}
+
+/* Index of the token past the subtree of token `index' */
+static unsigned int
+jsmntree_columns_skip(const jsmntok_t * tokens, const unsigned int num_tokens, const unsigned int index)
+{
+    const int       end = tokens[index].end;
+    unsigned int    i   = index + 1;
+
+    while(i < num_tokens && tokens[i].type != JSMN_UNDEFINED && tokens[i].start < end)
+        ++i;
+
+    return i;
+}
+
+int
+jsmntree_columns_append_tokens(jsmntree_columns * columns, const char * js,
+                                const jsmntok_t * tokens, const unsigned int num_tokens,
+                                const unsigned int index)
+{
+    jsmntree_column_order   order   = { NULL, 0, 1 };
+    unsigned int            i       = index + 1;
+    int                     e;
+    int                     r       = 0;
+
+    if(index >= num_tokens || tokens[index].type != JSMN_ARRAY)
+        return JSMNTREE_ERROR_INVTOK;
+
+    for(e = 0; r == 0 && e < tokens[index].size && i < num_tokens; ++e)
+    {
+        const jsmntok_t *   record  = &tokens[i];
+        unsigned int        k       = i + 1;
+        int                 m;
+
+        if(record->type != JSMN_OBJECT)
+        {
+            ++columns->num_skipped;
+            i = jsmntree_columns_skip(tokens, num_tokens, i);
+            continue;
+        }
+
+        if(jsmntree_columns_begin_row(columns) != 0 ||
+                jsmntree_column_order_begin(&order, record->size) != 0)
+        {
+            r = JSMN_ERROR_NOMEM;
+            break;
+        }
+
+        for(m = 0; r == 0 && m < record->size && k + 1 < num_tokens; ++m)
+        {
+            const jsmntok_t *   name    = &tokens[k];
+            const jsmntok_t *   token   = &tokens[k + 1];
+            jsmntree_value      value;
+            jsmntreetype_t      type;
+
+            value.integer = 0;
+
+            switch(token->type)
+            {
+            case JSMN_OBJECT:
+                type = JSMNTREE_OBJECT;
+                break;
+
+            case JSMN_ARRAY:
+                type = JSMNTREE_ARRAY;
+                break;
+
+            case JSMN_STRING:
+                type = JSMNTREE_STRING;
+                break;
+
+            default:
+                type = jsmntree_decode_primitive(js, token, &value);
+                break;
+            }
+
+            r = jsmntree_columns_member(columns, &order, m, &js[name->start], name->end - name->start,
+                                        type, &value, &js[token->start], token->end - token->start, 1);
+
+            k = jsmntree_columns_skip(tokens, num_tokens, k + 1);
+        }
+
+        order.learning  = 0;
+        i               = k;
+    }
+
+    free(order.keys);
+
+    return r;
+}
+
+void
+jsmntree_columns_free(jsmntree_columns * columns)
+{
+    size_t i;
+
+    for(i = 0; i < columns->num_columns; ++i)
+    {
+        jsmntree_column * column = &columns->columns[i];
+
+        free(column->name);
+        free(column->values);
+        free(column->offsets);
+        free(column->bytes);
+        free(column->nulls);
+    }
+
+    free(columns->columns);
+    jsmntree_columns_init(columns);
+}
+
+#undef JSMNTREE_COLUMN_ROWS
+#undef JSMNTREE_COLUMN_NONE
@@ -0,0 +1,145 @@
+#ifndef JSMNTREE_COLUMN_H_
+#define JSMNTREE_COLUMN_H_ 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include "jsmntree.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+
+/**
+ * The values of one key across records, stored contiguously. A row is
+ * null if the record has no such key, if the value is null, or if it is
+ * of another type than the column; a null row has 0, false or an empty
+ * string as its value.
+ * @param       name        Key, NUL-terminated, with its escapes decoded
+ * @param       name_length Length of `name'
+ * @param       type        JSMNTREE_NUMBER: `values' are int64_t
+ *                          JSMNTREE_REAL: `values' are double
+ *                          JSMNTREE_BOOLEAN: `values' are uint8_t, 0 or 1
+ *                          JSMNTREE_STRING: in `offsets' and `bytes'
+ *                          JSMNTREE_UNDEFINED: no value is seen yet, and
+ *                          there is no storage at all
+ * @param       values      A value per row
+ * @param       offsets     A string per row: row i is `bytes' from
+ *                          offsets[i] up to offsets[i + 1]; there is one
+ *                          offset more than there are rows
+ * @param       bytes       Strings, decoded as in a tree, back to back
+ *                          and not NUL-terminated
+ * @param       num_bytes   Size of `bytes'
+ * @param       bytes_capacity  Allocated memory size of `bytes'
+ * @param       nulls       Bit i % 8 of nulls[i / 8] is set if row i is
+ *                          null; see JSMNTREE_COLUMN_IS_NULL()
+ * @param       num_nulls   Number of null rows
+ * @param       num_mismatches  Null rows whose value is of another type
+ */
+typedef struct
+{
+    char *              name;
+    size_t              name_length;
+    jsmntreetype_t      type;
+    void *              values;
+    uint64_t *          offsets;
+    char *              bytes;
+    size_t              num_bytes;
+    size_t              bytes_capacity;
+    uint8_t *           nulls;
+    size_t              num_nulls;
+    size_t              num_mismatches;
+}
+jsmntree_column;
+
+/* Whether row `row' of a column is null */
+#define JSMNTREE_COLUMN_IS_NULL(column, row) \
+    (((column)->nulls[(row) / 8] >> ((row) % 8)) & 1)
+
+/**
+ * Columns of records: each object of an array is a row, and each key a
+ * column. Initialise with jsmntree_columns_init(), and release with
+ * jsmntree_columns_free().
+ *
+ * The schema is either given with jsmntree_columns_add() before any row
+ * is appended, and keys out of it are skipped; or inferred as rows are
+ * appended: every new key is a new column (null in the rows before), its
+ * type is that of its first value which is not null, and a column of
+ * numbers becomes JSMNTREE_REAL once it meets a number which does not fit
+ * in int64_t.
+ * @param       columns     Columns, in the order their keys were seen
+ * @param       num_columns Number of `columns'
+ * @param       columns_capacity    Allocated number of `columns'
+ * @param       num_rows    Number of rows
+ * @param       rows_capacity   Rows the columns have room for
+ * @param       num_skipped Elements skipped because they are not objects
+ * @param       fixed       Whether the schema is given
+ */
+typedef struct
+{
+    jsmntree_column *   columns;
+    size_t              num_columns;
+    size_t              columns_capacity;
+    size_t              num_rows;
+    size_t              rows_capacity;
+    size_t              num_skipped;
+    int                 fixed;
+}
+jsmntree_columns;
+
+/**
+ * Initialise empty columns, with the schema to be inferred.
+ */
+void jsmntree_columns_init(jsmntree_columns * columns);
+
+/**
+ * Add a column to the schema, which is then given rather than inferred.
+ * @param       type        JSMNTREE_NUMBER, JSMNTREE_REAL,
+ *                          JSMNTREE_BOOLEAN or JSMNTREE_STRING
+ * @return      0 on success, JSMNTREE_ERROR_INVTOK if rows are appended
+ *              already or `type' is none of the above, or
+ *              JSMN_ERROR_NOMEM
+ */
+int jsmntree_columns_add(jsmntree_columns * columns, const char * name, const size_t name_length,
+                            const jsmntreetype_t type);
+
+/**
+ * Find the column of a key.
+ * @return      Column, or NULL if there is none
+ */
+jsmntree_column *
+jsmntree_columns_find(const jsmntree_columns * columns, const char * name, const size_t name_length);
+
+/**
+ * Append a row for each object of an array of a tree. Lazy containers are
+ * expanded on the way. The order of the keys of the first object is
+ * learned, so that the keys of the next ones are matched to their
+ * columns by comparing names only while they come in the same order.
+ * @return      0 on success, or JSMN_ERROR_NOMEM; the rows appended so
+ *              far are kept
+ */
+int jsmntree_columns_append_array(jsmntree_columns * columns, jsmntree_array * array);
+
+/**
+ * Append a row for each object of the array at token `index' of a JSON
+ * string, as jsmntree_columns_append_array() but straight from its
+ * tokens, without making a tree.
+ * @return      0 on success, JSMNTREE_ERROR_INVTOK if the token is not an
+ *              array, or JSMN_ERROR_NOMEM; the rows appended so far are
+ *              kept
+ */
+int jsmntree_columns_append_tokens(jsmntree_columns * columns, const char * js,
+                                    const jsmntok_t * tokens, const unsigned int num_tokens,
+                                    const unsigned int index);
+
+/**
+ * Release the memory space of columns. They are empty afterwards, as
+ * after jsmntree_columns_init().
+ */
+void jsmntree_columns_free(jsmntree_columns * columns);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* ! JSMNTREE_COLUMN_H_ */
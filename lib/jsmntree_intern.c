@@ -0,0 +1,157 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "jsmntree.h"
+#include "jsmntree_private.h"
+
+/* Interned strings are carved from arena blocks of this size */
+#define JSMNTREE_INTERN_BLOCK       (64 * 1024)
+
+/**
+ * A slot of an interning table.
+ * @param       hash        Hash of the string
+ * @param       length      Length of the string
+ * @param       string      Interned string, or NULL if empty
+ */
+typedef struct
+{
+    uint32_t            hash;
+    size_t              length;
+    const char *        string;
+}
+jsmntree_intern_slot;
+
+/**
+ * @param       size        Number of strings
+ * @param       mask        Number of slots minus 1 (a power of 2 minus 1)
+ * @param       slots       Slots, linearly probed
+ * @param       strings     Arena the strings live in; they never move
+ */
+struct jsmntree_intern
+{
+    size_t                  size;
+    size_t                  mask;
+    jsmntree_intern_slot *  slots;
+    jsmntree_arena *        strings;
+};
+
+jsmntree_intern *
+jsmntree_intern_create(void)
+{
+    jsmntree_intern * intern = malloc(sizeof(jsmntree_intern));
+
+    if(intern == NULL)
+        return NULL;
+
+    intern->size    = 0;
+    intern->mask    = 64 - 1;
+    intern->slots   = calloc(intern->mask + 1, sizeof(jsmntree_intern_slot));
+    intern->strings = jsmntree_arena_create(JSMNTREE_INTERN_BLOCK);
+
+    if(intern->slots == NULL || intern->strings == NULL)
+    {
+        jsmntree_intern_destroy(intern);
+        return NULL;
+    }
+
+    return intern;
+}
+
+void
+jsmntree_intern_destroy(jsmntree_intern * intern)
+{
+    if(intern == NULL)
+        return;
+
+    free(intern->slots);
+    jsmntree_arena_destroy(intern->strings);
+    free(intern);
+}
+
+static jsmntree_intern_slot *
+jsmntree_intern_probe(const jsmntree_intern * intern, const uint32_t hash,
+                        const char * string, const size_t length)
+{
+    size_t slot = hash & intern->mask;
+
+    while(intern->slots[slot].string != NULL)
+    {
+        if(intern->slots[slot].hash == hash &&
+                intern->slots[slot].length == length &&
+                memcmp(intern->slots[slot].string, string, length) == 0)
+            break;
+
+        slot = (slot + 1) & intern->mask;
+    }
+
+    return &intern->slots[slot];
+}
+
+static int
+jsmntree_intern_grow(jsmntree_intern * intern)
+{
+    size_t                  old_count   = intern->mask + 1;
+    jsmntree_intern_slot *  old_slots   = intern->slots;
+    jsmntree_intern_slot *  new_slots   = calloc(old_count * 2, sizeof(jsmntree_intern_slot));
+
+    if(new_slots == NULL)
+        return -1;
+
+    intern->slots   = new_slots;
+    intern->mask    = old_count * 2 - 1;
+
+    size_t i;
+    for(i = 0; i < old_count; ++i)
+    {
+        if(old_slots[i].string != NULL)
+            *jsmntree_intern_probe(intern, old_slots[i].hash,
+                                    old_slots[i].string, old_slots[i].length) = old_slots[i];
+    }
+
+    free(old_slots);
+
+    return 0;
+}
+
+const char *
+jsmntree_intern_find(const jsmntree_intern * intern, const char * string, const size_t length)
+{
+    return jsmntree_intern_probe(intern, jsmntree_hash_name(string, length),
+                                    string, length)->string;
+}
+
+const char *
+jsmntree_intern_string(jsmntree_intern * intern, const char * string, const size_t length)
+{
+    uint32_t                hash    = jsmntree_hash_name(string, length);
+    jsmntree_intern_slot *  slot    = jsmntree_intern_probe(intern, hash, string, length);
+
+    if(slot->string != NULL)
+        return slot->string;
+
+    /* Keep the load factor under 1/2 */
+    if((intern->size + 1) * 2 > intern->mask + 1)
+    {
+        if(jsmntree_intern_grow(intern) < 0)
+            return NULL;
+
+        slot = jsmntree_intern_probe(intern, hash, string, length);
+    }
+
+    char * new_string = jsmntree_arena_alloc(intern->strings, length + 1);
+    if(new_string == NULL)
+        return NULL;
+
+    memcpy(new_string, string, length);
+    new_string[length] = '\0';
+
+    slot->hash      = hash;
+    slot->length    = length;
+    slot->string    = new_string;
+    ++intern->size;
+
+    return new_string;
+}
+
+#undef JSMNTREE_INTERN_BLOCK
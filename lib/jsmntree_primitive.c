@@ -0,0 +1,219 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "jsmntree.h"
+#include "jsmn/jsmn.h"
+
+/* Powers of 10 which are exact in a double */
+static const double jsmntree_pow10[] =
+{
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+#define JSMNTREE_IS_DIGIT(c)    ((unsigned char)((c) - '0') < 10)
+
+/**
+ * Decode a number which is not an integer, or too large for one. Numbers
+ * with at most 15 significant digits and a power of 10 of at most 22
+ * are the result of one correctly rounded multiplication or division.
+ * Anything else goes to strtod(), which rounds correctly. Numbers too
+ * large for a double are invalid: JSON has no infinity to write back.
+ */
+static jsmntreetype_t
+jsmntree_decode_real(const char * begin, const char * end, jsmntree_value * value)
+{
+    const char *    p           = begin;
+    int             negative    = 0;
+    uint64_t        mantissa    = 0;
+    int             digits      = 0;
+    int             exponent    = 0;
+
+    if(*p == '-')
+    {
+        negative = 1;
+        ++p;
+    }
+
+    for(; p < end && JSMNTREE_IS_DIGIT(*p); ++p)
+    {
+        if(mantissa != 0 || *p != '0')
+            ++digits;
+        if(digits <= 19)
+            mantissa = mantissa * 10 + (*p - '0');
+        else
+            ++exponent;
+    }
+
+    /* A fraction and an exponent have at least one digit */
+    if(p < end && *p == '.')
+    {
+        if(++p == end || !JSMNTREE_IS_DIGIT(*p))
+            return JSMNTREE_UNDEFINED;
+
+        for(; p < end && JSMNTREE_IS_DIGIT(*p); ++p)
+        {
+            if(mantissa != 0 || *p != '0')
+                ++digits;
+            if(digits <= 19)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                --exponent;
+            }
+        }
+    }
+
+    if(p < end && (*p == 'e' || *p == 'E'))
+    {
+        int     exponent_negative   = 0;
+        int     e                   = 0;
+
+        ++p;
+        if(p < end && (*p == '+' || *p == '-'))
+            exponent_negative = (*p++ == '-');
+
+        if(p == end || !JSMNTREE_IS_DIGIT(*p))
+            return JSMNTREE_UNDEFINED;
+
+        for(; p < end && JSMNTREE_IS_DIGIT(*p); ++p)
+        {
+            if(e < 100000)
+                e = e * 10 + (*p - '0');
+        }
+
+        exponent += exponent_negative ? -e : e;
+    }
+
+    if(p != end)
+        return JSMNTREE_UNDEFINED;
+
+    if(digits <= 15 && exponent >= -22 && exponent <= 22)
+    {
+        double d = (double)mantissa;
+
+        if(exponent < 0)
+            d /= jsmntree_pow10[-exponent];
+        else
+            d *= jsmntree_pow10[exponent];
+
+        value->real = negative ? -d : d;
+        return JSMNTREE_REAL;
+    }
+
+    {
+        char    temp_string[64];
+        char *  string      = temp_string;
+        size_t  length      = end - begin;
+        char *  string_end  = NULL;
+
+        if(length >= sizeof(temp_string))
+        {
+            string = malloc(length + 1);
+            if(string == NULL)
+                return JSMNTREE_UNDEFINED;
+        }
+
+        memcpy(string, begin, length);
+        string[length] = '\0';
+
+        value->real = strtod(string, &string_end);
+        length      = string_end - string;
+
+        if(string != temp_string)
+            free(string);
+
+        if(length != (size_t)(end - begin) || isinf(value->real))
+            return JSMNTREE_UNDEFINED;
+    }
+
+    return JSMNTREE_REAL;
+}
+
+static jsmntreetype_t
+jsmntree_decode_number(const char * begin, const char * end, jsmntree_value * value)
+{
+    const char *    p           = begin;
+    int             negative    = 0;
+    uint64_t        u           = 0;
+
+    if(p < end && *p == '-')
+    {
+        negative = 1;
+        ++p;
+    }
+
+    /* No '+', and no leading zero */
+    if(p == end || !JSMNTREE_IS_DIGIT(*p) || (*p == '0' && p + 1 < end && JSMNTREE_IS_DIGIT(p[1])))
+        return JSMNTREE_UNDEFINED;
+
+    /* Integers of up to 19 digits never overflow */
+    const char * limit = (end - p > 19) ? p + 19 : end;
+    for(; p < limit && JSMNTREE_IS_DIGIT(*p); ++p)
+        u = u * 10 + (*p - '0');
+
+    /* The 20th digit may still fit in a uint64_t */
+    if(p < end && JSMNTREE_IS_DIGIT(*p) && end - p == 1)
+    {
+        unsigned int d = *p - '0';
+
+        if(u > (UINT64_MAX - d) / 10)
+            return jsmntree_decode_real(begin, end, value);
+
+        u = u * 10 + d;
+        ++p;
+    }
+
+    if(p != end)
+        return jsmntree_decode_real(begin, end, value);
+
+    if(negative)
+    {
+        /* -0 is not the integer 0 */
+        if(u == 0 || u > (uint64_t)INT64_MAX + 1)
+            return jsmntree_decode_real(begin, end, value);
+
+        value->integer = (u == (uint64_t)INT64_MAX + 1) ? INT64_MIN : -(int64_t)u;
+        return JSMNTREE_NUMBER;
+    }
+
+    if(u > (uint64_t)INT64_MAX)
+    {
+        value->uinteger = u;
+        return JSMNTREE_UNSIGNED;
+    }
+
+    value->integer = (int64_t)u;
+    return JSMNTREE_NUMBER;
+}
+
+jsmntreetype_t
+jsmntree_decode_primitive(const char * js, const jsmntok_t * token, jsmntree_value * value)
+{
+    const char *    begin   = &js[token->start];
+    const int       length  = token->end - token->start;
+
+    if(length <= 0)
+        return JSMNTREE_UNDEFINED;
+
+    switch(*begin)
+    {
+    case 't':
+        value->boolean = 1;
+        return (length == 4 && memcmp(begin, "true", 4) == 0) ? JSMNTREE_BOOLEAN : JSMNTREE_UNDEFINED;
+
+    case 'f':
+        value->boolean = 0;
+        return (length == 5 && memcmp(begin, "false", 5) == 0) ? JSMNTREE_BOOLEAN : JSMNTREE_UNDEFINED;
+
+    case 'n':
+        value->pointer = NULL;
+        return (length == 4 && memcmp(begin, "null", 4) == 0) ? JSMNTREE_NULL : JSMNTREE_UNDEFINED;
+
+    default:
+        return jsmntree_decode_number(begin, begin + length, value);
+    }
+}
+
+#undef JSMNTREE_IS_DIGIT
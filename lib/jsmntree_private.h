@@ -0,0 +1,51 @@
+#ifndef JSMNTREE_PRIVATE_H_
+#define JSMNTREE_PRIVATE_H_ 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include "jsmntree.h"
+
+/*
+ * Functions shared by the sources of the library, which are not part of
+ * its interface.
+ */
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+
+/**
+ * Make a JSON tree as jsmntree_make_tree_ex() does, but tell why it fails.
+ * @param       tree        Set to the tree made, or NULL on error
+ * @return      0 on success, JSMNTREE_ERROR_INVTOK if the first token is
+ *              not an object, JSMN_ERROR_INVAL if the tokens do not nest
+ *              as those of JSON do, or JSMN_ERROR_NOMEM
+ */
+int jsmntree_build_tree(const char * js, const size_t len,
+                        const jsmntok_t * tokens, const unsigned int num_tokens,
+                        const jsmntree_options * options, jsmntree_object ** tree);
+
+/* Room needed by jsmntree_format_real() */
+#define JSMNTREE_REAL_MAX       32
+
+/**
+ * Write a real as JSON into `digits', which has room for
+ * JSMNTREE_REAL_MAX bytes: the shortest of %.15g, %.16g and %.17g which
+ * reads back the same double, with ".0" if it would read back as an
+ * integer, or null if it is not finite.
+ * @return      Length of the text, which is not NUL-terminated
+ */
+size_t jsmntree_format_real(const double value, char * digits);
+
+/**
+ * Hash a name with FNV-1a, for the hash indexes of objects and the
+ * interning tables alike.
+ */
+uint32_t jsmntree_hash_name(const char * name, const size_t length);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* ! JSMNTREE_PRIVATE_H_ */
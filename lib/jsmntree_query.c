@@ -0,0 +1,385 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "jsmntree_query.h"
+#include "jsmn/jsmn.h"
+
+/**
+ * A segment of a path expression.
+ * @param       name        Member name, with escapes decoded
+ * @param       length      Length of `name'
+ * @param       index       Array index, or -1 if `name' is not one
+ * @param       wildcard    Whether the segment is "*"
+ */
+typedef struct
+{
+    const char *        name;
+    size_t              length;
+    long                index;
+    int                 wildcard;
+}
+jsmntree_query_segment;
+
+/**
+ * @param       num_segments    Number of `segments'
+ * @param       segments    Segments, followed by their names
+ */
+struct jsmntree_query
+{
+    size_t                  num_segments;
+    jsmntree_query_segment  segments[];
+};
+
+/* A decimal index without leading zeros, as in a JSON Pointer */
+static long
+jsmntree_query_index(const char * name, const size_t length)
+{
+    long    index   = 0;
+    size_t  i;
+
+    if(length == 0 || length > 9 || (name[0] == '0' && length > 1))
+        return -1;
+
+    for(i = 0; i < length; ++i)
+    {
+        if(name[i] < '0' || name[i] > '9')
+            return -1;
+
+        index = index * 10 + (name[i] - '0');
+    }
+
+    return index;
+}
+
+jsmntree_query *
+jsmntree_query_compile(const char * expression)
+{
+    const size_t    length          = strlen(expression);
+    size_t          num_segments    = 0;
+    size_t          i;
+
+    if(length > 0 && expression[0] != '/')
+        return NULL;
+
+    for(i = 0; i < length; ++i)
+        if(expression[i] == '/')
+            ++num_segments;
+
+    /* The names take no more room than the expression */
+    jsmntree_query * query = malloc(sizeof(jsmntree_query) +
+                                    sizeof(jsmntree_query_segment) * num_segments + length + 1);
+    if(query == NULL)
+        return NULL;
+
+    char *          names   = (char *)&query->segments[num_segments];
+    const char *    p       = expression;
+
+    query->num_segments = num_segments;
+
+    for(i = 0; i < num_segments; ++i)
+    {
+        jsmntree_query_segment *    segment = &query->segments[i];
+        const char *                end     = strchr(++p, '/');
+
+        if(end == NULL)
+            end = expression + length;
+
+        segment->name   = names;
+        segment->length = 0;
+
+        for(; p < end; ++p)
+        {
+            char c = *p;
+
+            if(c == '~' && p + 1 < end && (p[1] == '0' || p[1] == '1'))
+                c = (*++p == '0') ? '~' : '/';
+
+            names[segment->length++] = c;
+        }
+
+        segment->wildcard   = (segment->length == 1 && segment->name[0] == '*');
+        segment->index      = jsmntree_query_index(segment->name, segment->length);
+        names              += segment->length;
+    }
+
+    return query;
+}
+
+void
+jsmntree_query_free(jsmntree_query * query)
+{
+    free(query);
+}
+
+unsigned int *
+jsmntree_subtree_sizes(const jsmntok_t * tokens, const unsigned int num_tokens)
+{
+    unsigned int *  sizes   = malloc(sizeof(unsigned int) * (num_tokens > 0 ? num_tokens : 1));
+    unsigned int    open    = num_tokens;   /* Innermost open container */
+    unsigned int    i;
+
+    if(sizes == NULL)
+        return NULL;
+
+    /* While a container is open, its entry links to the one it is in */
+    for(i = 0; i < num_tokens; ++i)
+    {
+        while(open != num_tokens && tokens[i].start >= tokens[open].end)
+        {
+            unsigned int outer = sizes[open];
+            sizes[open] = i - open;
+            open        = outer;
+        }
+
+        if(tokens[i].type == JSMN_OBJECT || tokens[i].type == JSMN_ARRAY)
+        {
+            sizes[i]    = open;
+            open        = i;
+        }
+        else
+            sizes[i]    = 1;
+    }
+
+    while(open != num_tokens)
+    {
+        unsigned int outer = sizes[open];
+        sizes[open] = num_tokens - open;
+        open        = outer;
+    }
+
+    return sizes;
+}
+
+/**
+ * State of a query over tokens.
+ * @param       query       Query
+ * @param       js          JSON string
+ * @param       tokens      Tokens
+ * @param       num_tokens  Number of `tokens'
+ * @param       sizes       Subtree sizes, or NULL
+ * @param       callback    Called with each match
+ * @param       context     Context of `callback'
+ */
+typedef struct
+{
+    const jsmntree_query *  query;
+    const char *            js;
+    const jsmntok_t *       tokens;
+    unsigned int            num_tokens;
+    const unsigned int *    sizes;
+    jsmntree_token_fn       callback;
+    void *                  context;
+}
+jsmntree_token_query;
+
+/* Index of the token past the subtree of token `index' */
+static unsigned int
+jsmntree_query_skip(const jsmntree_token_query * q, const unsigned int index)
+{
+    if(q->sizes != NULL)
+        return index + q->sizes[index];
+
+    const int       end = q->tokens[index].end;
+    unsigned int    i   = index + 1;
+
+    while(i < q->num_tokens && q->tokens[i].type != JSMN_UNDEFINED && q->tokens[i].start < end)
+        ++i;
+
+    return i;
+}
+
+/**
+ * Whether the name of a member, as it is in the JSON string, is that of
+ * a segment: names with escapes or which are not valid are decoded first,
+ * as the names of a tree are.
+ * @return      1 if it is, 0 if not, or -1 if out of memory
+ */
+static int
+jsmntree_query_name(const jsmntree_query_segment * segment, const char * name, const size_t length)
+{
+    char    local[256];
+    char *  decoded     = local;
+    int     matches;
+
+    if(memchr(name, '\\', length) == NULL && jsmntree_string_validate(name, length) == 0)
+        return length == segment->length && memcmp(name, segment->name, length) == 0;
+
+    if(JSMNTREE_UNESCAPED_MAX(length) > sizeof(local))
+    {
+        decoded = malloc(JSMNTREE_UNESCAPED_MAX(length));
+        if(decoded == NULL)
+            return -1;
+    }
+
+    matches = (jsmntree_string_unescape_lossy(name, length, decoded) == segment->length &&
+                memcmp(decoded, segment->name, segment->length) == 0);
+
+    if(decoded != local)
+        free(decoded);
+
+    return matches;
+}
+
+/* Match the segments from `depth' on against the subtree of token `index' */
+static int
+jsmntree_query_token(const jsmntree_token_query * q, const unsigned int index, const size_t depth)
+{
+    const jsmntok_t *               token   = &q->tokens[index];
+    const jsmntree_query_segment *  segment = &q->query->segments[depth];
+    unsigned int                    i       = index + 1;
+    int                             n;
+
+    if(depth == q->query->num_segments)
+        return (q->callback(q->context, token) != 0) ? 1 : 0;
+
+    if(token->type == JSMN_OBJECT)
+    {
+        for(n = 0; n < token->size && i + 1 < q->num_tokens; ++n)
+        {
+            const jsmntok_t *   name    = &q->tokens[i];
+            int                 matches = segment->wildcard ? 1 :
+                                            jsmntree_query_name(segment, &q->js[name->start],
+                                                                name->end - name->start);
+
+            if(matches < 0)
+                return -1;
+
+            if(matches)
+            {
+                int r = jsmntree_query_token(q, i + 1, depth + 1);
+
+                if(r != 0)
+                    return r;
+
+                /* Only the first member of a name, as jsmntree_object_get() */
+                if(!segment->wildcard)
+                    break;
+            }
+
+            i = jsmntree_query_skip(q, i + 1);
+        }
+    }
+    else if(token->type == JSMN_ARRAY)
+    {
+        for(n = 0; n < token->size && i < q->num_tokens; ++n)
+        {
+            if(segment->wildcard || n == segment->index)
+            {
+                int r = jsmntree_query_token(q, i, depth + 1);
+
+                if(r != 0)
+                    return r;
+
+                if(!segment->wildcard)
+                    break;
+            }
+
+            i = jsmntree_query_skip(q, i);
+        }
+    }
+
+    return 0;
+}
+
+int
+jsmntree_query_tokens(const jsmntree_query * query, const char * js,
+                        const jsmntok_t * tokens, const unsigned int num_tokens,
+                        const unsigned int * sizes, jsmntree_token_fn callback, void * context)
+{
+    const jsmntree_token_query q = { query, js, tokens, num_tokens, sizes, callback, context };
+
+    if(num_tokens == 0 || tokens[0].type == JSMN_UNDEFINED)
+        return 0;
+
+    return jsmntree_query_token(&q, 0, 0);
+}
+
+/* Match the segments from `depth' on against a value of a tree */
+static int
+jsmntree_query_value(const jsmntree_query * query, const jsmntree_element * value,
+                        const size_t depth, jsmntree_value_fn callback, void * context)
+{
+    const jsmntree_query_segment *  segment;
+    jsmntree_element                child;
+    size_t                          i;
+
+    if(depth == query->num_segments)
+        return (callback(context, value) != 0) ? 1 : 0;
+
+    segment = &query->segments[depth];
+
+    if(value->value_type == JSMNTREE_OBJECT)
+    {
+        jsmntree_object * object = value->value.pointer;
+
+        if(!segment->wildcard)
+        {
+            const jsmntree_member * member = jsmntree_object_get(object, segment->name, segment->length);
+
+            /* Still unexpanded if out of memory */
+            if(member == NULL)
+                return (object->token != NULL) ? -1 : 0;
+
+            child.value         = member->value;
+            child.value_length  = member->value_length;
+            child.value_type    = member->value_type;
+
+            return jsmntree_query_value(query, &child, depth + 1, callback, context);
+        }
+
+        if(jsmntree_object_expand(object) < 0)
+            return -1;
+
+        for(i = 0; i < object->size; ++i)
+        {
+            const jsmntree_member * member = &object->members[i];
+            int                     r;
+
+            child.value         = member->value;
+            child.value_length  = member->value_length;
+            child.value_type    = member->value_type;
+
+            r = jsmntree_query_value(query, &child, depth + 1, callback, context);
+            if(r != 0)
+                return r;
+        }
+    }
+    else if(value->value_type == JSMNTREE_ARRAY)
+    {
+        jsmntree_array * array = value->value.pointer;
+
+        if(jsmntree_array_expand(array) < 0)
+            return -1;
+
+        if(!segment->wildcard)
+        {
+            if(segment->index < 0 || (size_t)segment->index >= array->size)
+                return 0;
+
+            return jsmntree_query_value(query, &array->elements[segment->index], depth + 1,
+                                        callback, context);
+        }
+
+        for(i = 0; i < array->size; ++i)
+        {
+            int r = jsmntree_query_value(query, &array->elements[i], depth + 1, callback, context);
+            if(r != 0)
+                return r;
+        }
+    }
+
+    return 0;
+}
+
+int
+jsmntree_query_tree(const jsmntree_query * query, jsmntree_object * object,
+                    jsmntree_value_fn callback, void * context)
+{
+    jsmntree_element root;
+
+    root.value.pointer  = object;
+    root.value_length   = 0;
+    root.value_type     = JSMNTREE_OBJECT;
+
+    return jsmntree_query_value(query, &root, 0, callback, context);
+}
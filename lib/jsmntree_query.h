@@ -0,0 +1,79 @@
+#ifndef JSMNTREE_QUERY_H_
+#define JSMNTREE_QUERY_H_ 1
+
+#include <stddef.h>
+#include "jsmntree.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+
+/**
+ * A compiled path expression, e.g. "/records/0/user/id". It is a JSON
+ * Pointer where a segment "*" matches every member of an object or every
+ * element of an array. Any other segment matches the first member of
+ * that name (with "~1" for '/' and "~0" for '~'), or, if it is a decimal
+ * index, the element at that index. The empty expression matches the
+ * root. Opaque; see jsmntree_query_compile().
+ */
+typedef struct jsmntree_query jsmntree_query;
+
+/**
+ * Called with each match over tokens, in document order. Returns 0 to
+ * go on, or anything else to stop the query.
+ */
+typedef int (*jsmntree_token_fn)(void * context, const jsmntok_t * token);
+
+/**
+ * Called with each match over a tree, in document order. Returns 0 to
+ * go on, or anything else to stop the query.
+ */
+typedef int (*jsmntree_value_fn)(void * context, const jsmntree_element * value);
+
+/**
+ * Compile a path expression.
+ * @return      Query, or NULL if the expression is neither empty nor
+ *              starts with '/', or if out of memory
+ */
+jsmntree_query * jsmntree_query_compile(const char * expression);
+
+/**
+ * Release a compiled query.
+ */
+void jsmntree_query_free(jsmntree_query * query);
+
+/**
+ * Count the tokens of the subtree of every token, itself included, so
+ * that a query jumps over a subtree at once. Release with free().
+ * @return      Array of `num_tokens' counts, or NULL if out of memory
+ */
+unsigned int *
+jsmntree_subtree_sizes(const jsmntok_t * tokens, const unsigned int num_tokens);
+
+/**
+ * Evaluate a query straight over the tokens of a JSON string, without
+ * making a tree. Subtrees which cannot match are jumped over: at once
+ * with `sizes' from jsmntree_subtree_sizes(), or by their end offsets
+ * if `sizes' is NULL. Names are matched once decoded, as in a tree.
+ * @return      0 on success, 1 if `callback' stopped the query, or -1 if
+ *              out of memory
+ */
+int jsmntree_query_tokens(const jsmntree_query * query, const char * js,
+                            const jsmntok_t * tokens, const unsigned int num_tokens,
+                            const unsigned int * sizes, jsmntree_token_fn callback, void * context);
+
+/**
+ * Evaluate a query over a tree. Lazy containers are expanded on the way
+ * only, and objects are looked up by their hash index.
+ * @return      0 on success, 1 if `callback' stopped the query, or -1 if
+ *              out of memory
+ */
+int jsmntree_query_tree(const jsmntree_query * query, jsmntree_object * object,
+                        jsmntree_value_fn callback, void * context);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* ! JSMNTREE_QUERY_H_ */
@@ -0,0 +1,127 @@
+#include <stdlib.h>
+
+#include "jsmntree_sax.h"
+#include "jsmn/jsmn.h"
+
+/**
+ * An open container.
+ * @param       end         End offset of the container in `js'
+ * @param       object      Whether the container is an object
+ * @param       key_next    Whether a name comes next in an object
+ */
+typedef struct
+{
+    int                 end;
+    int                 object;
+    int                 key_next;
+}
+jsmntree_sax_frame;
+
+/* Fire the end of the innermost container */
+static int
+jsmntree_sax_end(const jsmntree_sax_handler * handler, void * context,
+                    const jsmntree_sax_frame * frame)
+{
+    if(frame->object)
+        return (handler->end_object != NULL) ? handler->end_object(context) : 0;
+
+    return (handler->end_array != NULL) ? handler->end_array(context) : 0;
+}
+
+int
+jsmntree_sax_parse(const char * js, const jsmntok_t * tokens, const unsigned int num_tokens,
+                    const jsmntree_sax_handler * handler, void * context)
+{
+    jsmntree_sax_frame  stack[JSMNTREE_SAX_MAX_DEPTH];
+    unsigned int        depth   = 0;
+    unsigned int        i;
+
+    for(i = 0; i < num_tokens && tokens[i].type != JSMN_UNDEFINED; ++i)
+    {
+        const jsmntok_t *   token   = &tokens[i];
+        int                 stop    = 0;
+
+        /* Close the containers this token is past */
+        while(depth > 0 && token->start >= stack[depth - 1].end)
+        {
+            if(jsmntree_sax_end(handler, context, &stack[--depth]) != 0)
+                return 1;
+        }
+
+        /* Past the root */
+        if(depth == 0 && i > 0)
+            break;
+
+        if(depth > 0 && stack[depth - 1].object)
+        {
+            if(stack[depth - 1].key_next)
+            {
+                stack[depth - 1].key_next = 0;
+
+                if(handler->key != NULL &&
+                        handler->key(context, &js[token->start], token->end - token->start) != 0)
+                    return 1;
+                continue;
+            }
+
+            stack[depth - 1].key_next = 1;
+        }
+
+        switch(token->type)
+        {
+        case JSMN_OBJECT:
+        case JSMN_ARRAY:
+            if(depth == JSMNTREE_SAX_MAX_DEPTH)
+                return JSMNTREE_ERROR_DEPTH;
+
+            stack[depth].end        = token->end;
+            stack[depth].object     = (token->type == JSMN_OBJECT);
+            stack[depth].key_next   = 1;
+            ++depth;
+
+            if(token->type == JSMN_OBJECT)
+            {
+                if(handler->begin_object != NULL)
+                    stop = handler->begin_object(context, token->size);
+            }
+            else
+            {
+                if(handler->begin_array != NULL)
+                    stop = handler->begin_array(context, token->size);
+            }
+            break;
+
+        case JSMN_STRING:
+        case JSMN_PRIMITIVE:
+            if(handler->value != NULL)
+            {
+                jsmntree_element value;
+
+                if(token->type == JSMN_STRING)
+                    jsmntree_element_set_string(&value, &js[token->start], token->end - token->start);
+                else
+                {
+                    value.value_length  = 0;
+                    value.value_type    = jsmntree_decode_primitive(js, token, &value.value);
+                }
+
+                stop = handler->value(context, &value);
+            }
+            break;
+
+        default:
+            break;
+        }
+
+        if(stop != 0)
+            return 1;
+    }
+
+    while(depth > 0)
+    {
+        if(jsmntree_sax_end(handler, context, &stack[--depth]) != 0)
+            return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,62 @@
+#ifndef JSMNTREE_SAX_H_
+#define JSMNTREE_SAX_H_ 1
+
+#include <stddef.h>
+#include "jsmntree.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+
+/**
+ * Deepest nesting jsmntree_sax_parse() walks into. The stack of open
+ * containers lives on the C stack, so nothing is allocated.
+ */
+#ifndef JSMNTREE_SAX_MAX_DEPTH
+#define JSMNTREE_SAX_MAX_DEPTH      1024
+#endif /* ! JSMNTREE_SAX_MAX_DEPTH */
+
+/**
+ * Callbacks of jsmntree_sax_parse(). Any of them may be NULL. Each
+ * returns 0 to go on, or anything else to stop the walk.
+ *
+ * Strings are slices of the JSON string with their escapes as they are
+ * (see jsmntree_string_unescape()): they are not NUL-terminated and must
+ * not outlive it. A string value is read with JSMNTREE_VALUE_STRING(); a
+ * short one is a copy inline in the element, which lasts for the call only.
+ * @param       begin_object    An object with `size' members begins
+ * @param       end_object      The innermost object ends
+ * @param       begin_array     An array with `size' elements begins
+ * @param       end_array       The innermost array ends
+ * @param       key         The name of a member; its value follows
+ * @param       value       A string, number, boolean or null, typed as in
+ *                          a tree; JSMNTREE_UNDEFINED if it is invalid
+ */
+typedef struct
+{
+    int (*begin_object)(void * context, const size_t size);
+    int (*end_object)(void * context);
+    int (*begin_array)(void * context, const size_t size);
+    int (*end_array)(void * context);
+    int (*key)(void * context, const char * name, const size_t length);
+    int (*value)(void * context, const jsmntree_element * value);
+}
+jsmntree_sax_handler;
+
+/**
+ * Walk the tokens of a JSON string, firing the callbacks of `handler' in
+ * document order, without making a tree or allocating anything. The
+ * root may be of any type.
+ * @return      0 on success, 1 if a callback stopped the walk, or
+ *              JSMNTREE_ERROR_DEPTH if nested deeper than
+ *              JSMNTREE_SAX_MAX_DEPTH
+ */
+int jsmntree_sax_parse(const char * js, const jsmntok_t * tokens, const unsigned int num_tokens,
+                        const jsmntree_sax_handler * handler, void * context);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* ! JSMNTREE_SAX_H_ */
@@ -0,0 +1,520 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+
+#include "jsmntree.h"
+#include "jsmntree_private.h"
+
+/* A sink is handed chunks of at least this many bytes */
+#define JSMNTREE_WRITER_CHUNK   (64 * 1024)
+
+/* Longer strings are escaped piece by piece, each growing up to 6 times */
+#define JSMNTREE_WRITER_PIECE   (4 * 1024)
+
+/**
+ * State of a serialization.
+ * @param       buffer      Output, or staging area for `write'
+ * @param       write       Sink, or NULL to keep everything in `buffer'
+ * @param       context     Context of `write'
+ * @param       format      Format
+ * @param       depth       Nesting depth, for JSMNTREE_FORMAT_PRETTY
+ * @param       error       Nonzero once anything failed
+ */
+typedef struct
+{
+    jsmntree_buffer *       buffer;
+    jsmntree_write_fn       write;
+    void *                  context;
+    jsmntree_format         format;
+    unsigned int            depth;
+    int                     error;
+}
+jsmntree_writer;
+
+static int
+jsmntree_writer_flush(jsmntree_writer * writer)
+{
+    if(writer->write != NULL && writer->buffer->size > 0)
+    {
+        if(writer->write(writer->context, writer->buffer->data, writer->buffer->size) != 0)
+            writer->error = 1;
+
+        writer->buffer->size = 0;
+    }
+
+    return writer->error ? -1 : 0;
+}
+
+/**
+ * Make room for `length' more bytes. Returns where to write them, or
+ * NULL on error.
+ */
+static char *
+jsmntree_writer_reserve(jsmntree_writer * writer, const size_t length)
+{
+    jsmntree_buffer * buffer = writer->buffer;
+
+    if(writer->error)
+        return NULL;
+
+    if(buffer->capacity - buffer->size < length)
+    {
+        if(writer->write != NULL && buffer->size > 0)
+        {
+            if(jsmntree_writer_flush(writer) < 0)
+                return NULL;
+        }
+
+        if(buffer->capacity - buffer->size < length)
+        {
+            size_t new_capacity = (buffer->capacity > 0) ? buffer->capacity * 2 : JSMNTREE_WRITER_CHUNK;
+            while(new_capacity - buffer->size < length)
+                new_capacity *= 2;
+
+            char * new_data = realloc(buffer->data, new_capacity);
+            if(new_data == NULL)
+            {
+                writer->error = 1;
+                return NULL;
+            }
+
+            buffer->data        = new_data;
+            buffer->capacity    = new_capacity;
+        }
+    }
+
+    return buffer->data + buffer->size;
+}
+
+static void
+jsmntree_writer_put(jsmntree_writer * writer, const char * data, const size_t length)
+{
+    char * out = jsmntree_writer_reserve(writer, length);
+
+    if(out == NULL)
+        return;
+
+    memcpy(out, data, length);
+    writer->buffer->size += length;
+}
+
+static void
+jsmntree_writer_putc(jsmntree_writer * writer, const char c)
+{
+    char * out = jsmntree_writer_reserve(writer, 1);
+
+    if(out == NULL)
+        return;
+
+    *out = c;
+    ++writer->buffer->size;
+}
+
+static void
+jsmntree_writer_put_uint(jsmntree_writer * writer, uint64_t u, const int negative)
+{
+    char            digits[24];
+    char *          p       = digits + sizeof(digits);
+
+    do
+    {
+        *--p = '0' + (u % 10);
+        u /= 10;
+    }
+    while(u != 0);
+
+    if(negative)
+        *--p = '-';
+
+    jsmntree_writer_put(writer, p, digits + sizeof(digits) - p);
+}
+
+static void
+jsmntree_writer_put_int(jsmntree_writer * writer, const int64_t value)
+{
+    if(value < 0)
+        jsmntree_writer_put_uint(writer, 0u - (uint64_t)value, 1);
+    else
+        jsmntree_writer_put_uint(writer, (uint64_t)value, 0);
+}
+
+size_t
+jsmntree_format_real(const double value, char * digits)
+{
+    int     length      = 0;
+    int     precision;
+
+    /* JSON has no infinity nor NaN */
+    if(!isfinite(value))
+    {
+        memcpy(digits, "null", 4);
+        return 4;
+    }
+
+    for(precision = 15; precision <= 17; ++precision)
+    {
+        length = snprintf(digits, JSMNTREE_REAL_MAX, "%.*g", precision, value);
+        if(strtod(digits, NULL) == value)
+            break;
+    }
+
+    /* Keep it a real when it is read again */
+    if(strpbrk(digits, ".eE") == NULL)
+    {
+        digits[length++] = '.';
+        digits[length++] = '0';
+    }
+
+    return length;
+}
+
+static void
+jsmntree_writer_put_real(jsmntree_writer * writer, const double value)
+{
+    char    digits[JSMNTREE_REAL_MAX];
+
+    jsmntree_writer_put(writer, digits, jsmntree_format_real(value, digits));
+}
+
+static void
+jsmntree_writer_put_string(jsmntree_writer * writer, const char * string, const size_t length)
+{
+    size_t  done    = 0;
+    char *  out;
+
+    if(length <= JSMNTREE_WRITER_PIECE)
+    {
+        out = jsmntree_writer_reserve(writer, JSMNTREE_ESCAPED_MAX(length) + 2);
+        if(out == NULL)
+            return;
+
+        const size_t escaped = jsmntree_string_escape(string, length, out + 1);
+
+        out[0]              = '"';
+        out[escaped + 1]    = '"';
+        writer->buffer->size += escaped + 2;
+        return;
+    }
+
+    jsmntree_writer_putc(writer, '"');
+
+    while(done < length)
+    {
+        const size_t piece = (length - done < JSMNTREE_WRITER_PIECE) ? length - done : JSMNTREE_WRITER_PIECE;
+
+        out = jsmntree_writer_reserve(writer, JSMNTREE_ESCAPED_MAX(piece));
+        if(out == NULL)
+            return;
+
+        writer->buffer->size   += jsmntree_string_escape(string + done, piece, out);
+        done                   += piece;
+    }
+
+    jsmntree_writer_putc(writer, '"');
+}
+
+/* Line break and indentation before a member or element, or a closing bracket */
+static void
+jsmntree_writer_newline(jsmntree_writer * writer)
+{
+    if(writer->format.style != JSMNTREE_FORMAT_PRETTY)
+        return;
+
+    size_t  length  = 1 + (size_t)writer->depth * writer->format.indent;
+    char *  out     = jsmntree_writer_reserve(writer, length);
+
+    if(out == NULL)
+        return;
+
+    out[0] = '\n';
+    memset(out + 1, ' ', length - 1);
+    writer->buffer->size += length;
+}
+
+static void jsmntree_writer_object(jsmntree_writer *, jsmntree_object *);
+static void jsmntree_writer_array(jsmntree_writer *, jsmntree_array *);
+
+static void
+jsmntree_writer_value(jsmntree_writer * writer, const jsmntree_value * value,
+                        const size_t value_length, const jsmntreetype_t value_type)
+{
+    switch(value_type)
+    {
+    case JSMNTREE_OBJECT:
+        jsmntree_writer_object(writer, value->pointer);
+        break;
+
+    case JSMNTREE_ARRAY:
+        jsmntree_writer_array(writer, value->pointer);
+        break;
+
+    case JSMNTREE_STRING:
+        jsmntree_writer_put_string(writer, JSMNTREE_VALUE_STRING(value, value_length), value_length);
+        break;
+
+    case JSMNTREE_NUMBER:
+        jsmntree_writer_put_int(writer, value->integer);
+        break;
+
+    case JSMNTREE_UNSIGNED:
+        jsmntree_writer_put_uint(writer, value->uinteger, 0);
+        break;
+
+    case JSMNTREE_REAL:
+        jsmntree_writer_put_real(writer, value->real);
+        break;
+
+    case JSMNTREE_BOOLEAN:
+        if(value->boolean == 0)
+            jsmntree_writer_put(writer, "false", 5);
+        else
+            jsmntree_writer_put(writer, "true", 4);
+        break;
+
+    default:
+        /* null, and primitives which could not be decoded */
+        jsmntree_writer_put(writer, "null", 4);
+        break;
+    }
+}
+
+/* Opening bracket of a container with `size' members or elements */
+static void
+jsmntree_writer_open(jsmntree_writer * writer, const char bracket, const size_t size)
+{
+    jsmntree_writer_putc(writer, bracket);
+
+    if(writer->format.style == JSMNTREE_FORMAT_SPACED)
+        jsmntree_writer_putc(writer, ' ');
+    else if(size > 0)
+        ++writer->depth;
+}
+
+static void
+jsmntree_writer_close(jsmntree_writer * writer, const char bracket, const size_t size)
+{
+    if(writer->format.style == JSMNTREE_FORMAT_SPACED)
+        jsmntree_writer_putc(writer, ' ');
+    else if(size > 0)
+    {
+        --writer->depth;
+        jsmntree_writer_newline(writer);
+    }
+
+    jsmntree_writer_putc(writer, bracket);
+}
+
+static void
+jsmntree_writer_separator(jsmntree_writer * writer)
+{
+    jsmntree_writer_putc(writer, ',');
+
+    if(writer->format.style == JSMNTREE_FORMAT_SPACED)
+        jsmntree_writer_putc(writer, ' ');
+}
+
+static void
+jsmntree_writer_object(jsmntree_writer * writer, jsmntree_object * object)
+{
+    if(object == NULL)
+        return;
+
+    if(jsmntree_object_expand(object) < 0)
+    {
+        writer->error = 1;
+        return;
+    }
+
+    jsmntree_writer_open(writer, '{', object->size);
+
+    size_t i;
+    for(i = 0; i < object->size && !writer->error; ++i)
+    {
+        const jsmntree_member * member = &object->members[i];
+
+        if(i > 0)
+            jsmntree_writer_separator(writer);
+
+        jsmntree_writer_newline(writer);
+        jsmntree_writer_put_string(writer, member->name, member->name_length);
+        if(writer->format.style == JSMNTREE_FORMAT_MINIFIED)
+            jsmntree_writer_putc(writer, ':');
+        else
+            jsmntree_writer_put(writer, ": ", 2);
+
+        jsmntree_writer_value(writer, &member->value, member->value_length, member->value_type);
+    }
+
+    jsmntree_writer_close(writer, '}', object->size);
+}
+
+static void
+jsmntree_writer_array(jsmntree_writer * writer, jsmntree_array * array)
+{
+    if(array == NULL)
+        return;
+
+    if(jsmntree_array_expand(array) < 0)
+    {
+        writer->error = 1;
+        return;
+    }
+
+    jsmntree_writer_open(writer, '[', array->size);
+
+    size_t i;
+    for(i = 0; i < array->size && !writer->error; ++i)
+    {
+        const jsmntree_element * element = &array->elements[i];
+
+        if(i > 0)
+            jsmntree_writer_separator(writer);
+
+        jsmntree_writer_newline(writer);
+        jsmntree_writer_value(writer, &element->value, element->value_length, element->value_type);
+    }
+
+    jsmntree_writer_close(writer, ']', array->size);
+}
+
+/* Seconds of a monotonic clock, if `stats' are recorded */
+static double
+jsmntree_writer_clock(const jsmntree_stats * stats)
+{
+    struct timespec ts;
+
+    if(stats == NULL)
+        return 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void
+jsmntree_writer_init(jsmntree_writer * writer, jsmntree_buffer * buffer,
+                        const jsmntree_format * format)
+{
+    writer->buffer          = buffer;
+    writer->write           = NULL;
+    writer->context         = NULL;
+    writer->format.style    = JSMNTREE_FORMAT_MINIFIED;
+    writer->format.indent   = 0;
+    writer->depth           = 0;
+    writer->error           = 0;
+
+    if(format != NULL)
+        writer->format = *format;
+}
+
+int
+jsmntree_serialize(jsmntree_object * object, const jsmntree_format * format,
+                    jsmntree_write_fn write, void * context)
+{
+    jsmntree_stats *    stats   = jsmntree_get_stats(object);
+    const double        start   = jsmntree_writer_clock(stats);
+    jsmntree_buffer     buffer  = { NULL, 0, 0 };
+    jsmntree_writer     writer;
+
+    jsmntree_writer_init(&writer, &buffer, format);
+    writer.write    = write;
+    writer.context  = context;
+
+    jsmntree_writer_object(&writer, object);
+    jsmntree_writer_flush(&writer);
+
+    jsmntree_buffer_free(&buffer);
+
+    if(stats != NULL)
+        stats->print_seconds += jsmntree_writer_clock(stats) - start;
+
+    return writer.error ? -1 : 0;
+}
+
+int
+jsmntree_serialize_buffer(jsmntree_object * object, const jsmntree_format * format,
+                            jsmntree_buffer * buffer)
+{
+    jsmntree_stats *    stats   = jsmntree_get_stats(object);
+    const double        start   = jsmntree_writer_clock(stats);
+    jsmntree_writer     writer;
+
+    jsmntree_writer_init(&writer, buffer, format);
+    jsmntree_writer_object(&writer, object);
+
+    if(stats != NULL)
+        stats->print_seconds += jsmntree_writer_clock(stats) - start;
+
+    return writer.error ? -1 : 0;
+}
+
+int
+jsmntree_serialize_value(const jsmntree_element * element, const jsmntree_format * format,
+                            jsmntree_buffer * buffer)
+{
+    jsmntree_writer writer;
+
+    jsmntree_writer_init(&writer, buffer, format);
+    jsmntree_writer_value(&writer, &element->value, element->value_length, element->value_type);
+
+    return writer.error ? -1 : 0;
+}
+
+int
+jsmntree_fwrite_tree(FILE * stream, jsmntree_object * object, const jsmntree_format * format)
+{
+    jsmntree_stats *    stats   = jsmntree_get_stats(object);
+    const double        start   = jsmntree_writer_clock(stats);
+    jsmntree_buffer     buffer  = { NULL, 0, 0 };
+    jsmntree_writer     writer;
+    int                 ret     = 0;
+
+    jsmntree_writer_init(&writer, &buffer, format);
+    jsmntree_writer_object(&writer, object);
+    jsmntree_writer_putc(&writer, '\n');
+
+    if(writer.error || fwrite(buffer.data, 1, buffer.size, stream) != buffer.size)
+        ret = -1;
+
+    jsmntree_buffer_free(&buffer);
+
+    if(stats != NULL)
+        stats->print_seconds += jsmntree_writer_clock(stats) - start;
+
+    return ret;
+}
+
+int
+jsmntree_buffer_append(jsmntree_buffer * buffer, const char * data, const size_t length)
+{
+    jsmntree_writer writer;
+
+    jsmntree_writer_init(&writer, buffer, NULL);
+    jsmntree_writer_put(&writer, data, length);
+
+    return writer.error ? -1 : 0;
+}
+
+void
+jsmntree_buffer_free(jsmntree_buffer * buffer)
+{
+    if(buffer->data != NULL)
+        free(buffer->data);
+
+    buffer->data        = NULL;
+    buffer->size        = 0;
+    buffer->capacity    = 0;
+}
+
+void
+jsmntree_fprint_tree(FILE * stream, jsmntree_object * object)
+{
+    const jsmntree_format format = { JSMNTREE_FORMAT_SPACED, 0 };
+
+    jsmntree_fwrite_tree(stream, object, &format);
+}
+
+#undef JSMNTREE_WRITER_CHUNK
+#undef JSMNTREE_WRITER_PIECE
@@ -0,0 +1,270 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "jsmntree_stream.h"
+#include "jsmntree_private.h"
+#include "jsmn/jsmn.h"
+
+/**
+ * @param       options         Options records are made with
+ * @param       owns_arena      Whether `options.arena' belongs to the stream
+ * @param       callback        Called with each record
+ * @param       context         Context of `callback'
+ * @param       pending         Head of a record split across chunks
+ * @param       pending_size    Number of bytes in `pending'
+ * @param       pending_capacity    Allocated memory size of `pending'
+ * @param       tokens          Tokens of the current record
+ * @param       tokens_capacity Allocated number of `tokens'
+ * @param       depth           Depth of brackets in the input
+ * @param       record_depth    Depth records start at (1 in an array)
+ * @param       in_record       Whether a record is being read
+ * @param       in_string       Whether a string of a record is being read
+ * @param       escaped         Whether the last byte was a backslash
+ * @param       status          Nonzero once stopped or failed
+ */
+struct jsmntree_stream
+{
+    jsmntree_options        options;
+    int                     owns_arena;
+    jsmntree_record_fn      callback;
+    void *                  context;
+
+    char *                  pending;
+    size_t                  pending_size;
+    size_t                  pending_capacity;
+
+    jsmntok_t *             tokens;
+    unsigned int            tokens_capacity;
+
+    int                     depth;
+    int                     record_depth;
+    int                     in_record;
+    int                     in_string;
+    int                     escaped;
+    int                     status;
+};
+
+jsmntree_stream *
+jsmntree_stream_create(const jsmntree_options * options,
+                        jsmntree_record_fn callback, void * context)
+{
+    jsmntree_stream * stream = calloc(1, sizeof(jsmntree_stream));
+
+    if(stream == NULL)
+        return NULL;
+
+    if(options != NULL)
+        stream->options = *options;
+    else
+        jsmntree_options_init(&stream->options);
+
+    if((stream->options.flags & JSMNTREE_FLAG_ARENA) && stream->options.arena == NULL)
+    {
+        stream->options.arena = jsmntree_arena_create(64 * 1024);
+        if(stream->options.arena == NULL)
+        {
+            free(stream);
+            return NULL;
+        }
+
+        stream->owns_arena = 1;
+    }
+
+    stream->callback    = callback;
+    stream->context     = context;
+
+    return stream;
+}
+
+void
+jsmntree_stream_destroy(jsmntree_stream * stream)
+{
+    if(stream == NULL)
+        return;
+
+    if(stream->owns_arena)
+        jsmntree_arena_destroy(stream->options.arena);
+
+    free(stream->pending);
+    free(stream->tokens);
+    free(stream);
+}
+
+static int
+jsmntree_stream_append(jsmntree_stream * stream, const char * data, const size_t length)
+{
+    if(stream->pending_capacity - stream->pending_size < length)
+    {
+        size_t new_capacity = (stream->pending_capacity > 0) ? stream->pending_capacity : 4096;
+        while(new_capacity - stream->pending_size < length)
+            new_capacity *= 2;
+
+        char * new_pending = realloc(stream->pending, new_capacity);
+        if(new_pending == NULL)
+            return JSMN_ERROR_NOMEM;
+
+        stream->pending             = new_pending;
+        stream->pending_capacity    = new_capacity;
+    }
+
+    memcpy(stream->pending + stream->pending_size, data, length);
+    stream->pending_size += length;
+
+    return 0;
+}
+
+/* Parse a complete record, build its tree and hand it to the callback */
+static int
+jsmntree_stream_record(jsmntree_stream * stream, const char * js, const size_t len)
+{
+    /* The tokens are reused from record to record */
+    int r = jsmntree_parse_tokens(js, len, &stream->tokens, &stream->tokens_capacity);
+
+    if(r < 0)
+        return r;
+
+    jsmntree_object * record;
+
+    r = jsmntree_build_tree(js, len, stream->tokens, r, &stream->options, &record);
+    if(r != 0)
+    {
+        /* Whatever the record got of the arena is left there */
+        if(stream->options.flags & JSMNTREE_FLAG_ARENA)
+            jsmntree_arena_reset(stream->options.arena);
+        return r;
+    }
+
+    int stop = stream->callback(stream->context, record);
+
+    jsmntree_free_tree(record);
+    if(stream->options.flags & JSMNTREE_FLAG_ARENA)
+        jsmntree_arena_reset(stream->options.arena);
+
+    return (stop != 0) ? 1 : 0;
+}
+
+int
+jsmntree_stream_feed(jsmntree_stream * stream, const char * data, const size_t length)
+{
+    if(stream->status != 0)
+        return stream->status;
+
+    /* Where the record being read starts in this chunk */
+    size_t  begin   = 0;
+    size_t  i;
+
+    for(i = 0; i < length; ++i)
+    {
+        const char c = data[i];
+
+        if(stream->in_record)
+        {
+            if(stream->in_string)
+            {
+                if(stream->escaped)
+                    stream->escaped = 0;
+                else if(c == '\\')
+                    stream->escaped = 1;
+                else if(c == '"')
+                    stream->in_string = 0;
+                continue;
+            }
+
+            switch(c)
+            {
+            case '"':
+                stream->in_string = 1;
+                break;
+
+            case '{':
+            case '[':
+                ++stream->depth;
+                break;
+
+            case '}':
+            case ']':
+                if(--stream->depth == stream->record_depth)
+                {
+                    int r;
+
+                    stream->in_record = 0;
+
+                    if(stream->pending_size > 0)
+                    {
+                        /* The record started in an earlier chunk */
+                        r = jsmntree_stream_append(stream, data + begin, i + 1 - begin);
+                        if(r == 0)
+                            r = jsmntree_stream_record(stream, stream->pending, stream->pending_size);
+                        stream->pending_size = 0;
+                    }
+                    else
+                        r = jsmntree_stream_record(stream, data + begin, i + 1 - begin);
+
+                    if(r != 0)
+                        return stream->status = r;
+                }
+                break;
+            }
+            continue;
+        }
+
+        /* Between records */
+        switch(c)
+        {
+        case ' ':
+        case '\t':
+        case '\r':
+        case '\n':
+        case ',':
+            break;
+
+        case '[':
+            if(stream->depth != 0)
+                return stream->status = JSMNTREE_ERROR_INVTOK;
+
+            /* Records are the elements of a top-level array */
+            stream->depth           = 1;
+            stream->record_depth    = 1;
+            break;
+
+        case ']':
+            if(stream->depth != 1)
+                return stream->status = JSMN_ERROR_INVAL;
+
+            stream->depth           = 0;
+            stream->record_depth    = 0;
+            break;
+
+        case '{':
+            stream->in_record       = 1;
+            ++stream->depth;
+            begin                   = i;
+            break;
+
+        default:
+            return stream->status = JSMNTREE_ERROR_INVTOK;
+        }
+    }
+
+    /* Keep the head of a record which goes on in the next chunk */
+    if(stream->in_record)
+    {
+        int r = jsmntree_stream_append(stream, data + begin, length - begin);
+        if(r != 0)
+            return stream->status = r;
+    }
+
+    return 0;
+}
+
+int
+jsmntree_stream_finish(jsmntree_stream * stream)
+{
+    if(stream->status < 0)
+        return stream->status;
+
+    if(stream->in_record || stream->depth != 0)
+        return JSMN_ERROR_PART;
+
+    return 0;
+}
@@ -0,0 +1,60 @@
+#ifndef JSMNTREE_STREAM_H_
+#define JSMNTREE_STREAM_H_ 1
+
+#include <stddef.h>
+#include "jsmntree.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+
+/**
+ * A streaming tree builder. JSON text is fed to it in chunks of any size,
+ * and a tree is made for each record as soon as the record is complete.
+ * A record is a top-level object, or an object element of a top-level
+ * array; so both a stream of objects (e.g. newline-delimited JSON) and
+ * one large array of objects are handled. Only the record being read is
+ * kept in memory. Opaque; see jsmntree_stream_create().
+ */
+typedef struct jsmntree_stream jsmntree_stream;
+
+/**
+ * Called with the tree of each record. The tree is freed when this
+ * returns. Returns 0 to go on, or anything else to stop the stream.
+ */
+typedef int (*jsmntree_record_fn)(void * context, jsmntree_object * record);
+
+/**
+ * Create a streaming builder. Records are made with `options', which may
+ * be NULL. With JSMNTREE_FLAG_ARENA, every record is built in the same
+ * arena, which is reset after each record.
+ */
+jsmntree_stream *
+jsmntree_stream_create(const jsmntree_options * options,
+                        jsmntree_record_fn callback, void * context);
+
+/**
+ * Feed the next chunk of JSON text.
+ * @return      0 on success, 1 if the callback stopped the stream,
+ *              JSMN_ERROR_NOMEM, JSMN_ERROR_INVAL on a malformed record,
+ *              or JSMNTREE_ERROR_INVTOK on a record which is not an object
+ */
+int jsmntree_stream_feed(jsmntree_stream * stream, const char * data, const size_t length);
+
+/**
+ * Tell the end of the input.
+ * @return      0 on success, or JSMN_ERROR_PART if a record is incomplete
+ */
+int jsmntree_stream_finish(jsmntree_stream * stream);
+
+/**
+ * Release a streaming builder.
+ */
+void jsmntree_stream_destroy(jsmntree_stream * stream);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* ! JSMNTREE_STREAM_H_ */
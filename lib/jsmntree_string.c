@@ -0,0 +1,456 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "jsmntree.h"
+
+/*
+ * The scanning kernels are picked at run time: AVX2 if the CPU has it,
+ * else SSE2, which every x86-64 CPU has. Define JSMNTREE_NO_SIMD to build
+ * the scalar one only.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+        defined(__SSE2__) && !defined(JSMNTREE_NO_SIMD)
+#define JSMNTREE_STRING_SIMD    1
+#include <immintrin.h>
+#endif
+
+/**
+ * Find the first byte of a string a kernel stops at: '"', '\\' or a
+ * control character, and any byte of a non-ASCII character too if
+ * `non_ascii' is set.
+ * @return      Index of the byte, or `length' if there is none
+ */
+typedef size_t (*jsmntree_scan_fn)(const char * string, const size_t length, const int non_ascii);
+
+static size_t
+jsmntree_scan_scalar(const char * string, const size_t length, const int non_ascii)
+{
+    size_t i;
+
+    for(i = 0; i < length; ++i)
+    {
+        const unsigned char c = (unsigned char)string[i];
+
+        if(c < 0x20 || c == '"' || c == '\\' || (non_ascii && c >= 0x80))
+            break;
+    }
+
+    return i;
+}
+
+#ifdef JSMNTREE_STRING_SIMD
+static size_t
+jsmntree_scan_sse2(const char * string, const size_t length, const int non_ascii)
+{
+    const __m128i   quote       = _mm_set1_epi8('"');
+    const __m128i   backslash   = _mm_set1_epi8('\\');
+    const __m128i   space       = _mm_set1_epi8(0x20);
+    const __m128i   control     = _mm_set1_epi8(0x1F);
+    size_t          i;
+
+    for(i = 0; i + 16 <= length; i += 16)
+    {
+        const __m128i   v       = _mm_loadu_si128((const __m128i *)(string + i));
+        __m128i         stop    = _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash));
+
+        /* Signed, bytes from 0x80 on are below ' ' too */
+        if(non_ascii)
+            stop = _mm_or_si128(stop, _mm_cmplt_epi8(v, space));
+        else
+            stop = _mm_or_si128(stop, _mm_cmpeq_epi8(_mm_min_epu8(v, control), v));
+
+        const int mask = _mm_movemask_epi8(stop);
+        if(mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+
+    return i + jsmntree_scan_scalar(string + i, length - i, non_ascii);
+}
+
+__attribute__((target("avx2")))
+static size_t
+jsmntree_scan_avx2(const char * string, const size_t length, const int non_ascii)
+{
+    const __m256i   quote       = _mm256_set1_epi8('"');
+    const __m256i   backslash   = _mm256_set1_epi8('\\');
+    const __m256i   space       = _mm256_set1_epi8(0x20);
+    const __m256i   control     = _mm256_set1_epi8(0x1F);
+    size_t          i;
+
+    for(i = 0; i + 32 <= length; i += 32)
+    {
+        const __m256i   v       = _mm256_loadu_si256((const __m256i *)(string + i));
+        __m256i         stop    = _mm256_or_si256(_mm256_cmpeq_epi8(v, quote),
+                                                    _mm256_cmpeq_epi8(v, backslash));
+
+        if(non_ascii)
+            stop = _mm256_or_si256(stop, _mm256_cmpgt_epi8(space, v));
+        else
+            stop = _mm256_or_si256(stop, _mm256_cmpeq_epi8(_mm256_min_epu8(v, control), v));
+
+        const unsigned int mask = (unsigned int)_mm256_movemask_epi8(stop);
+        if(mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+
+    /* The SSE2 kernel is not VEX-encoded: clear the upper halves first */
+    _mm256_zeroupper();
+
+    return i + jsmntree_scan_sse2(string + i, length - i, non_ascii);
+}
+#endif /* JSMNTREE_STRING_SIMD */
+
+static size_t jsmntree_scan_init(const char *, const size_t, const int);
+
+/* The kernel in use; picked by the first call */
+static jsmntree_scan_fn jsmntree_scan_kernel = jsmntree_scan_init;
+
+static size_t
+jsmntree_scan_init(const char * string, const size_t length, const int non_ascii)
+{
+    jsmntree_scan_fn kernel = jsmntree_scan_scalar;
+
+#ifdef JSMNTREE_STRING_SIMD
+    __builtin_cpu_init();
+    kernel = __builtin_cpu_supports("avx2") ? jsmntree_scan_avx2 : jsmntree_scan_sse2;
+#endif /* JSMNTREE_STRING_SIMD */
+
+    __atomic_store_n(&jsmntree_scan_kernel, kernel, __ATOMIC_RELAXED);
+
+    return kernel(string, length, non_ascii);
+}
+
+static size_t
+jsmntree_scan(const char * string, const size_t length, const int non_ascii)
+{
+    /* Most names and short strings never fill a vector */
+    if(length < 16)
+        return jsmntree_scan_scalar(string, length, non_ascii);
+
+    return __atomic_load_n(&jsmntree_scan_kernel, __ATOMIC_RELAXED)(string, length, non_ascii);
+}
+
+/**
+ * Length of the UTF-8 sequence of a non-ASCII character at the start of
+ * `p', or 0 if it is not well-formed: truncated, overlong, a surrogate,
+ * or above U+10FFFF.
+ */
+static size_t
+jsmntree_utf8_sequence(const unsigned char * p, const size_t length)
+{
+    const unsigned char c       = p[0];
+    unsigned char       low     = 0x80;     /* Bounds of the second byte */
+    unsigned char       high    = 0xBF;
+    size_t              n;
+    size_t              i;
+
+    if(c >= 0xC2 && c <= 0xDF)
+        n = 2;
+    else if(c >= 0xE0 && c <= 0xEF)
+    {
+        n = 3;
+        if(c == 0xE0)
+            low = 0xA0;
+        else if(c == 0xED)
+            high = 0x9F;
+    }
+    else if(c >= 0xF0 && c <= 0xF4)
+    {
+        n = 4;
+        if(c == 0xF0)
+            low = 0x90;
+        else if(c == 0xF4)
+            high = 0x8F;
+    }
+    else
+        return 0;
+
+    if(length < n || p[1] < low || p[1] > high)
+        return 0;
+
+    for(i = 2; i < n; ++i)
+        if((p[i] & 0xC0) != 0x80)
+            return 0;
+
+    return n;
+}
+
+/* Value of the 4 hexadecimal digits of a "\uXXXX" escape, or -1 */
+static long
+jsmntree_hex4(const char * p)
+{
+    long    value   = 0;
+    int     i;
+
+    for(i = 0; i < 4; ++i)
+    {
+        const char c = p[i];
+
+        value <<= 4;
+        if(c >= '0' && c <= '9')
+            value |= c - '0';
+        else if(c >= 'a' && c <= 'f')
+            value |= c - 'a' + 10;
+        else if(c >= 'A' && c <= 'F')
+            value |= c - 'A' + 10;
+        else
+            return -1;
+    }
+
+    return value;
+}
+
+/* Encode a code point in UTF-8; returns the number of bytes */
+static size_t
+jsmntree_utf8_encode(const unsigned long code, char * out)
+{
+    if(code < 0x80)
+    {
+        out[0] = (char)code;
+        return 1;
+    }
+
+    if(code < 0x800)
+    {
+        out[0] = (char)(0xC0 | (code >> 6));
+        out[1] = (char)(0x80 | (code & 0x3F));
+        return 2;
+    }
+
+    if(code < 0x10000)
+    {
+        out[0] = (char)(0xE0 | (code >> 12));
+        out[1] = (char)(0x80 | ((code >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (code & 0x3F));
+        return 3;
+    }
+
+    out[0] = (char)(0xF0 | (code >> 18));
+    out[1] = (char)(0x80 | ((code >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((code >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (code & 0x3F));
+    return 4;
+}
+
+/* U+FFFD, which stands for what is not valid in a lossy decoding */
+static const char jsmntree_replacement[3] = { (char)0xEF, (char)0xBF, (char)0xBD };
+
+/**
+ * Decode the escapes of a string. Unless `lossy', the decoding stops at
+ * the first malformed escape or byte which is not UTF-8; otherwise they
+ * are replaced by U+FFFD and the decoding goes on.
+ * @return      Length of the decoded string, or (size_t)-1
+ */
+static size_t
+jsmntree_unescape(const char * string, const size_t length, char * dst, const int lossy)
+{
+    const char *    p       = string;
+    const char *    end     = string + length;
+    char *          out     = dst;
+
+    while(p < end)
+    {
+        /* Plain ASCII is copied as a whole */
+        const size_t run = jsmntree_scan(p, end - p, 1);
+
+        memmove(out, p, run);
+        out    += run;
+        p      += run;
+
+        if(p == end)
+            break;
+
+        if((unsigned char)*p >= 0x80)
+        {
+            const size_t n = jsmntree_utf8_sequence((const unsigned char *)p, end - p);
+
+            if(n == 0)
+            {
+                if(!lossy)
+                    return (size_t)-1;
+
+                /* Each byte of it on its own */
+                memcpy(out, jsmntree_replacement, 3);
+                out    += 3;
+                ++p;
+                continue;
+            }
+
+            memmove(out, p, n);
+            out    += n;
+            p      += n;
+            continue;
+        }
+
+        if(*p != '\\')
+        {
+            /* A '"' or a control character, left to the tokenizer */
+            *out++ = *p++;
+            continue;
+        }
+
+        switch((end - p < 2) ? '\0' : p[1])
+        {
+        case '"':   *out++ = '"';   break;
+        case '\\':  *out++ = '\\';  break;
+        case '/':   *out++ = '/';   break;
+        case 'b':   *out++ = '\b';  break;
+        case 'f':   *out++ = '\f';  break;
+        case 'n':   *out++ = '\n';  break;
+        case 'r':   *out++ = '\r';  break;
+        case 't':   *out++ = '\t';  break;
+
+        case 'u':
+            {
+                long code = (end - p >= 6) ? jsmntree_hex4(p + 2) : -1;
+
+                if(code < 0)
+                {
+                    if(!lossy)
+                        return (size_t)-1;
+
+                    /* As any other malformed escape */
+                    memcpy(out, jsmntree_replacement, 3);
+                    out    += 3;
+                    ++p;
+                    continue;
+                }
+
+                /* A high surrogate must be followed by a low one */
+                if(code >= 0xD800 && code <= 0xDBFF)
+                {
+                    const long low = (end - p >= 12 && p[6] == '\\' && p[7] == 'u')
+                                        ? jsmntree_hex4(p + 8) : -1;
+
+                    if(low >= 0xDC00 && low <= 0xDFFF)
+                    {
+                        code    = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                        p      += 6;
+                    }
+                    else
+                        code    = -1;
+                }
+                else if(code >= 0xDC00 && code <= 0xDFFF)
+                    code = -1;
+
+                /* A lone surrogate is replaced as a whole */
+                if(code < 0)
+                {
+                    if(!lossy)
+                        return (size_t)-1;
+
+                    memcpy(out, jsmntree_replacement, 3);
+                    out    += 3;
+                }
+                else
+                    out    += jsmntree_utf8_encode((unsigned long)code, out);
+
+                p      += 6;
+            }
+            continue;
+
+        default:
+            if(!lossy)
+                return (size_t)-1;
+
+            /* Only the backslash; what follows it is read as it is */
+            memcpy(out, jsmntree_replacement, 3);
+            out    += 3;
+            ++p;
+            continue;
+        }
+
+        p += 2;
+    }
+
+    return out - dst;
+}
+
+size_t
+jsmntree_string_unescape(const char * string, const size_t length, char * dst)
+{
+    return jsmntree_unescape(string, length, dst, 0);
+}
+
+size_t
+jsmntree_string_unescape_lossy(const char * string, const size_t length, char * dst)
+{
+    return jsmntree_unescape(string, length, dst, 1);
+}
+
+int
+jsmntree_string_validate(const char * string, const size_t length)
+{
+    const char *    p   = string;
+    const char *    end = string + length;
+
+    while(p < end)
+    {
+        p += jsmntree_scan(p, end - p, 1);
+        if(p == end)
+            break;
+
+        if((unsigned char)*p < 0x80)
+        {
+            ++p;
+            continue;
+        }
+
+        const size_t n = jsmntree_utf8_sequence((const unsigned char *)p, end - p);
+        if(n == 0)
+            return -1;
+
+        p += n;
+    }
+
+    return 0;
+}
+
+size_t
+jsmntree_string_escape(const char * string, const size_t length, char * dst)
+{
+    static const char   hex[]   = "0123456789abcdef";
+    const char *        p       = string;
+    const char *        end     = string + length;
+    char *              out     = dst;
+
+    while(p < end)
+    {
+        const size_t run = jsmntree_scan(p, end - p, 0);
+
+        memcpy(out, p, run);
+        out    += run;
+        p      += run;
+
+        if(p == end)
+            break;
+
+        const unsigned char c = (unsigned char)*p++;
+
+        *out++ = '\\';
+        switch(c)
+        {
+        case '"':   *out++ = '"';   break;
+        case '\\':  *out++ = '\\';  break;
+        case '\b':  *out++ = 'b';   break;
+        case '\f':  *out++ = 'f';   break;
+        case '\n':  *out++ = 'n';   break;
+        case '\r':  *out++ = 'r';   break;
+        case '\t':  *out++ = 't';   break;
+
+        default:
+            out[0]  = 'u';
+            out[1]  = '0';
+            out[2]  = '0';
+            out[3]  = hex[c >> 4];
+            out[4]  = hex[c & 0xF];
+            out    += 5;
+            break;
+        }
+    }
+
+    return out - dst;
+}
+
+#undef JSMNTREE_STRING_SIMD
@@ -0,0 +1,517 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "jsmntree_tape.h"
+#include "jsmntree_private.h"
+#include "jsmn/jsmn.h"
+#include "algorithm/adt/stack.h"
+
+static void
+jsmntree_tape_set_primitive(jsmntree_tape_node * node, const char * js, const jsmntok_t * token)
+{
+    jsmntree_value value;
+
+    node->type      = jsmntree_decode_primitive(js, token, &value);
+    node->offset    = 0;
+
+    switch(node->type)
+    {
+    case JSMNTREE_NUMBER:
+        node->value.integer     = value.integer;
+        break;
+
+    case JSMNTREE_UNSIGNED:
+        node->value.uinteger    = value.uinteger;
+        break;
+
+    case JSMNTREE_REAL:
+        node->value.real        = value.real;
+        break;
+
+    case JSMNTREE_BOOLEAN:
+        node->value.integer     = value.boolean;
+        break;
+
+    default:
+        node->value.integer     = 0;
+        break;
+    }
+}
+
+jsmntree_tape *
+jsmntree_tape_make(const char * js, const size_t len,
+                    const jsmntok_t * tokens, const unsigned int num_tokens)
+{
+    unsigned int    count           = 0;
+    size_t          strings_size    = 0;
+
+    /* Count nodes and bytes of the string table */
+    for(count = 0; count < num_tokens && tokens[count].type != JSMN_UNDEFINED; ++count)
+    {
+        if(tokens[count].type == JSMN_STRING)
+            strings_size += tokens[count].end - tokens[count].start + 1;
+    }
+
+    /*
+     * Strings are slices of `js' with a NUL each: if these fit in 32-bit
+     * offsets, so does the string table, replacements aside
+     */
+    if(count == 0 || len > UINT32_MAX - count)
+        return NULL;
+
+    jsmntree_tape *         tape    = malloc(sizeof(jsmntree_tape)
+                                            + sizeof(jsmntree_tape_node) * count
+                                            + strings_size);
+    if(tape == NULL)
+        return NULL;
+
+    tape->num_nodes                 = count;
+    tape->strings_size              = strings_size;
+
+    jsmntree_tape_node *    nodes   = JSMNTREE_TAPE_NODES(tape);
+    char *                  strings = JSMNTREE_TAPE_STRINGS(tape);
+    uint32_t                offset  = 0;
+
+    /* Open objects, arrays and members whose `end' is not known yet */
+    adt_stack *             s       = adt_stack_create(sizeof(uint32_t));
+    if(s == NULL)
+    {
+        free(tape);
+        return NULL;
+    }
+
+    uint32_t i;
+    for(i = 0; i < count; ++i)
+    {
+        /* Close containers ended before this token, and their members */
+        while(adt_stack_size(s) > 0)
+        {
+            uint32_t top = *(uint32_t *)adt_stack_top(s);
+
+            if(nodes[top].type == JSMNTREE_MEMBER ||
+                    tokens[i].start < tokens[top].end)
+                break;
+
+            nodes[top].end = i;
+            adt_stack_pop(s);
+
+            if(adt_stack_size(s) > 0)
+            {
+                uint32_t parent = *(uint32_t *)adt_stack_top(s);
+                if(nodes[parent].type == JSMNTREE_MEMBER)
+                {
+                    nodes[parent].end = i;
+                    adt_stack_pop(s);
+                }
+            }
+        }
+
+        jsmntree_tape_node *    node    = &nodes[i];
+        int                     parent  = -1;
+
+        if(adt_stack_size(s) > 0)
+            parent = *(uint32_t *)adt_stack_top(s);
+
+        switch(tokens[i].type)
+        {
+        case JSMN_OBJECT:
+            node->type          = JSMNTREE_OBJECT;
+            node->size          = tokens[i].size;
+            node->offset        = 0;
+            node->value.integer = 0;
+            adt_stack_push(s, &i);
+            continue;
+
+        case JSMN_ARRAY:
+            node->type          = JSMNTREE_ARRAY;
+            node->size          = tokens[i].size;
+            node->offset        = 0;
+            node->value.integer = 0;
+            adt_stack_push(s, &i);
+            continue;
+
+        case JSMN_STRING:
+            node->type          = (parent >= 0 && nodes[parent].type == JSMNTREE_OBJECT)
+                                    ? JSMNTREE_MEMBER : JSMNTREE_STRING;
+            node->offset        = offset;
+            node->value.integer = 0;
+
+            /* Decoded strings are never longer, unless they are not valid */
+            {
+                const size_t    raw_length  = tokens[i].end - tokens[i].start;
+                size_t          room        = raw_length + 1;
+                size_t          length      = jsmntree_string_unescape(&js[tokens[i].start], raw_length,
+                                                                        &strings[offset]);
+
+                if(length == (size_t)-1)
+                {
+                    /* The string table grows for the replacements */
+                    const size_t    grow        = JSMNTREE_UNESCAPED_MAX(raw_length) + 1 - room;
+                    jsmntree_tape * new_tape    = NULL;
+
+                    if(tape->strings_size + grow <= UINT32_MAX)
+                        new_tape = realloc(tape, sizeof(jsmntree_tape) + sizeof(jsmntree_tape_node) * count
+                                                    + tape->strings_size + grow);
+                    if(new_tape == NULL)
+                    {
+                        adt_stack_destroy(s);
+                        free(tape);
+                        return NULL;
+                    }
+
+                    tape                = new_tape;
+                    tape->strings_size += grow;
+                    room               += grow;
+                    nodes               = JSMNTREE_TAPE_NODES(tape);
+                    strings             = JSMNTREE_TAPE_STRINGS(tape);
+                    node                = &nodes[i];
+
+                    length = jsmntree_string_unescape_lossy(&js[tokens[i].start], raw_length,
+                                                            &strings[offset]);
+                }
+
+                node->size = length;
+                strings[offset + length] = '\0';
+                offset += room;
+            }
+
+            if(node->type == JSMNTREE_MEMBER)
+            {
+                /* Its end is the end of its value */
+                adt_stack_push(s, &i);
+                continue;
+            }
+            break;
+
+        case JSMN_PRIMITIVE:
+            node->size          = 0;
+            jsmntree_tape_set_primitive(node, js, &tokens[i]);
+            break;
+
+        default:
+            break;
+        }
+
+        /* A scalar ends right here, and so does its member */
+        node->end = i + 1;
+
+        if(parent >= 0 && nodes[parent].type == JSMNTREE_MEMBER)
+        {
+            nodes[parent].end = i + 1;
+            adt_stack_pop(s);
+        }
+    }
+
+    /* Close what is left open at the end of the document */
+    while(adt_stack_size(s) > 0)
+    {
+        nodes[*(uint32_t *)adt_stack_top(s)].end = count;
+        adt_stack_pop(s);
+    }
+
+    adt_stack_destroy(s);
+
+    return tape;
+}
+
+/**
+ * State of making a tape from a tree.
+ * @param       nodes       Nodes, or NULL to count only
+ * @param       strings     String table, or NULL to count only
+ * @param       num_nodes   Number of nodes so far
+ * @param       strings_size    Bytes of the string table so far
+ * @param       error       Nonzero if out of memory
+ */
+typedef struct
+{
+    jsmntree_tape_node *    nodes;
+    char *                  strings;
+    size_t                  num_nodes;
+    size_t                  strings_size;
+    int                     error;
+}
+jsmntree_tape_writer;
+
+static void
+jsmntree_tape_put_string(jsmntree_tape_writer * writer, const jsmntreetype_t type,
+                            const char * string, const size_t length)
+{
+    if(writer->nodes != NULL)
+    {
+        jsmntree_tape_node * node = &writer->nodes[writer->num_nodes];
+
+        node->type          = type;
+        node->size          = length;
+        node->offset        = writer->strings_size;
+        node->value.integer = 0;
+
+        memcpy(&writer->strings[writer->strings_size], string, length);
+        writer->strings[writer->strings_size + length] = '\0';
+    }
+
+    ++writer->num_nodes;
+    writer->strings_size += length + 1;
+}
+
+/* Put a value and its subtree; members are a name node and a value */
+static void
+jsmntree_tape_put_value(jsmntree_tape_writer * writer, const jsmntree_value * value,
+                        const size_t value_length, const jsmntreetype_t value_type)
+{
+    const size_t            index   = writer->num_nodes;
+    jsmntree_tape_node *    node    = (writer->nodes != NULL) ? &writer->nodes[index] : NULL;
+    size_t                  i;
+
+    switch(value_type)
+    {
+    case JSMNTREE_OBJECT:
+        {
+            jsmntree_object * object = value->pointer;
+
+            if(jsmntree_object_expand(object) < 0)
+            {
+                writer->error = 1;
+                return;
+            }
+
+            ++writer->num_nodes;
+            for(i = 0; i < object->size && !writer->error; ++i)
+            {
+                const jsmntree_member * member  = &object->members[i];
+                const size_t            name    = writer->num_nodes;
+
+                jsmntree_tape_put_string(writer, JSMNTREE_MEMBER, member->name, member->name_length);
+                jsmntree_tape_put_value(writer, &member->value, member->value_length, member->value_type);
+
+                if(writer->nodes != NULL)
+                    writer->nodes[name].end = writer->num_nodes;
+            }
+
+            if(node != NULL)
+            {
+                node->type          = JSMNTREE_OBJECT;
+                node->size          = object->size;
+                node->offset        = 0;
+                node->value.integer = 0;
+            }
+        }
+        break;
+
+    case JSMNTREE_ARRAY:
+        {
+            jsmntree_array * array = value->pointer;
+
+            if(jsmntree_array_expand(array) < 0)
+            {
+                writer->error = 1;
+                return;
+            }
+
+            ++writer->num_nodes;
+            for(i = 0; i < array->size && !writer->error; ++i)
+            {
+                const jsmntree_element * element = &array->elements[i];
+                jsmntree_tape_put_value(writer, &element->value, element->value_length, element->value_type);
+            }
+
+            if(node != NULL)
+            {
+                node->type          = JSMNTREE_ARRAY;
+                node->size          = array->size;
+                node->offset        = 0;
+                node->value.integer = 0;
+            }
+        }
+        break;
+
+    case JSMNTREE_STRING:
+        jsmntree_tape_put_string(writer, JSMNTREE_STRING, JSMNTREE_VALUE_STRING(value, value_length),
+                                    value_length);
+        break;
+
+    default:
+        ++writer->num_nodes;
+        if(node != NULL)
+        {
+            node->type          = value_type;
+            node->size          = 0;
+            node->offset        = 0;
+
+            switch(value_type)
+            {
+            case JSMNTREE_NUMBER:
+            case JSMNTREE_UNSIGNED:
+            case JSMNTREE_REAL:
+                node->value.uinteger    = value->uinteger;
+                break;
+
+            case JSMNTREE_BOOLEAN:
+                node->value.integer     = value->boolean;
+                break;
+
+            default:
+                node->value.integer     = 0;
+                break;
+            }
+        }
+        break;
+    }
+
+    if(node != NULL)
+        node->end = writer->num_nodes;
+}
+
+jsmntree_tape *
+jsmntree_tape_make_tree(jsmntree_object * object)
+{
+    jsmntree_tape_writer    writer  = { NULL, NULL, 0, 0, 0 };
+    jsmntree_value          root;
+
+    root.pointer = object;
+
+    /* Count nodes and bytes of the string table, then fill them */
+    jsmntree_tape_put_value(&writer, &root, 0, JSMNTREE_OBJECT);
+    if(writer.error || writer.num_nodes > UINT32_MAX || writer.strings_size > UINT32_MAX)
+        return NULL;
+
+    jsmntree_tape * tape = malloc(sizeof(jsmntree_tape)
+                                    + sizeof(jsmntree_tape_node) * writer.num_nodes
+                                    + writer.strings_size);
+    if(tape == NULL)
+        return NULL;
+
+    tape->num_nodes     = writer.num_nodes;
+    tape->strings_size  = writer.strings_size;
+
+    writer.nodes        = JSMNTREE_TAPE_NODES(tape);
+    writer.strings      = JSMNTREE_TAPE_STRINGS(tape);
+    writer.num_nodes    = 0;
+    writer.strings_size = 0;
+
+    jsmntree_tape_put_value(&writer, &root, 0, JSMNTREE_OBJECT);
+
+    return tape;
+}
+
+void
+jsmntree_tape_free(jsmntree_tape * tape)
+{
+    if(tape != NULL)
+        free(tape);
+}
+
+size_t
+jsmntree_tape_size(const jsmntree_tape * tape)
+{
+    return sizeof(jsmntree_tape)
+            + sizeof(jsmntree_tape_node) * tape->num_nodes
+            + tape->strings_size;
+}
+
+const char *
+jsmntree_tape_string(const jsmntree_tape * tape, const jsmntree_tape_node * node)
+{
+    return JSMNTREE_TAPE_STRINGS(tape) + node->offset;
+}
+
+/* Append a string escaped, piece by piece through a buffer on the stack */
+static int
+jsmntree_tape_put_escaped(jsmntree_buffer * buffer, const char * string, const size_t length)
+{
+    char    escaped[JSMNTREE_ESCAPED_MAX(256)];
+    size_t  done    = 0;
+    int     r       = jsmntree_buffer_append(buffer, "\"", 1);
+
+    while(r == 0 && done < length)
+    {
+        const size_t piece = (length - done < 256) ? length - done : 256;
+
+        r       = jsmntree_buffer_append(buffer, escaped, jsmntree_string_escape(string + done, piece, escaped));
+        done   += piece;
+    }
+
+    return (r == 0) ? jsmntree_buffer_append(buffer, "\"", 1) : r;
+}
+
+/**
+ * Append node `index' and its subtree to `buffer', as jsmntree_fprint_tree()
+ * writes a tree.
+ * @return      0 on success, -1 if out of memory
+ */
+static int
+jsmntree_tape_put_node(jsmntree_buffer * buffer, const jsmntree_tape * tape, const uint32_t index)
+{
+    const jsmntree_tape_node *  nodes   = JSMNTREE_TAPE_NODES(tape);
+    const jsmntree_tape_node *  node    = &nodes[index];
+    char                        digits[JSMNTREE_REAL_MAX];
+    uint32_t                    i;
+    int                         r       = 0;
+
+    switch(node->type)
+    {
+    case JSMNTREE_OBJECT:
+        r = jsmntree_buffer_append(buffer, "{ ", 2);
+        for(i = JSMNTREE_TAPE_FIRST(tape, index); r == 0 && i < node->end; i = JSMNTREE_TAPE_NEXT(tape, i))
+        {
+            r = jsmntree_tape_put_escaped(buffer, jsmntree_tape_string(tape, &nodes[i]), nodes[i].size);
+            if(r == 0)
+                r = jsmntree_buffer_append(buffer, ": ", 2);
+            if(r == 0)
+                r = jsmntree_tape_put_node(buffer, tape, i + 1);
+
+            if(r == 0 && nodes[i].end < node->end)
+                r = jsmntree_buffer_append(buffer, ", ", 2);
+        }
+        return (r == 0) ? jsmntree_buffer_append(buffer, " }", 2) : r;
+
+    case JSMNTREE_ARRAY:
+        r = jsmntree_buffer_append(buffer, "[ ", 2);
+        for(i = JSMNTREE_TAPE_FIRST(tape, index); r == 0 && i < node->end; i = JSMNTREE_TAPE_NEXT(tape, i))
+        {
+            r = jsmntree_tape_put_node(buffer, tape, i);
+
+            if(r == 0 && nodes[i].end < node->end)
+                r = jsmntree_buffer_append(buffer, ", ", 2);
+        }
+        return (r == 0) ? jsmntree_buffer_append(buffer, " ]", 2) : r;
+
+    case JSMNTREE_STRING:
+        return jsmntree_tape_put_escaped(buffer, jsmntree_tape_string(tape, node), node->size);
+
+    case JSMNTREE_NUMBER:
+        return jsmntree_buffer_append(buffer, digits,
+                                        snprintf(digits, sizeof(digits), "%" PRId64, node->value.integer));
+
+    case JSMNTREE_UNSIGNED:
+        return jsmntree_buffer_append(buffer, digits,
+                                        snprintf(digits, sizeof(digits), "%" PRIu64, node->value.uinteger));
+
+    case JSMNTREE_REAL:
+        /* As a tree writes it */
+        return jsmntree_buffer_append(buffer, digits, jsmntree_format_real(node->value.real, digits));
+
+    case JSMNTREE_BOOLEAN:
+        return (node->value.integer == 0) ? jsmntree_buffer_append(buffer, "false", 5)
+                                            : jsmntree_buffer_append(buffer, "true", 4);
+
+    default:
+        return jsmntree_buffer_append(buffer, "null", 4);
+    }
+}
+
+void
+jsmntree_tape_fprint(FILE * stream, const jsmntree_tape * tape)
+{
+    jsmntree_buffer buffer = { NULL, 0, 0 };
+
+    if(tape == NULL)
+        return;
+
+    /* Written at once, as a tree is */
+    if(jsmntree_tape_put_node(&buffer, tape, 0) == 0 && jsmntree_buffer_append(&buffer, "\n", 1) == 0)
+        fwrite(buffer.data, 1, buffer.size, stream);
+
+    jsmntree_buffer_free(&buffer);
+}
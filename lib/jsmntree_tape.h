@@ -0,0 +1,115 @@
+#ifndef JSMNTREE_TAPE_H_
+#define JSMNTREE_TAPE_H_ 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "jsmntree.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+
+/**
+ * A node of a tape. A tape holds a whole JSON document as one array of
+ * nodes in document order, so that a subtree is a contiguous run of
+ * nodes. A member of an object is a JSMNTREE_MEMBER node holding the
+ * name, followed by the value.
+ * @param       type        Type of the node (jsmntreetype_t)
+ * @param       size        Object: number of members
+ *                          Array: number of elements
+ *                          String, member: length of the string
+ * @param       end         Index of the node right after this subtree
+ * @param       offset      String, member: offset in the string table
+ * @param       value       Number, unsigned, real, boolean: the value
+ */
+typedef struct
+{
+    uint32_t            type;
+    uint32_t            size;
+    uint32_t            end;
+    uint32_t            offset;
+    union
+    {
+        int64_t         integer;
+        uint64_t        uinteger;
+        double          real;
+    }
+    value;
+}
+jsmntree_tape_node;
+
+/**
+ * A tape. The nodes and then the string table follow this header in the
+ * same block, and nodes refer to each other and to the strings by index
+ * and offset only; a tape can be copied with memcpy() as a whole.
+ * @param       num_nodes       Number of nodes
+ * @param       strings_size    Size of the string table in bytes
+ */
+typedef struct
+{
+    uint32_t            num_nodes;
+    uint32_t            strings_size;
+}
+jsmntree_tape;
+
+/* Array of nodes of a tape */
+#define JSMNTREE_TAPE_NODES(tape) \
+    ((jsmntree_tape_node *)((jsmntree_tape *)(tape) + 1))
+
+/* String table of a tape */
+#define JSMNTREE_TAPE_STRINGS(tape) \
+    ((char *)(JSMNTREE_TAPE_NODES(tape) + (tape)->num_nodes))
+
+/* Index of the first child of node `index' (members, elements) */
+#define JSMNTREE_TAPE_FIRST(tape, index)    ((index) + 1)
+
+/* Index of the next sibling of node `index' */
+#define JSMNTREE_TAPE_NEXT(tape, index)     (JSMNTREE_TAPE_NODES(tape)[(index)].end)
+
+/**
+ * Make a tape from tokens. Unlike jsmntree_make_tree(), the root can be
+ * a value of any type.
+ * @param       len         Length of `js', which bounds the string table
+ * @return      Tape, or NULL if there are no tokens, if out of memory, or
+ *              if the strings may not fit in 32-bit offsets
+ */
+jsmntree_tape *
+jsmntree_tape_make(const char * js, const size_t len,
+                    const jsmntok_t * tokens, const unsigned int num_tokens);
+
+/**
+ * Make a tape from a tree. Lazy containers are expanded on the way.
+ * Returns NULL if out of memory, or if the nodes or the strings do not
+ * fit in 32-bit indexes and offsets.
+ */
+jsmntree_tape * jsmntree_tape_make_tree(jsmntree_object * object);
+
+/**
+ * Free the memory space of a tape.
+ */
+void jsmntree_tape_free(jsmntree_tape * tape);
+
+/**
+ * Size of the whole tape in bytes.
+ */
+size_t jsmntree_tape_size(const jsmntree_tape * tape);
+
+/**
+ * NUL-terminated string of a string or member node, with its escapes
+ * decoded as in a tree; use `size' of the node for its length.
+ */
+const char *
+jsmntree_tape_string(const jsmntree_tape * tape, const jsmntree_tape_node * node);
+
+/**
+ * Print a tape in the same format as jsmntree_fprint_tree().
+ */
+void jsmntree_tape_fprint(FILE * stream, const jsmntree_tape * tape);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* ! JSMNTREE_TAPE_H_ */
@@ -0,0 +1,1433 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../lib/jsmntree.h"
+#include "../lib/jsmntree_query.h"
+#include "../lib/jsmntree_tape.h"
+#include "../lib/jsmntree_binary.h"
+#include "../lib/jsmntree_column.h"
+#include "../lib/jsmntree_stream.h"
+#include "../lib/jsmntree_batch.h"
+#include "../lib/jsmntree_sax.h"
+
+/* Number of checks which failed */
+static int failures = 0;
+
+#define TEST_CHECK(condition) \
+    do \
+    { \
+        if(!(condition)) \
+        { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            ++failures; \
+        } \
+    } \
+    while(0)
+
+/* A document with a value of every type, minified as the serializer writes it */
+static const char test_document[] =
+    "{\"name\":\"jsmntree\",\"count\":42,\"negative\":-7,\"big\":18446744073709551615,"
+    "\"real\":2.5,\"zero\":-0.0,\"yes\":true,\"no\":false,\"none\":null,"
+    "\"escaped\":\"tab\\tquote\\\"caf\xc3\xa9\","
+    "\"long\":\"a string which is too long to be stored inline\","
+    "\"nested\":{\"array\":[1,[],{},\"x\"],\"empty\":{}}}";
+
+/**
+ * Parse a JSON string and make a tree of it with `flags'.
+ * @return      Tree, or NULL on error
+ */
+static jsmntree_object *
+test_parse(const char * js, const unsigned int flags)
+{
+    jsmntree_options    options;
+    jsmntree_object *   tree    = NULL;
+
+    jsmntree_options_init(&options);
+    options.flags = flags;
+
+    if(jsmntree_parse_buffer(js, strlen(js), &options, &tree) != 0)
+        return NULL;
+
+    return tree;
+}
+
+/**
+ * Check that a tree serializes, minified, to `expected'.
+ */
+static void
+test_serialized(jsmntree_object * tree, const char * expected)
+{
+    const jsmntree_format   format  = { JSMNTREE_FORMAT_MINIFIED, 0 };
+    jsmntree_buffer         buffer  = { NULL, 0, 0 };
+
+    TEST_CHECK(tree != NULL);
+    if(tree == NULL)
+        return;
+
+    TEST_CHECK(jsmntree_serialize_buffer(tree, &format, &buffer) == 0);
+    TEST_CHECK(buffer.size == strlen(expected) && memcmp(buffer.data, expected, buffer.size) == 0);
+    if(buffer.size != strlen(expected) || memcmp(buffer.data, expected, buffer.size) != 0)
+        fprintf(stderr, "  got:      %.*s\n  expected: %s\n", (int)buffer.size, buffer.data, expected);
+
+    jsmntree_buffer_free(&buffer);
+}
+
+/* Parse, build and serialize back, with and without the flags which change how */
+static void
+test_round_trip(void)
+{
+    static const unsigned int   flags[] =
+    {
+        0, JSMNTREE_FLAG_ARENA, JSMNTREE_FLAG_INTERN, JSMNTREE_FLAG_LAZY,
+        JSMNTREE_FLAG_ARENA | JSMNTREE_FLAG_INTERN | JSMNTREE_FLAG_LAZY,
+    };
+    size_t                      i;
+
+    for(i = 0; i < sizeof(flags) / sizeof(flags[0]); ++i)
+    {
+        jsmntree_object * tree = test_parse(test_document, flags[i]);
+
+        test_serialized(tree, test_document);
+        jsmntree_free_tree(tree);
+    }
+
+    /* Pretty and spaced output reads back as the same tree */
+    {
+        const jsmntree_format   formats[]   = { { JSMNTREE_FORMAT_PRETTY, 4 }, { JSMNTREE_FORMAT_SPACED, 0 } };
+        jsmntree_object *       tree        = test_parse(test_document, 0);
+
+        for(i = 0; tree != NULL && i < sizeof(formats) / sizeof(formats[0]); ++i)
+        {
+            jsmntree_buffer     buffer  = { NULL, 0, 0 };
+            jsmntree_object *   again   = NULL;
+
+            TEST_CHECK(jsmntree_serialize_buffer(tree, &formats[i], &buffer) == 0);
+            TEST_CHECK(jsmntree_buffer_append(&buffer, "", 1) == 0);
+            if(buffer.data != NULL)
+                again = test_parse(buffer.data, 0);
+
+            test_serialized(again, test_document);
+            jsmntree_free_tree(again);
+            jsmntree_buffer_free(&buffer);
+        }
+
+        jsmntree_free_tree(tree);
+    }
+
+    TEST_CHECK(test_parse("[1,2]", 0) == NULL);
+    TEST_CHECK(test_parse("{\"a\":", 0) == NULL);
+}
+
+/* Removing members keeps the hash index right, and removing elements keeps their order */
+static void
+test_mutation(void)
+{
+    jsmntree_object *   tree    = test_parse("{\"list\":[0,1,2,3,4]}", 0);
+    jsmntree_member *   list;
+    jsmntree_array *    array;
+    jsmntree_element    value;
+    char                name[16];
+    int                 i;
+
+    TEST_CHECK(tree != NULL);
+    if(tree == NULL)
+        return;
+
+    /* Enough members for an index, then every third one removed */
+    for(i = 0; i < JSMNTREE_INDEX_THRESHOLD * 3; ++i)
+    {
+        value.value_type    = JSMNTREE_NUMBER;
+        value.value_length  = 0;
+        value.value.integer = i;
+        sprintf(name, "m%d", i);
+        TEST_CHECK(jsmntree_object_set(tree, name, strlen(name), &value) != NULL);
+    }
+
+    for(i = 0; i < JSMNTREE_INDEX_THRESHOLD * 3; i += 3)
+    {
+        sprintf(name, "m%d", i);
+        TEST_CHECK(jsmntree_object_remove(tree, name, strlen(name)) == 0);
+    }
+
+    TEST_CHECK(jsmntree_object_remove(tree, "m0", 2) == -1);
+
+    /* Inserting in front moves every member up */
+    value.value.integer = -1;
+    TEST_CHECK(jsmntree_object_insert(tree, 0, "first", 5, &value) != NULL);
+    TEST_CHECK(jsmntree_object_insert(tree, tree->size + 1, "past", 4, &value) == NULL);
+    TEST_CHECK(tree->members[0].name_length == 5 && jsmntree_object_get(tree, "first", 5) == &tree->members[0]);
+
+    for(i = 0; i < JSMNTREE_INDEX_THRESHOLD * 3; ++i)
+    {
+        jsmntree_member * member;
+
+        sprintf(name, "m%d", i);
+        member = jsmntree_object_get(tree, name, strlen(name));
+
+        if(i % 3 == 0)
+            TEST_CHECK(member == NULL);
+        else
+            TEST_CHECK(member != NULL && member->value.integer == i);
+    }
+
+    list = jsmntree_object_get(tree, "list", 4);
+    TEST_CHECK(list != NULL && list->value_type == JSMNTREE_ARRAY);
+    if(list == NULL)
+    {
+        jsmntree_free_tree(tree);
+        return;
+    }
+
+    array = list->value.pointer;
+    TEST_CHECK(jsmntree_array_remove(array, 1) == 0);
+    TEST_CHECK(jsmntree_array_remove(array, 3) == 0);
+    TEST_CHECK(jsmntree_array_remove(array, 3) == -1);
+    TEST_CHECK(array->size == 3 &&
+            array->elements[0].value.integer == 0 &&
+            array->elements[1].value.integer == 2 &&
+            array->elements[2].value.integer == 3);
+
+    /* Appending grows past the capacity the tokens gave */
+    for(i = 4; i < 100; ++i)
+    {
+        value.value.integer = i;
+        TEST_CHECK(jsmntree_array_append(array, &value) != NULL);
+    }
+
+    value.value.integer = 1;
+    TEST_CHECK(jsmntree_array_insert(array, 1, &value) != NULL);
+    TEST_CHECK(jsmntree_array_insert(array, array->size + 1, &value) == NULL);
+    value.value_type = JSMNTREE_NULL;
+    TEST_CHECK(jsmntree_array_set(array, 99, &value) != NULL);
+    TEST_CHECK(jsmntree_array_set(array, 100, &value) == NULL);
+    TEST_CHECK(array->size == 100 && array->capacity >= 100);
+
+    for(i = 0; i < 99; ++i)
+        TEST_CHECK(array->elements[i].value_type == JSMNTREE_NUMBER && array->elements[i].value.integer == i);
+    TEST_CHECK(array->elements[99].value_type == JSMNTREE_NULL);
+
+    jsmntree_free_tree(tree);
+
+    /* Containers are made empty, to be filled through what is returned */
+    tree = test_parse("{}", 0);
+    TEST_CHECK(tree != NULL);
+    if(tree == NULL)
+        return;
+
+    value.value_type = JSMNTREE_ARRAY;
+    list = jsmntree_object_set(tree, "list", 4, &value);
+    TEST_CHECK(list != NULL && list->value_type == JSMNTREE_ARRAY);
+    if(list != NULL)
+    {
+        jsmntree_element_set_string(&value, "a string which is not inline", 28);
+        TEST_CHECK(jsmntree_array_append(list->value.pointer, &value) != NULL);
+    }
+
+    test_serialized(tree, "{\"list\":[\"a string which is not inline\"]}");
+    jsmntree_free_tree(tree);
+}
+
+/* jsmn takes these; only the first few have tokens which do not nest as JSON does */
+static const char * malformed[] =
+{
+    "{\"a\":[]1}",
+    "{\"a\":{\"x\":[1]2}}",
+    "{\"a\" 1, \"b\"}",
+    "{\"a\":[[1]2]}",
+    "{\"a\":[[]2,3]}",
+    "{\"a\":1,}",
+    "{\"a\":[,1]}",
+    "{\"a\":1} {}",
+    NULL
+};
+
+#define TEST_MALFORMED_NESTING 3
+
+/* Malformed JSON is refused by every way of building, without writing past what is allocated */
+static void
+test_malformed(void)
+{
+    const unsigned int  flags[] = { 0, JSMNTREE_FLAG_ARENA, JSMNTREE_FLAG_INTERN, JSMNTREE_FLAG_LAZY };
+    jsmntok_t           tokens[64];
+    jsmn_parser         parser;
+    jsmntree_options    options;
+    unsigned int        i;
+    unsigned int        j;
+
+    for(i = 0; malformed[i] != NULL; ++i)
+    {
+        const char *        js      = malformed[i];
+        jsmntree_object *   tree;
+        jsmntree_member *   member;
+        int                 num_tokens;
+
+        for(j = 0; j < sizeof(flags) / sizeof(flags[0]); ++j)
+        {
+            tree = test_parse(js, flags[j]);
+            TEST_CHECK(tree == NULL);
+            jsmntree_free_tree(tree);
+        }
+
+        /* The tokens jsmn makes, given as they are */
+        jsmn_init(&parser);
+        num_tokens = jsmn_parse(&parser, js, strlen(js), tokens, 64);
+        TEST_CHECK(num_tokens > 0);
+        if(num_tokens <= 0)
+            continue;
+
+        tree = jsmntree_make_tree(js, strlen(js), tokens, (unsigned int)num_tokens);
+        if(i < TEST_MALFORMED_NESTING)
+            TEST_CHECK(tree == NULL);
+        jsmntree_free_tree(tree);
+
+        /* A lazy tree finds out as what does not nest is expanded */
+        jsmntree_options_init(&options);
+        options.flags = JSMNTREE_FLAG_LAZY;
+        tree = jsmntree_make_tree_ex(js, strlen(js), tokens, (unsigned int)num_tokens, &options);
+        if(tree == NULL)
+            continue;
+
+        member = jsmntree_object_get(tree, "a", 1);
+        if(member != NULL && member->value_type == JSMNTREE_OBJECT)
+            TEST_CHECK(jsmntree_object_expand(member->value.pointer) == -1 || i >= TEST_MALFORMED_NESTING);
+        else if(member != NULL && member->value_type == JSMNTREE_ARRAY)
+            TEST_CHECK(jsmntree_array_expand(member->value.pointer) == 0 || i < TEST_MALFORMED_NESTING);
+
+        jsmntree_free_tree(tree);
+    }
+
+    /* Enough tokens to be built on threads, the last of which do not nest */
+    {
+        const size_t        count   = JSMNTREE_PARALLEL_THRESHOLD + 16;
+        char *              js      = malloc(count * 2 + 64);
+        jsmntok_t *         many    = malloc(sizeof(jsmntok_t) * (count + 16));
+        jsmntree_object *   tree    = NULL;
+        size_t              len     = 0;
+        size_t              k;
+        int                 num_tokens;
+
+        TEST_CHECK(js != NULL && many != NULL);
+        if(js != NULL && many != NULL)
+        {
+            len += sprintf(&js[len], "{\"a\":[");
+            for(k = 0; k < count; ++k)
+                len += sprintf(&js[len], (k == 0) ? "0" : ",0");
+            len += sprintf(&js[len], "],\"b\":{\"x\":[1]2}}");
+
+            jsmn_init(&parser);
+            num_tokens = jsmn_parse(&parser, js, len, many, (unsigned int)(count + 16));
+            TEST_CHECK(num_tokens > JSMNTREE_PARALLEL_THRESHOLD);
+
+            jsmntree_options_init(&options);
+            options.num_threads = 4;
+            if(num_tokens > 0)
+                tree = jsmntree_make_tree_ex(js, len, many, (unsigned int)num_tokens, &options);
+            TEST_CHECK(tree == NULL);
+            jsmntree_free_tree(tree);
+        }
+
+        free(js);
+        free(many);
+    }
+}
+
+#undef TEST_MALFORMED_NESTING
+
+/* Matches of a query, as the offsets of their tokens or the integers of their values */
+typedef struct
+{
+    long long   found[8];
+    int         count;
+}
+test_matches;
+
+static int
+test_token_match(void * context, const jsmntok_t * token)
+{
+    test_matches * matches = context;
+
+    if(matches->count < 8)
+        matches->found[matches->count] = token->start;
+
+    return ++matches->count == 8;
+}
+
+static int
+test_value_match(void * context, const jsmntree_element * value)
+{
+    test_matches * matches = context;
+
+    if(matches->count < 8)
+        matches->found[matches->count] = (value->value_type == JSMNTREE_NUMBER) ? value->value.integer : -1;
+
+    return ++matches->count == 8;
+}
+
+/* Queries over tokens and over a tree find the same, names with escapes included */
+static void
+test_query(void)
+{
+    static const char   js[]        = "{\"r\":[{\"id\":1,\"a\\/b\":2},{\"id\":3,\"\\u0061\\/b\":4}],\"id\":5}";
+    const char *        expressions[] = { "/r/*/id", "/r/1/a~1b", "/*", "/id", "/r/2", "/missing", NULL };
+    const int           expected[]  = { 2, 1, 2, 1, 0, 0 };
+    jsmntok_t *         tokens      = NULL;
+    unsigned int        capacity    = 0;
+    unsigned int *      sizes;
+    jsmntree_object *   tree        = test_parse(js, 0);
+    int                 num_tokens  = jsmntree_parse_tokens(js, sizeof(js) - 1, &tokens, &capacity);
+    int                 i;
+
+    TEST_CHECK(tree != NULL && num_tokens > 0);
+    if(tree == NULL || num_tokens <= 0)
+    {
+        jsmntree_free_tree(tree);
+        free(tokens);
+        return;
+    }
+
+    sizes = jsmntree_subtree_sizes(tokens, (unsigned int)num_tokens);
+    TEST_CHECK(sizes != NULL);
+
+    for(i = 0; expressions[i] != NULL; ++i)
+    {
+        jsmntree_query *    query           = jsmntree_query_compile(expressions[i]);
+        test_matches        by_offsets      = { { 0 }, 0 };
+        test_matches        by_sizes        = { { 0 }, 0 };
+        test_matches        by_tree         = { { 0 }, 0 };
+
+        TEST_CHECK(query != NULL);
+        if(query == NULL)
+            continue;
+
+        TEST_CHECK(jsmntree_query_tokens(query, js, tokens, (unsigned int)num_tokens, NULL,
+                                            test_token_match, &by_offsets) == 0);
+        TEST_CHECK(jsmntree_query_tokens(query, js, tokens, (unsigned int)num_tokens, sizes,
+                                            test_token_match, &by_sizes) == 0);
+        TEST_CHECK(jsmntree_query_tree(query, tree, test_value_match, &by_tree) == 0);
+
+        TEST_CHECK(by_offsets.count == expected[i] && by_sizes.count == expected[i] &&
+                    by_tree.count == expected[i]);
+        TEST_CHECK(memcmp(by_offsets.found, by_sizes.found, sizeof(by_offsets.found)) == 0);
+
+        jsmntree_query_free(query);
+    }
+
+    /* The escaped name is matched decoded, with the value it has in the tree */
+    {
+        jsmntree_query *    query   = jsmntree_query_compile("/r/*/a~1b");
+        test_matches        matches = { { 0 }, 0 };
+
+        TEST_CHECK(query != NULL && jsmntree_query_tree(query, tree, test_value_match, &matches) == 0);
+        TEST_CHECK(matches.count == 2 && matches.found[0] == 2 && matches.found[1] == 4);
+        jsmntree_query_free(query);
+    }
+
+    TEST_CHECK(jsmntree_query_compile("r/id") == NULL);
+
+    /* Malformed JSON gives no tokens to query */
+    TEST_CHECK(jsmntree_parse_tokens("{\"r\":[1 2]}", 11, &tokens, &capacity) == JSMN_ERROR_INVAL);
+
+    free(sizes);
+    free(tokens);
+    jsmntree_free_tree(tree);
+}
+
+/* Timings add up over the trees made with the same statistics */
+static void
+test_stats(void)
+{
+    const char *        js              = "{\"a\":[1,2,3],\"b\":{\"c\":null}}";
+    jsmntree_stats      stats;
+    jsmntree_options    options;
+    jsmntree_object *   tree;
+    double              build_seconds   = 0;
+    double              free_seconds    = 0;
+    int                 i;
+
+    jsmntree_stats_init(&stats);
+    jsmntree_options_init(&options);
+    options.stats = &stats;
+
+    for(i = 0; i < 3; ++i)
+    {
+        options.flags = (i == 2) ? JSMNTREE_FLAG_FUSED : 0;
+        TEST_CHECK(jsmntree_parse_buffer(js, strlen(js), &options, &tree) == 0);
+        TEST_CHECK(jsmntree_get_stats(tree) == &stats);
+        jsmntree_free_tree(tree);
+
+        TEST_CHECK(stats.build_seconds >= build_seconds && stats.free_seconds >= free_seconds);
+        build_seconds   = stats.build_seconds;
+        free_seconds    = stats.free_seconds;
+    }
+
+    TEST_CHECK(stats.allocations > 0 && stats.allocated_bytes > 0);
+}
+
+/* Numbers follow the grammar of JSON; anything else is left undefined */
+static void
+test_numbers(void)
+{
+    static const struct
+    {
+        const char *    js;
+        jsmntreetype_t  type;
+    }
+    numbers[] =
+    {
+        { "0", JSMNTREE_NUMBER },               { "-0", JSMNTREE_REAL },
+        { "-12", JSMNTREE_NUMBER },             { "9223372036854775808", JSMNTREE_UNSIGNED },
+        { "1.5", JSMNTREE_REAL },               { "0.5e-3", JSMNTREE_REAL },
+        { "1E+2", JSMNTREE_REAL },              { "-9223372036854775808", JSMNTREE_NUMBER },
+        { "01", JSMNTREE_UNDEFINED },           { "-01", JSMNTREE_UNDEFINED },
+        { "1.", JSMNTREE_UNDEFINED },           { "1.e5", JSMNTREE_UNDEFINED },
+        { "1e", JSMNTREE_UNDEFINED },           { "1e+", JSMNTREE_UNDEFINED },
+        { "-", JSMNTREE_UNDEFINED },            { "+1", JSMNTREE_UNDEFINED },
+        { ".5", JSMNTREE_UNDEFINED },           { "1x", JSMNTREE_UNDEFINED },
+        { "1e999", JSMNTREE_UNDEFINED },        { "nul", JSMNTREE_UNDEFINED },
+    };
+    size_t i;
+
+    for(i = 0; i < sizeof(numbers) / sizeof(numbers[0]); ++i)
+    {
+        jsmntok_t       token   = { JSMN_PRIMITIVE, 0, (int)strlen(numbers[i].js), 0 };
+        jsmntree_value  value;
+
+        TEST_CHECK(jsmntree_decode_primitive(numbers[i].js, &token, &value) == numbers[i].type);
+        if(jsmntree_decode_primitive(numbers[i].js, &token, &value) != numbers[i].type)
+            fprintf(stderr, "  number:   %s\n", numbers[i].js);
+    }
+}
+
+/* The fused parser makes the trees the two passes make, and refuses what they refuse */
+static void
+test_fused(void)
+{
+    static const char * const   documents[] =
+    {
+        "{}",
+        " {\"a\":{\"b\":{\"c\":[[[]]]}},\"d\":\"\\ud83d\\ude00\"} \n",
+        "{\"k\\u00e9y\":1,\"k\\u00e9y\":[true,false,null,-1.5e3,18446744073709551615]}",
+    };
+    static const char * const   refused[] =
+    {
+        "{\"a\":1} x",
+        "{\"a\":1}}",
+        "{\"a\":\"\\x\"}",
+        "{\"a\":\"\\u12\"}",
+        "{\"a\\q\":1}",
+        "{\"a\":[1,}",
+        "{\"a\":1",
+        "[1]",
+    };
+    jsmntree_options    options;
+    jsmntree_object *   fused;
+    size_t              i;
+
+    for(i = 0; i < sizeof(documents) / sizeof(documents[0]); ++i)
+    {
+        jsmntree_object *   tree    = test_parse(documents[i], 0);
+        jsmntree_buffer     buffer  = { NULL, 0, 0 };
+
+        fused = test_parse(documents[i], JSMNTREE_FLAG_FUSED);
+
+        TEST_CHECK(tree != NULL && jsmntree_serialize_buffer(tree, NULL, &buffer) == 0);
+        if(buffer.data != NULL)
+        {
+            /* The serialized tree is itself a document to check against */
+            TEST_CHECK(jsmntree_buffer_append(&buffer, "", 1) == 0);
+            test_serialized(fused, buffer.data);
+        }
+
+        jsmntree_buffer_free(&buffer);
+        jsmntree_free_tree(fused);
+        jsmntree_free_tree(tree);
+    }
+
+    /* Both ways give the same error */
+    jsmntree_options_init(&options);
+    for(i = 0; i < sizeof(refused) / sizeof(refused[0]) + sizeof(malformed) / sizeof(malformed[0]) - 1; ++i)
+    {
+        const char *    js      = (i < sizeof(refused) / sizeof(refused[0])) ?
+                                    refused[i] : malformed[i - sizeof(refused) / sizeof(refused[0])];
+        jsmntree_object * tree  = NULL;
+        int             r;
+        int             r_fused;
+
+        options.flags   = 0;
+        r               = jsmntree_parse_buffer(js, strlen(js), &options, &tree);
+        jsmntree_free_tree(tree);
+
+        options.flags   = JSMNTREE_FLAG_FUSED;
+        r_fused         = jsmntree_parse_buffer(js, strlen(js), &options, &tree);
+        jsmntree_free_tree(tree);
+
+        TEST_CHECK(r != 0 && r == r_fused);
+        if(r == 0 || r != r_fused)
+            fprintf(stderr, "  document: %s (%d, fused %d)\n", js, r, r_fused);
+    }
+}
+
+/**
+ * Read back what was printed to a temporary file, NUL-terminated, and
+ * close the file.
+ * @return      Text to free(), or NULL on error
+ */
+static char *
+test_printed(FILE * stream)
+{
+    long    size;
+    char *  text    = NULL;
+
+    if(stream == NULL)
+        return NULL;
+
+    if(fseek(stream, 0, SEEK_END) == 0 && (size = ftell(stream)) >= 0 && fseek(stream, 0, SEEK_SET) == 0)
+    {
+        text = malloc(size + 1);
+        if(text != NULL && fread(text, 1, size, stream) != (size_t)size)
+        {
+            free(text);
+            text = NULL;
+        }
+        else if(text != NULL)
+            text[size] = '\0';
+    }
+
+    fclose(stream);
+
+    return text;
+}
+
+/* Tapes made from tokens and from a tree print as the tree does */
+static void
+test_tape(void)
+{
+    static const char   js[]        = "{\"a\":[1,-2,3.5,18446744073709551615],\"b\\n\":{\"c\":\"\\u00e9\",\"d\":[]},"
+                                        "\"e\":true,\"f\":null,\"g\":\"\\\"\"}";
+    jsmntok_t *         tokens      = NULL;
+    unsigned int        capacity    = 0;
+    int                 num_tokens  = jsmntree_parse_tokens(js, sizeof(js) - 1, &tokens, &capacity);
+    jsmntree_object *   tree        = test_parse(js, 0);
+    jsmntree_tape *     from_tokens = NULL;
+    jsmntree_tape *     from_tree   = NULL;
+    FILE *              stream;
+    char *              expected;
+    char *              printed;
+
+    TEST_CHECK(num_tokens > 0 && tree != NULL);
+    if(num_tokens > 0)
+        from_tokens = jsmntree_tape_make(js, sizeof(js) - 1, tokens, (unsigned int)num_tokens);
+    if(tree != NULL)
+        from_tree = jsmntree_tape_make_tree(tree);
+    TEST_CHECK(from_tokens != NULL && from_tree != NULL);
+
+    stream = tmpfile();
+    if(stream != NULL)
+        jsmntree_fprint_tree(stream, tree);
+    expected = test_printed(stream);
+    TEST_CHECK(expected != NULL);
+
+    if(expected != NULL && from_tokens != NULL && from_tree != NULL)
+    {
+        TEST_CHECK(from_tokens->num_nodes == from_tree->num_nodes);
+        TEST_CHECK(jsmntree_tape_size(from_tokens) >= jsmntree_tape_size(from_tree));
+
+        stream = tmpfile();
+        if(stream != NULL)
+            jsmntree_tape_fprint(stream, from_tokens);
+        printed = test_printed(stream);
+        TEST_CHECK(printed != NULL && strcmp(printed, expected) == 0);
+        free(printed);
+
+        stream = tmpfile();
+        if(stream != NULL)
+            jsmntree_tape_fprint(stream, from_tree);
+        printed = test_printed(stream);
+        TEST_CHECK(printed != NULL && strcmp(printed, expected) == 0);
+        free(printed);
+    }
+
+    /* There is no tape of no tokens */
+    TEST_CHECK(jsmntree_tape_make(js, sizeof(js) - 1, tokens, 0) == NULL);
+
+    free(expected);
+    jsmntree_tape_free(from_tokens);
+    jsmntree_tape_free(from_tree);
+    jsmntree_free_tree(tree);
+    free(tokens);
+}
+
+/* Snapshots load as they were saved, and are refused when they do not hold together */
+static void
+test_binary(void)
+{
+    static const char       js[]    = "{\"a\":[1,{\"b\":\"c\"}],\"d\":{}}";
+    static const char       path[]  = "jsmntree_test.snapshot";
+    const uint64_t          hash    = jsmntree_binary_hash(js, sizeof(js) - 1);
+    jsmntree_object *       tree    = test_parse(js, 0);
+    jsmntree_tape *         tape    = (tree != NULL) ? jsmntree_tape_make_tree(tree) : NULL;
+    const jsmntree_tape *   loaded;
+
+    TEST_CHECK(tape != NULL);
+    if(tape == NULL)
+    {
+        jsmntree_free_tree(tree);
+        return;
+    }
+
+    TEST_CHECK(jsmntree_save_binary(path, tree, hash) == 0);
+
+    loaded = jsmntree_load_binary(path, hash);
+    TEST_CHECK(loaded != NULL && jsmntree_tape_size(loaded) == jsmntree_tape_size(tape) &&
+                memcmp(loaded, tape, jsmntree_tape_size(tape)) == 0);
+    jsmntree_unload_binary(loaded);
+
+    TEST_CHECK(jsmntree_load_binary(path, hash + 1) == NULL);
+
+    /* An array which says it holds one element more than it does */
+    ++JSMNTREE_TAPE_NODES(tape)[2].size;
+    TEST_CHECK(JSMNTREE_TAPE_NODES(tape)[2].type == JSMNTREE_ARRAY);
+    TEST_CHECK(jsmntree_save_tape(path, tape, hash) == 0);
+    TEST_CHECK(jsmntree_load_binary(path, hash) == NULL);
+    --JSMNTREE_TAPE_NODES(tape)[2].size;
+
+    /* A subtree which runs past the tape */
+    JSMNTREE_TAPE_NODES(tape)[0].end = tape->num_nodes + 1;
+    TEST_CHECK(jsmntree_save_tape(path, tape, hash) == 0);
+    TEST_CHECK(jsmntree_load_binary(path, hash) == NULL);
+
+    remove(path);
+    TEST_CHECK(jsmntree_load_binary(path, 0) == NULL);
+
+    jsmntree_tape_free(tape);
+    jsmntree_free_tree(tree);
+}
+
+/* Escape and decode strings long enough for the vector kernels, with escapes anywhere */
+static void
+test_escape(void)
+{
+    static const char   specials[]  = "\"\\\n\t\x01\x1f" "\xc3\xa9" "\xe2\x82\xac" "\xf0\x9f\x98\x80";
+    char                string[96];
+    char                escaped[JSMNTREE_ESCAPED_MAX(sizeof(string))];
+    char                decoded[JSMNTREE_UNESCAPED_MAX(sizeof(escaped))];
+    size_t              length;
+    size_t              position;
+
+    length = jsmntree_string_escape("a\"b\\c\n\x01/", 8, escaped);
+    TEST_CHECK(length == 16 && memcmp(escaped, "a\\\"b\\\\c\\n\\u0001/", length) == 0);
+
+    for(position = 0; position + sizeof(specials) <= sizeof(string); ++position)
+    {
+        memset(string, 'x', sizeof(string));
+        memcpy(&string[position], specials, sizeof(specials) - 1);
+
+        length = jsmntree_string_escape(string, sizeof(string), escaped);
+        TEST_CHECK(jsmntree_string_unescape(escaped, length, decoded) == sizeof(string) &&
+                memcmp(decoded, string, sizeof(string)) == 0);
+        TEST_CHECK(jsmntree_string_unescape_lossy(escaped, length, decoded) == sizeof(string) &&
+                memcmp(decoded, string, sizeof(string)) == 0);
+        TEST_CHECK(jsmntree_string_validate(string, sizeof(string)) == 0);
+
+        /* A stray continuation byte */
+        string[position] = '\x80';
+        TEST_CHECK(jsmntree_string_validate(string, sizeof(string)) == -1);
+        TEST_CHECK(jsmntree_string_unescape(string, sizeof(string), decoded) == (size_t)-1);
+    }
+
+    TEST_CHECK(jsmntree_string_unescape("\\ud83d\\ude00", 12, decoded) == 4 &&
+            memcmp(decoded, "\xf0\x9f\x98\x80", 4) == 0);
+    TEST_CHECK(jsmntree_string_unescape("\\ud83dx", 7, decoded) == (size_t)-1);
+    TEST_CHECK(jsmntree_string_unescape("\\q", 2, decoded) == (size_t)-1);
+
+    /* Replaced rather than refused */
+    TEST_CHECK(jsmntree_string_unescape_lossy("\\ud83dx", 7, decoded) == 4 &&
+            memcmp(decoded, "\xef\xbf\xbd" "x", 4) == 0);
+    TEST_CHECK(jsmntree_string_unescape_lossy("a\xff" "b", 3, decoded) == 5 &&
+            memcmp(decoded, "a\xef\xbf\xbd" "b", 5) == 0);
+}
+
+/* Short strings live in the value, longer ones are pointed to */
+static void
+test_inline_strings(void)
+{
+    static const char   longer[]    = "sixteen bytes!!!";
+    jsmntree_object *   tree        = test_parse("{\"short\":\"fifteen bytes!!\",\"empty\":\"\"}", 0);
+    jsmntree_member *   member;
+    jsmntree_element    value;
+
+    TEST_CHECK(tree != NULL);
+    if(tree == NULL)
+        return;
+
+    member = jsmntree_object_get(tree, "short", 5);
+    TEST_CHECK(member != NULL && member->value_length == JSMNTREE_INLINE_MAX &&
+            JSMNTREE_VALUE_STRING(&member->value, member->value_length) == member->value.string &&
+            strcmp(member->value.string, "fifteen bytes!!") == 0);
+
+    member = jsmntree_object_get(tree, "empty", 5);
+    TEST_CHECK(member != NULL && member->value_length == 0 && member->value.string[0] == '\0');
+
+    jsmntree_element_set_string(&value, longer, sizeof(longer) - 1);
+    member = jsmntree_object_set(tree, "short", 5, &value);
+    TEST_CHECK(member != NULL && member->value_length == sizeof(longer) - 1 &&
+            JSMNTREE_VALUE_STRING(&member->value, member->value_length) != longer &&
+            memcmp(member->value.pointer, longer, sizeof(longer) - 1) == 0);
+
+    jsmntree_element_set_string(&value, "tiny", 4);
+    member = jsmntree_object_set(tree, "short", 5, &value);
+    TEST_CHECK(member != NULL && strcmp(member->value.string, "tiny") == 0);
+
+    test_serialized(tree, "{\"short\":\"tiny\",\"empty\":\"\"}");
+    jsmntree_free_tree(tree);
+}
+
+/* Columns from tokens are those from a tree */
+static void
+test_columns(void)
+{
+    static const char   js[]    =
+        "{\"rows\":[{\"id\":1,\"name\":\"a\\nb\",\"score\":0.5},"
+        "{\"id\":2,\"score\":1,\"k\\u00e9y\":true},"
+        "3,"
+        "{\"name\":null,\"id\":18446744073709551615}]}";
+    jsmntree_columns    columns;
+    jsmntree_column *   column;
+    jsmntok_t *         tokens      = NULL;
+    unsigned int        capacity    = 0;
+    int                 num_tokens  = jsmntree_parse_tokens(js, strlen(js), &tokens, &capacity);
+
+    TEST_CHECK(num_tokens > 2);
+    if(num_tokens <= 2)
+    {
+        free(tokens);
+        return;
+    }
+
+    jsmntree_columns_init(&columns);
+    TEST_CHECK(jsmntree_columns_append_tokens(&columns, js, tokens, num_tokens, 2) == 0);
+    TEST_CHECK(jsmntree_columns_append_tokens(&columns, js, tokens, num_tokens, 0) == JSMNTREE_ERROR_INVTOK);
+    TEST_CHECK(columns.num_rows == 3 && columns.num_skipped == 1 && columns.num_columns == 4);
+
+    /* A number above INT64_MAX turns the column to reals */
+    column = jsmntree_columns_find(&columns, "id", 2);
+    TEST_CHECK(column != NULL && column->type == JSMNTREE_REAL &&
+            ((double *)column->values)[0] == 1.0 && ((double *)column->values)[2] > 1.8e19);
+
+    column = jsmntree_columns_find(&columns, "name", 4);
+    TEST_CHECK(column != NULL && column->type == JSMNTREE_STRING && column->num_nulls == 2 &&
+            column->offsets[1] == 3 && memcmp(column->bytes, "a\nb", 3) == 0);
+
+    column = jsmntree_columns_find(&columns, "score", 5);
+    TEST_CHECK(column != NULL && column->type == JSMNTREE_REAL && column->num_nulls == 1 &&
+            ((double *)column->values)[1] == 1.0);
+
+    column = jsmntree_columns_find(&columns, "k\xc3\xa9y", 4);
+    TEST_CHECK(column != NULL && column->type == JSMNTREE_BOOLEAN &&
+            JSMNTREE_COLUMN_IS_NULL(column, 0) && ((uint8_t *)column->values)[1] == 1);
+
+    jsmntree_columns_free(&columns);
+    TEST_CHECK(columns.num_columns == 0 && columns.columns == NULL);
+
+    /* The same rows from a tree */
+    {
+        jsmntree_object *   tree    = test_parse(js, 0);
+        jsmntree_member *   rows    = (tree != NULL) ? jsmntree_object_get(tree, "rows", 4) : NULL;
+
+        TEST_CHECK(rows != NULL && rows->value_type == JSMNTREE_ARRAY);
+        if(rows != NULL && rows->value_type == JSMNTREE_ARRAY)
+        {
+            TEST_CHECK(jsmntree_columns_append_array(&columns, rows->value.pointer) == 0);
+            TEST_CHECK(columns.num_rows == 3 && columns.num_skipped == 1 && columns.num_columns == 4);
+
+            column = jsmntree_columns_find(&columns, "id", 2);
+            TEST_CHECK(column != NULL && column->type == JSMNTREE_REAL);
+        }
+
+        jsmntree_columns_free(&columns);
+        jsmntree_free_tree(tree);
+    }
+
+    /* Malformed JSON gives no tokens, and the tokens jsmn makes of it are read within bounds */
+    {
+        static const char   bad[]   = "{\"rows\":[{\"id\":1}2,{\"id\" 3},{\"id\":[]4}]}";
+        jsmntok_t           raw[32];
+        jsmn_parser         parser;
+        int                 num_raw;
+
+        TEST_CHECK(jsmntree_parse_tokens(bad, sizeof(bad) - 1, &tokens, &capacity) == JSMN_ERROR_INVAL);
+
+        jsmn_init(&parser);
+        num_raw = jsmn_parse(&parser, bad, sizeof(bad) - 1, raw, 32);
+        TEST_CHECK(num_raw > 2);
+        if(num_raw > 2)
+            TEST_CHECK(jsmntree_columns_append_tokens(&columns, bad, raw, num_raw, 2) == 0);
+
+        jsmntree_columns_free(&columns);
+    }
+
+    free(tokens);
+}
+
+/* Append a record, minified, as a line of the buffer given as context */
+static int
+test_stream_record(void * context, jsmntree_object * record)
+{
+    const jsmntree_format format = { JSMNTREE_FORMAT_MINIFIED, 0 };
+
+    if(jsmntree_serialize_buffer(record, &format, context) != 0 ||
+            jsmntree_buffer_append(context, "\n", 1) != 0)
+        return -1;
+
+    return 0;
+}
+
+/* Records come out whole whatever the chunks they are fed in */
+static void
+test_stream(void)
+{
+    static const char   ndjson[]    = "{\"a\":1}\n{\"b\":[\"x\\\"}\",{}]}\n  {\"c\":{\"d\":null}}\n";
+    static const char   array[]     = "[{\"a\":1},{\"b\":[\"x\\\"}\",{}]},{\"c\":{\"d\":null}}]";
+    static const char   expected[]  = "{\"a\":1}\n{\"b\":[\"x\\\"}\",{}]}\n{\"c\":{\"d\":null}}\n";
+    const char * const  inputs[]    = { ndjson, array };
+    const unsigned int  flags[]     = { 0, JSMNTREE_FLAG_ARENA };
+    jsmntree_options    options;
+    jsmntree_stream *   stream;
+    jsmntree_buffer     buffer      = { NULL, 0, 0 };
+    size_t              chunk;
+    size_t              i;
+    size_t              j;
+    size_t              k;
+
+    jsmntree_options_init(&options);
+
+    for(i = 0; i < sizeof(inputs) / sizeof(inputs[0]); ++i)
+    {
+        for(j = 0; j < sizeof(flags) / sizeof(flags[0]); ++j)
+        {
+            for(chunk = 1; chunk <= strlen(inputs[i]); chunk *= 3)
+            {
+                int r = 0;
+
+                options.flags   = flags[j];
+                buffer.size     = 0;
+                stream          = jsmntree_stream_create(&options, test_stream_record, &buffer);
+                TEST_CHECK(stream != NULL);
+                if(stream == NULL)
+                    continue;
+
+                for(k = 0; r == 0 && k < strlen(inputs[i]); k += chunk)
+                {
+                    const size_t length = (strlen(inputs[i]) - k < chunk) ? strlen(inputs[i]) - k : chunk;
+
+                    r = jsmntree_stream_feed(stream, &inputs[i][k], length);
+                }
+
+                TEST_CHECK(r == 0 && jsmntree_stream_finish(stream) == 0);
+                TEST_CHECK(buffer.size == sizeof(expected) - 1 && memcmp(buffer.data, expected, buffer.size) == 0);
+                jsmntree_stream_destroy(stream);
+            }
+        }
+    }
+
+    /* A malformed record stops the stream, after the records before it */
+    stream = jsmntree_stream_create(NULL, test_stream_record, &buffer);
+    TEST_CHECK(stream != NULL);
+    if(stream != NULL)
+    {
+        buffer.size = 0;
+        TEST_CHECK(jsmntree_stream_feed(stream, "{\"a\":1}\n{\"a\":[]1}\n", 18) == JSMN_ERROR_INVAL);
+        TEST_CHECK(buffer.size == 8 && memcmp(buffer.data, "{\"a\":1}\n", 8) == 0);
+        jsmntree_stream_destroy(stream);
+    }
+
+    /* An incomplete record is told at the end */
+    stream = jsmntree_stream_create(NULL, test_stream_record, &buffer);
+    TEST_CHECK(stream != NULL);
+    if(stream != NULL)
+    {
+        TEST_CHECK(jsmntree_stream_feed(stream, "{\"a\":[1,", 8) == 0);
+        TEST_CHECK(jsmntree_stream_finish(stream) == JSMN_ERROR_PART);
+        jsmntree_stream_destroy(stream);
+    }
+
+    jsmntree_buffer_free(&buffer);
+}
+
+/**
+ * Write a string to a file.
+ * @return      0 on success, -1 on error
+ */
+static int
+test_write_file(const char * path, const char * text)
+{
+    FILE *  stream  = fopen(path, "wb");
+    int     r       = -1;
+
+    if(stream == NULL)
+        return -1;
+
+    if(fwrite(text, 1, strlen(text), stream) == strlen(text))
+        r = 0;
+
+    return (fclose(stream) == 0) ? r : -1;
+}
+
+/* Files are mapped and made trees of as buffers are */
+static void
+test_file(void)
+{
+    static const char       path[]  = "jsmntree_test.json";
+    const unsigned int      flags[] = { 0, JSMNTREE_FLAG_LAZY, JSMNTREE_FLAG_FUSED, JSMNTREE_FLAG_HUGEPAGE };
+    jsmntree_options        options;
+    jsmntree_object *       tree;
+    const char *            data;
+    size_t                  size    = 0;
+    size_t                  i;
+
+    TEST_CHECK(test_write_file(path, test_document) == 0);
+
+    data = jsmntree_map_file(path, NULL, &size);
+    TEST_CHECK(data != NULL && size == strlen(test_document) && memcmp(data, test_document, size) == 0);
+    if(data != NULL)
+        jsmntree_unmap_file(data, size);
+
+    jsmntree_options_init(&options);
+    for(i = 0; i < sizeof(flags) / sizeof(flags[0]); ++i)
+    {
+        options.flags = flags[i];
+        tree = NULL;
+        TEST_CHECK(jsmntree_make_tree_from_file(path, &options, &tree) == 0);
+
+        /* A lazy tree keeps the mapping until it is freed */
+        test_serialized(tree, test_document);
+        jsmntree_free_tree(tree);
+    }
+
+    /* What jsmntree_parse_buffer() refuses, and no file at all */
+    TEST_CHECK(test_write_file(path, "{\"a\":[1 2]}") == 0);
+    TEST_CHECK(jsmntree_make_tree_from_file(path, NULL, &tree) == JSMN_ERROR_INVAL && tree == NULL);
+
+    remove(path);
+    TEST_CHECK(jsmntree_make_tree_from_file(path, NULL, &tree) == JSMNTREE_ERROR_IO && tree == NULL);
+    TEST_CHECK(jsmntree_map_file(path, NULL, &size) == NULL);
+}
+
+/* Minify a document of a batch into its own line */
+static int
+test_batch_document(void * context, jsmntree_object * document, jsmntree_buffer * output)
+{
+    const jsmntree_format format = { JSMNTREE_FORMAT_MINIFIED, 0 };
+
+    (void)context;
+
+    if(jsmntree_serialize_buffer(document, &format, output) != 0 ||
+            jsmntree_buffer_append(output, "\n", 1) != 0)
+        return -1;
+
+    return 0;
+}
+
+/* Append what a batch writes to the buffer given as context */
+static int
+test_batch_write(void * context, const char * data, const size_t length)
+{
+    return jsmntree_buffer_append(context, data, length);
+}
+
+/* Documents spread over several tasks come out minified, in input order */
+static void
+test_batch(void)
+{
+    const unsigned int  threads[]   = { 1, 4 };
+    jsmntree_buffer     input       = { NULL, 0, 0 };
+    jsmntree_buffer     expected    = { NULL, 0, 0 };
+    jsmntree_buffer     output      = { NULL, 0, 0 };
+    char                line[256];
+    size_t              bad         = 0;
+    size_t              i;
+    int                 n;
+
+    /* Some 4 megabytes, with blank lines and spaces */
+    for(i = 0; i < 32768; ++i)
+    {
+        n = sprintf(line, "{ \"i\": %u, \"s\": \"%0100u\" }\n%s", (unsigned int)i, (unsigned int)i,
+                    (i % 1000 == 0) ? "\n" : "");
+        TEST_CHECK(jsmntree_buffer_append(&input, line, n) == 0);
+
+        n = sprintf(line, "{\"i\":%u,\"s\":\"%0100u\"}\n", (unsigned int)i, (unsigned int)i);
+        TEST_CHECK(jsmntree_buffer_append(&expected, line, n) == 0);
+
+        if(i == 20000)
+            bad = expected.size;
+    }
+
+    for(i = 0; input.data != NULL && i < sizeof(threads) / sizeof(threads[0]); ++i)
+    {
+        output.size = 0;
+        TEST_CHECK(jsmntree_batch(input.data, input.size, NULL, threads[i],
+                                    test_batch_document, NULL, test_batch_write, &output) == 0);
+        TEST_CHECK(output.size == expected.size && memcmp(output.data, expected.data, output.size) == 0);
+    }
+
+    /* A malformed document stops the batch after the output of those before it */
+    if(input.data != NULL && expected.data != NULL)
+    {
+        char * found = strstr(input.data, "\"i\": 20001,");
+
+        TEST_CHECK(found != NULL);
+        if(found != NULL)
+        {
+            found[3] = ' ';
+            output.size = 0;
+            TEST_CHECK(jsmntree_batch(input.data, input.size, NULL, 4,
+                                        test_batch_document, NULL, test_batch_write, &output) == JSMN_ERROR_INVAL);
+            TEST_CHECK(output.size == bad && memcmp(output.data, expected.data, bad) == 0);
+        }
+    }
+
+    jsmntree_buffer_free(&input);
+    jsmntree_buffer_free(&expected);
+    jsmntree_buffer_free(&output);
+}
+
+/* A document built on threads is the one built on the calling thread alone */
+static void
+test_parallel(void)
+{
+    const unsigned int  flags[]     = { 0, JSMNTREE_FLAG_ARENA, JSMNTREE_FLAG_INTERN };
+    jsmntree_buffer     input       = { NULL, 0, 0 };
+    jsmntree_buffer     expected    = { NULL, 0, 0 };
+    jsmntree_buffer     output      = { NULL, 0, 0 };
+    jsmntree_options    options;
+    jsmntree_object *   tree        = NULL;
+    char                row[128];
+    size_t              i;
+    int                 n;
+
+    /* 14 tokens a row, past JSMNTREE_PARALLEL_THRESHOLD */
+    TEST_CHECK(jsmntree_buffer_append(&input, "{\"rows\":[", 9) == 0);
+    for(i = 0; i < JSMNTREE_PARALLEL_THRESHOLD / 14 + 400; ++i)
+    {
+        n = sprintf(row, "%s{\"i\":%u,\"a\":[%u,\"s%u\",[]],\"o\":{\"x\":true,\"y\":{}}}",
+                    (i > 0) ? "," : "", (unsigned int)i, (unsigned int)i * 7, (unsigned int)i);
+        TEST_CHECK(jsmntree_buffer_append(&input, row, n) == 0);
+    }
+    TEST_CHECK(jsmntree_buffer_append(&input, "],\"end\":null}", 13) == 0);
+
+    jsmntree_options_init(&options);
+    TEST_CHECK(jsmntree_parse_buffer(input.data, input.size, &options, &tree) == 0);
+    TEST_CHECK(tree != NULL && jsmntree_serialize_buffer(tree, NULL, &expected) == 0);
+    TEST_CHECK(expected.size == input.size);
+    jsmntree_free_tree(tree);
+
+    options.num_threads = 4;
+    for(i = 0; i < sizeof(flags) / sizeof(flags[0]); ++i)
+    {
+        options.flags   = flags[i];
+        output.size     = 0;
+        tree            = NULL;
+
+        TEST_CHECK(jsmntree_parse_buffer(input.data, input.size, &options, &tree) == 0);
+        TEST_CHECK(tree != NULL && jsmntree_serialize_buffer(tree, NULL, &output) == 0);
+        TEST_CHECK(output.size == expected.size && memcmp(output.data, expected.data, output.size) == 0);
+        jsmntree_free_tree(tree);
+    }
+
+    /* A name without its ':' in the last row, far from the first thread */
+    if(input.data != NULL && input.size > 32)
+    {
+        input.data[input.size - 32 + strcspn(&input.data[input.size - 32], ":")] = ' ';
+        options.flags = 0;
+        TEST_CHECK(jsmntree_parse_buffer(input.data, input.size, &options, &tree) == JSMN_ERROR_INVAL);
+        TEST_CHECK(tree == NULL);
+    }
+
+    jsmntree_buffer_free(&input);
+    jsmntree_buffer_free(&expected);
+    jsmntree_buffer_free(&output);
+}
+
+/* Trace of the events of a walk, one word each, and the event to stop at */
+typedef struct
+{
+    char    trace[256];
+    size_t  length;
+    int     stop_at;
+}
+test_sax_trace;
+
+static int
+test_sax_event(test_sax_trace * t, const char * event, const size_t length)
+{
+    if(t->length + length + 1 < sizeof(t->trace))
+    {
+        memcpy(&t->trace[t->length], event, length);
+        t->length += length;
+        t->trace[t->length++] = ' ';
+        t->trace[t->length] = '\0';
+    }
+
+    return --t->stop_at == 0;
+}
+
+static int
+test_sax_begin_object(void * context, const size_t size)
+{
+    char event[24];
+
+    return test_sax_event(context, event, sprintf(event, "{%u", (unsigned int)size));
+}
+
+static int
+test_sax_end_object(void * context)
+{
+    return test_sax_event(context, "}", 1);
+}
+
+static int
+test_sax_begin_array(void * context, const size_t size)
+{
+    char event[24];
+
+    return test_sax_event(context, event, sprintf(event, "[%u", (unsigned int)size));
+}
+
+static int
+test_sax_end_array(void * context)
+{
+    return test_sax_event(context, "]", 1);
+}
+
+static int
+test_sax_key(void * context, const char * name, const size_t length)
+{
+    return test_sax_event(context, name, length);
+}
+
+static int
+test_sax_value(void * context, const jsmntree_element * value)
+{
+    char event[24];
+
+    if(value->value_type == JSMNTREE_STRING)
+        return test_sax_event(context, JSMNTREE_VALUE_STRING(&value->value, value->value_length),
+                                value->value_length);
+
+    return test_sax_event(context, event, sprintf(event, "=%d", (int)value->value_type));
+}
+
+/* Events come in document order, the walk stops when told to, and only within the tokens */
+static void
+test_sax(void)
+{
+    static const char           js[]        = "{\"a\":[1,\"x\\ty\",{},-1.5],\"b\":{\"c\":null,\"d\":true}}";
+    static const char           expected[]  = "{2 a [4 =5 x\\ty {0 } =13 ] b {2 c =7 d =6 } } ";
+    const jsmntree_sax_handler  handler     =
+    {
+        test_sax_begin_object, test_sax_end_object,
+        test_sax_begin_array, test_sax_end_array,
+        test_sax_key, test_sax_value
+    };
+    const jsmntree_sax_handler  none        = { NULL, NULL, NULL, NULL, NULL, NULL };
+    test_sax_trace              t           = { "", 0, -1 };
+    jsmntok_t *                 tokens      = NULL;
+    unsigned int                capacity    = 0;
+    int                         num_tokens  = jsmntree_parse_tokens(js, sizeof(js) - 1, &tokens, &capacity);
+    jsmntok_t                   raw[32];
+    jsmn_parser                 parser;
+    char                        deep[2 * JSMNTREE_SAX_MAX_DEPTH + 3];
+    size_t                      i;
+
+    TEST_CHECK(num_tokens > 0);
+    if(num_tokens <= 0)
+    {
+        free(tokens);
+        return;
+    }
+
+    TEST_CHECK(jsmntree_sax_parse(js, tokens, num_tokens, &handler, &t) == 0);
+    TEST_CHECK(strcmp(t.trace, expected) == 0);
+    if(strcmp(t.trace, expected) != 0)
+        fprintf(stderr, "  got:      %s\n  expected: %s\n", t.trace, expected);
+
+    TEST_CHECK(jsmntree_sax_parse(js, tokens, num_tokens, &none, NULL) == 0);
+
+    /* Stopped at the fifth event */
+    t.length    = 0;
+    t.stop_at   = 5;
+    TEST_CHECK(jsmntree_sax_parse(js, tokens, num_tokens, &handler, &t) == 1);
+    TEST_CHECK(strcmp(t.trace, "{2 a [4 =5 x\\ty ") == 0);
+
+    /* Nested one level too deep */
+    for(i = 0; i <= JSMNTREE_SAX_MAX_DEPTH; ++i)
+    {
+        deep[i] = '[';
+        deep[2 * JSMNTREE_SAX_MAX_DEPTH + 1 - i] = ']';
+    }
+    deep[2 * JSMNTREE_SAX_MAX_DEPTH + 2] = '\0';
+
+    num_tokens = jsmntree_parse_tokens(deep, strlen(deep), &tokens, &capacity);
+    TEST_CHECK(num_tokens == JSMNTREE_SAX_MAX_DEPTH + 1);
+    if(num_tokens > 0)
+        TEST_CHECK(jsmntree_sax_parse(deep, tokens, num_tokens, &none, NULL) == JSMNTREE_ERROR_DEPTH);
+
+    /* The tokens jsmn makes of malformed JSON are walked within bounds */
+    for(i = 0; malformed[i] != NULL; ++i)
+    {
+        int num_raw;
+
+        TEST_CHECK(jsmntree_parse_tokens(malformed[i], strlen(malformed[i]), &tokens, &capacity) == JSMN_ERROR_INVAL);
+
+        jsmn_init(&parser);
+        num_raw = jsmn_parse(&parser, malformed[i], strlen(malformed[i]), raw, 32);
+        t.length    = 0;
+        t.stop_at   = -1;
+        if(num_raw > 0)
+            TEST_CHECK(jsmntree_sax_parse(malformed[i], raw, num_raw, &handler, &t) == 0);
+    }
+
+    free(tokens);
+}
+
+/* Only the members on a path are built, escaped names included, and malformed JSON is refused */
+static void
+test_projection(void)
+{
+    static const char *     paths[]     = { "/count", "/nested/array", "/other/*/b", "/a~1b", "/caf\xc3\xa9" };
+    static const char *     js          =
+        "{\"name\":\"x\",\"count\":42,\"nested\":{\"array\":[1,{\"y\":2}],\"empty\":{}},\"a/b\":3,"
+        "\"other\":{\"x\":{\"b\":[true],\"c\":1},\"y\":{\"c\":null},\"z\":{\"b\":2}},"
+        "\"caf\\u00e9\":\"escaped\",\"last\":[1,2]}";
+    static const char *     expected    =
+        "{\"count\":42,\"nested\":{\"array\":[1,{\"y\":2}]},\"a/b\":3,"
+        "\"other\":{\"x\":{\"b\":[true]},\"y\":{},\"z\":{\"b\":2}},\"caf\xc3\xa9\":\"escaped\"}";
+    static const char *     bad_paths[] = { "count" };
+    const char *            everything  = "";
+    jsmntree_projection *   projection  = jsmntree_projection_create(paths, 5);
+    jsmntree_options        options;
+    jsmntree_object *       tree        = NULL;
+    size_t                  i;
+
+    TEST_CHECK(projection != NULL);
+    TEST_CHECK(jsmntree_projection_create(bad_paths, 1) == NULL);
+    if(projection == NULL)
+        return;
+
+    jsmntree_options_init(&options);
+    options.projection = projection;
+
+    TEST_CHECK(jsmntree_parse_buffer(js, strlen(js), &options, &tree) == 0);
+    test_serialized(tree, expected);
+    jsmntree_free_tree(tree);
+
+    /* Lazy trees are not made with a projection */
+    options.flags = JSMNTREE_FLAG_LAZY | JSMNTREE_FLAG_FUSED;
+    TEST_CHECK(jsmntree_parse_buffer(js, strlen(js), &options, &tree) == 0);
+    test_serialized(tree, expected);
+    jsmntree_free_tree(tree);
+
+    for(i = 0; malformed[i] != NULL; ++i)
+    {
+        tree = (jsmntree_object *)1;
+        TEST_CHECK(jsmntree_parse_buffer(malformed[i], strlen(malformed[i]), &options, &tree) != 0);
+        TEST_CHECK(tree == NULL);
+    }
+
+    jsmntree_projection_free(projection);
+
+    /* An empty path selects everything */
+    projection          = jsmntree_projection_create(&everything, 1);
+    options.projection  = projection;
+    options.flags       = 0;
+    TEST_CHECK(projection != NULL);
+    TEST_CHECK(jsmntree_parse_buffer(test_document, strlen(test_document), &options, &tree) == 0);
+    test_serialized(tree, test_document);
+    jsmntree_free_tree(tree);
+    jsmntree_projection_free(projection);
+}
+
+/* A context makes tree after tree in the same memory, and survives malformed JSON */
+static void
+test_context(void)
+{
+    static const char *     small       = "{\"count\":1,\"nested\":{\"array\":[\"x\"]}}";
+    static const unsigned int flags[]   = { 0, JSMNTREE_FLAG_INTERN, JSMNTREE_FLAG_FUSED, JSMNTREE_FLAG_LAZY };
+    jsmntree_options        options;
+    jsmntree_context *      context;
+    jsmntree_object *       tree;
+    size_t                  i;
+    size_t                  j;
+
+    context = jsmntree_context_create(NULL);
+    TEST_CHECK(context != NULL);
+    if(context != NULL)
+    {
+        TEST_CHECK(jsmntree_context_parse(context, small, strlen(small), &tree) == 0);
+        test_serialized(tree, small);
+        jsmntree_reset(context);
+        jsmntree_reset(context);
+        jsmntree_context_destroy(context);
+    }
+
+    jsmntree_options_init(&options);
+    for(i = 0; i < sizeof(flags) / sizeof(flags[0]); ++i)
+    {
+        options.flags   = flags[i];
+        context         = jsmntree_context_create(&options);
+        TEST_CHECK(context != NULL);
+        if(context == NULL)
+            continue;
+
+        /* A big tree, then a smaller one in the memory left by it */
+        TEST_CHECK(jsmntree_context_parse(context, test_document, strlen(test_document), &tree) == 0);
+        test_serialized(tree, test_document);
+        TEST_CHECK(jsmntree_context_parse(context, small, strlen(small), &tree) == 0);
+        test_serialized(tree, small);
+
+        for(j = 0; malformed[j] != NULL; ++j)
+        {
+            tree = (jsmntree_object *)1;
+            TEST_CHECK(jsmntree_context_parse(context, malformed[j], strlen(malformed[j]), &tree) != 0);
+            TEST_CHECK(tree == NULL);
+        }
+
+        TEST_CHECK(jsmntree_context_parse(context, test_document, strlen(test_document), &tree) == 0);
+        test_serialized(tree, test_document);
+
+        jsmntree_context_destroy(context);
+    }
+}
+
+int
+main(void)
+{
+    test_round_trip();
+    test_mutation();
+    test_malformed();
+    test_query();
+    test_stats();
+    test_numbers();
+    test_fused();
+    test_tape();
+    test_binary();
+    test_escape();
+    test_inline_strings();
+    test_columns();
+    test_stream();
+    test_file();
+    test_batch();
+    test_parallel();
+    test_sax();
+    test_projection();
+    test_context();
+
+    if(failures != 0)
+    {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+
+    return 0;
+}